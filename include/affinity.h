@@ -0,0 +1,78 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef IMAGE_GP_6_AFFINITY_H
+#define IMAGE_GP_6_AFFINITY_H
+
+#include <blt/std/types.h>
+#include <sched.h>
+#include <string>
+#include <vector>
+
+// on machines with more than one numa node a thread which wanders between sockets ends up working on memory attached to the other one.
+// pinned workers stay on one cpu, and the per thread memory they render into is allocated after pinning so linux's first touch policy puts
+// it on the local node.
+
+struct cpu_topology_t
+{
+    // cpus this process may run on, grouped by node so consecutive workers fill one node before moving to the next
+    std::vector<int> cpus;
+    // node of each entry in cpus
+    std::vector<int> nodes;
+    blt::size_t node_count = 1;
+    // read through libnuma rather than sysfs
+    bool from_libnuma = false;
+    
+    // one line per node listing its cpus
+    [[nodiscard]] std::string describe() const;
+};
+
+struct affinity_settings_t
+{
+    // pin the threads rendering individuals to a cpu each
+    bool pin_workers = false;
+};
+
+inline affinity_settings_t affinity_settings;
+
+// detected and logged the first time it is asked for
+const cpu_topology_t& cpu_topology();
+
+void pin_current_thread(const std::vector<int>& cpus);
+
+// pins the calling thread to the cpu for a worker slot for as long as the placement lives, restoring its old affinity afterwards. does nothing
+// while pinning is off. the first time a thread is pinned to a node its scratch image is dropped so the next one is allocated there
+class worker_placement_t
+{
+    public:
+        explicit worker_placement_t(blt::size_t worker);
+        
+        worker_placement_t(const worker_placement_t&) = delete;
+        
+        worker_placement_t& operator=(const worker_placement_t&) = delete;
+        
+        ~worker_placement_t();
+    
+    private:
+        bool pinned = false;
+        cpu_set_t previous{};
+};
+
+// a worker slot for a thread which outlives a generation, like blt-gp's pool. assigned the first time the thread asks and kept after that
+blt::size_t persistent_worker_slot();
+
+#endif //IMAGE_GP_6_AFFINITY_H
@@ -0,0 +1,77 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_ANIMATION_H
+#define IMAGE_GP_6_ANIMATION_H
+
+#include <blt/gp/program.h>
+#include <fitness.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+struct animation_settings_t
+{
+    // evolve against every frame of load_animation instead of the still target
+    bool enabled = false;
+    // frames are picked evenly from the animation, rendering every frame of a long gif is rarely worth it
+    blt::size_t max_frames = 16;
+    // threads used to render the frames of a single individual
+    blt::size_t threads = 4;
+    // render subtrees which don't depend on the time terminal once and reuse them for every frame
+    bool fold_static = true;
+};
+
+struct animation_stats_t
+{
+    std::atomic_uint64_t evaluations = 0;
+    std::atomic_uint64_t total_ops = 0;
+    // ops which were evaluated once per individual instead of once per frame
+    std::atomic_uint64_t folded_ops = 0;
+    // frames in animation_frames, for threads which can't read it while the gp thread may be loading. kept across reset
+    std::atomic_uint64_t frames = 0;
+    
+    void reset()
+    {
+        evaluations = 0;
+        total_ops = 0;
+        folded_ops = 0;
+    }
+    
+    [[nodiscard]] double folded_fraction() const
+    {
+        return total_ops == 0 ? 0 : static_cast<double>(folded_ops) / static_cast<double>(total_ops);
+    }
+};
+
+inline animation_settings_t animation_settings;
+inline animation_stats_t animation_stats;
+inline std::vector<target_level_t> animation_frames;
+
+// decodes the gif at path (normally animation_image) into animation_frames, prepared at full resolution
+bool load_animation(const std::string& path);
+
+// copy of the tree with every time independent subtree replaced by an image literal holding its value. operators with random output are
+// treated as time dependent so folding never changes what a tree can produce.
+blt::gp::tree_t fold_time_independent(blt::gp::tree_t& tree, blt::size_t* folded_ops = nullptr);
+
+// renders and scores the tree at every frame, with the time terminal set to the frame's position in the animation. returns the mean
+// components over all frames and leaves the first frame in preview.
+fitness_components_t evaluate_animation(blt::gp::tree_t& tree, full_image_t& preview);
+
+#endif //IMAGE_GP_6_ANIMATION_H
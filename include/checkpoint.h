@@ -0,0 +1,45 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_CHECKPOINT_H
+#define IMAGE_GP_6_CHECKPOINT_H
+
+#include <blt/std/types.h>
+#include <string>
+
+// a checkpoint holds everything needed to carry on evolving the single population: every tree, the unweighted fitness terms and user
+// assigned fitness, the generation, the random state and a fingerprint of the target. the weights are not saved, fitness is recombined
+// from the terms when loading so a run can be resumed with different weights.
+inline constexpr auto DEFAULT_CHECKPOINT = "checkpoint.igck";
+
+// generations between automatic checkpoints to checkpoint_path, 0 to disable them. only read on the gp thread
+inline blt::size_t checkpoint_every = 0;
+inline std::string checkpoint_path = DEFAULT_CHECKPOINT;
+
+// captures the current population and hands it to a background thread to write. the file is written under a temporary name and renamed
+// over the old one, so a crash never leaves a partial checkpoint behind. must run on the gp thread between generations
+bool save_checkpoint(const std::string& path);
+
+// blocks until every captured checkpoint is on disk
+void flush_checkpoints();
+
+// replaces the population with the one in the checkpoint, loading the target it was made against if that isn't the current one. the file
+// is memory mapped and checked completely before anything is replaced. must run on the gp thread between generations
+bool load_checkpoint(const std::string& path);
+
+#endif //IMAGE_GP_6_CHECKPOINT_H
@@ -20,24 +20,41 @@
 #define IMAGE_GP_6_CONFIG_H
 
 #include <custom_transformer.h>
+#include <algorithm>
+#include <cstdlib>
+#include <string>
 
 inline constexpr size_t log2(size_t n) // NOLINT
 {
     return ((n < 2) ? 1 : 1 + log2(n / 2));
 }
 
-inline const blt::u64 SEED = std::random_device()();
+// the seed and thread count are read when the program is constructed, before main runs, so they can only be overridden from the environment
+inline blt::u64 environment_or(const char* name, blt::u64 fallback)
+{
+    auto value = std::getenv(name);
+    return value == nullptr ? fallback : std::stoull(value);
+}
+
+inline const blt::u64 SEED = environment_or("IMAGE_GP_SEED", std::random_device()());
 //inline const blt::u64 SEED = 125003014;
 inline constexpr blt::size_t IMAGE_SIZE = 128;
 inline constexpr blt::size_t IMAGE_PADDING = 16;
+// default population size. the real one is read from the environment when the program is constructed, like the seed
 inline constexpr blt::size_t POP_SIZE = 64;
+inline const blt::size_t population_size = std::max(environment_or("IMAGE_GP_POPULATION", POP_SIZE), blt::u64{1});
+// individuals the ui shows at once, snapshots only ever hold one page
+inline constexpr blt::size_t PAGE_SIZE = 64;
 inline constexpr blt::size_t CHANNELS = 3;
 inline constexpr blt::u64 u64_size_min = 1;
 inline constexpr blt::u64 u64_size_max = 9;
 inline constexpr float THRESHOLD = 0.5;
 //inline constexpr auto load_image = "../GSab4SWWcAA1TNR.png";
 inline constexpr auto load_image = "../hannah.png";
+// frames evolved against when the animated target is enabled
+inline constexpr auto animation_image = "../471289cde2490c80f60d5e85bcdfb6da.gif";
 inline constexpr blt::size_t MAX_ARG_C = 8;
+inline constexpr blt::size_t ELITE_COUNT = 2;
 
 inline blt::gp::image_crossover_t image_crossover;
 inline blt::gp::image_mutation_t image_mutation;
@@ -49,18 +66,23 @@ inline blt::gp::prog_config_t config = blt::gp::prog_config_t()
         .set_mutation(image_mutation)
         .set_initial_min_tree_size(4)
         .set_initial_max_tree_size(8)
-        .set_elite_count(2)
+        .set_elite_count(ELITE_COUNT)
         .set_max_generations(50)
         .set_mutation_chance(1.0)
         .set_crossover_chance(1.0)
         .set_reproduction_chance(0.5)
-        .set_pop_size(POP_SIZE)
-        .set_thread_count(0);
+        .set_pop_size(population_size)
+        .set_thread_count(environment_or("IMAGE_GP_THREADS", 0));
 
 inline constexpr blt::size_t DATA_SIZE = IMAGE_SIZE * IMAGE_SIZE;
 inline constexpr blt::size_t DATA_CHANNELS_SIZE = DATA_SIZE * CHANNELS;
 inline constexpr blt::size_t BOX_COUNT = static_cast<blt::size_t>(log2(IMAGE_SIZE / 2));
 
+// resolutions used by progressive evaluation, smallest first. the last level must always be the full IMAGE_SIZE
+inline constexpr std::array<blt::size_t, 3> RESOLUTION_LEVELS{IMAGE_SIZE / 4, IMAGE_SIZE / 2, IMAGE_SIZE};
+inline constexpr blt::size_t LEVEL_COUNT = RESOLUTION_LEVELS.size();
+static_assert(RESOLUTION_LEVELS[LEVEL_COUNT - 1] == IMAGE_SIZE);
+
 inline blt::gp::type_provider type_system;
 inline blt::gp::gp_program program{type_system, SEED, config};
 
@@ -0,0 +1,102 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef IMAGE_GP_6_COST_SCHEDULER_H
+#define IMAGE_GP_6_COST_SCHEDULER_H
+
+#include <blt/gp/program.h>
+#include <evaluation.h>
+#include <atomic>
+#include <array>
+#include <vector>
+
+// blt-gp hands each evaluation thread a fixed share of the population, but a tree of a few pointwise ops renders in microseconds while a
+// stack of bilateral filters takes tens of milliseconds. the cost scheduler predicts what every individual will cost from the operators in
+// its tree, deals them out most expensive first to per thread queues balanced by predicted cost, and lets a thread which runs dry steal from
+// whichever queue has the most left. an individual too large for any one thread is split into tiles which every thread can take.
+
+inline constexpr blt::size_t MAX_SCHEDULER_THREADS = 256;
+
+// predicted nanoseconds per operator, fitted online to how long whole trees actually took (normalized least mean squares). a tree's error is
+// shared among its operators in proportion to how often each appears in it.
+class cost_model_t
+{
+    public:
+        [[nodiscard]] double predict(blt::gp::tree_t& tree);
+        
+        void learn(blt::gp::tree_t& tree, double measured_ns);
+        
+        [[nodiscard]] const std::vector<double>& get_costs() const
+        {
+            return costs;
+        }
+        
+        // predict only reads the model once this has sized it for the operators, so several threads can predict at once
+        void ensure_costs();
+    
+    private:
+        std::vector<double> costs;
+        // scoring and copying the image, paid once per individual whatever its tree
+        double base_cost = 100000;
+};
+
+struct schedule_stats_t
+{
+    // per generation, threads past the thread count are left at zero
+    std::array<std::atomic_uint64_t, MAX_SCHEDULER_THREADS> busy_ns{};
+    std::atomic_uint64_t wall_ns = 0;
+    std::atomic_uint64_t threads = 0;
+    std::atomic_uint64_t steals = 0;
+    std::atomic_uint64_t split = 0;
+    std::atomic_uint64_t tiles = 0;
+    // absolute error of the predictions summed over the generation, as a fraction of the total measured cost
+    std::atomic<double> prediction_error = 0;
+    
+    void reset()
+    {
+        for (auto& busy : busy_ns)
+            busy = 0;
+        wall_ns = 0;
+        threads = 0;
+        steals = 0;
+        split = 0;
+        tiles = 0;
+        prediction_error = 0;
+    }
+    
+    [[nodiscard]] double utilization(blt::size_t thread) const
+    {
+        return wall_ns == 0 ? 0 : static_cast<double>(busy_ns[thread]) / static_cast<double>(wall_ns);
+    }
+    
+    [[nodiscard]] double utilization() const
+    {
+        double total = 0;
+        for (blt::size_t i = 0; i < threads; i++)
+            total += utilization(i);
+        return threads == 0 ? 0 : total / static_cast<double>(threads);
+    }
+};
+
+inline cost_model_t cost_model;
+inline schedule_stats_t schedule_stats;
+
+// renders and scores every individual the same way blt-gp's fitness pass would, leaving the results prepared. racing_threshold is the plain
+// difference racing aborts at, see get_racing_threshold(), infinity when racing is off. must run on the gp thread, which owns the cost model
+void scheduled_evaluate(blt::gp::population_t& pop, image_store_t& images, evaluation_result_t* results, double racing_threshold);
+
+#endif //IMAGE_GP_6_COST_SCHEDULER_H
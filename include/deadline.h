@@ -0,0 +1,133 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_DEADLINE_H
+#define IMAGE_GP_6_DEADLINE_H
+
+#include <images.h>
+#include <fitness.h>
+#include <blt/std/time.h>
+#include <atomic>
+#include <utility>
+
+// a wall clock limit on rendering a single individual, so one pathological tree can't hold up the generation. nothing is interrupted: once
+// the deadline passes every image operator returns an empty image without doing any work, the slow per pixel ones stop at the next row and
+// tiled renders skip the tiles left. the tree still evaluates to the end, so blt-gp's stack is unwound as it would be for any other tree,
+// and the individual is given the worst score there is.
+struct deadline_settings_t
+{
+    // milliseconds, 0 for no deadline
+    float deadline_ms = 0;
+};
+
+struct deadline_stats_t
+{
+    std::atomic_uint64_t timeouts = 0;
+    // totals up to the end of the last generation
+    blt::size_t total_timeouts = 0;
+    
+    void reset()
+    {
+        timeouts = 0;
+    }
+    
+    void finish_generation()
+    {
+        total_timeouts += timeouts;
+    }
+};
+
+inline deadline_settings_t deadline_settings;
+inline deadline_stats_t deadline_stats;
+
+// nanoseconds the individual the current thread is rendering has to finish by, 0 when it has no deadline
+inline thread_local blt::u64 evaluation_deadline = 0;
+
+inline bool deadline_passed()
+{
+    return evaluation_deadline != 0 && blt::system::getCurrentTimeNanoseconds() > evaluation_deadline;
+}
+
+// checked once per row by operators which spend long enough on every pixel that a whole image of them could blow the deadline
+inline bool row_deadline_passed(blt::size_t value)
+{
+    return value % (eval_region.width * CHANNELS) == 0 && deadline_passed();
+}
+
+// sets the deadline for the current thread, restoring the previous one when it goes out of scope
+class deadline_guard
+{
+    public:
+        // starts the configured deadline from now
+        deadline_guard(): deadline_guard(start_deadline())
+        {}
+        
+        // shares the deadline of an individual whose tiles are rendered by several threads
+        explicit deadline_guard(blt::u64 deadline): previous(evaluation_deadline)
+        {
+            evaluation_deadline = deadline;
+        }
+        
+        deadline_guard(const deadline_guard&) = delete;
+        
+        deadline_guard& operator=(const deadline_guard&) = delete;
+        
+        ~deadline_guard()
+        {
+            evaluation_deadline = previous;
+        }
+        
+        static blt::u64 start_deadline()
+        {
+            if (deadline_settings.deadline_ms <= 0)
+                return 0;
+            return blt::system::getCurrentTimeNanoseconds() + static_cast<blt::u64>(static_cast<double>(deadline_settings.deadline_ms) * 1e6);
+        }
+        
+        // replaces the score of an individual which ran past its deadline with the worst one, true when it did
+        bool finish(fitness_components_t& components) const
+        {
+            if (!deadline_passed())
+                return false;
+            components = worst_components();
+            deadline_stats.timeouts++;
+            return true;
+        }
+    
+    private:
+        blt::u64 previous;
+};
+
+template<typename Func, typename Return, typename... Args>
+auto cancellable_with(Func func, Return (Func::*)(Args...) const)
+{
+    return [func](Args... args) -> Return {
+        if (deadline_passed())
+            return Return{};
+        return func(std::forward<Args>(args)...);
+    };
+}
+
+// wraps an operator so it does nothing once the deadline has passed, keeping its exact signature for blt-gp
+template<typename Func>
+auto cancellable(Func func)
+{
+    return cancellable_with(func, &Func::operator());
+}
+
+#endif //IMAGE_GP_6_DEADLINE_H
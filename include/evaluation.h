@@ -0,0 +1,176 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_EVALUATION_H
+#define IMAGE_GP_6_EVALUATION_H
+
+#include <blt/gp/program.h>
+#include <fitness.h>
+#include <image_store.h>
+#include <atomic>
+
+enum class racing_threshold_t : blt::i32
+{
+    // abort anything further from the target than the worst elite of the last generation
+    WORST_ELITE,
+    // abort anything further from the target than the given percentile of the last generation
+    PERCENTILE
+};
+
+struct evaluation_settings_t
+{
+    // screen every individual at the lowest resolution and only promote the best to the next level
+    bool progressive = false;
+    // fraction of the individuals at each level which get promoted to the next
+    std::array<float, LEVEL_COUNT - 1> promotion_ratios{0.25f, 0.5f};
+    
+    // render and score a tile at a time, giving up on individuals already further from the target than the threshold individual
+    bool racing = false;
+    racing_threshold_t racing_threshold = racing_threshold_t::WORST_ELITE;
+    float racing_percentile = 0.5f;
+    blt::size_t tile_size = 32;
+    
+    // evaluate the whole tree one tile at a time so the intermediate images stay in cache
+    bool tiled = false;
+    // threads used to render the tiles of a single individual, on top of blt-gp's own evaluation threads
+    blt::size_t tile_threads = 1;
+    
+    // render the generation on work stealing threads, most expensive individuals first, see cost_scheduler.h
+    bool cost_scheduling = false;
+    // 0 uses every core
+    blt::size_t scheduler_threads = 0;
+    // individuals predicted to cost more than this share of a thread's work are split into tiles rendered by several threads
+    bool split_expensive = true;
+    float split_share = 0.5f;
+};
+
+struct tile_benchmark_t
+{
+    blt::size_t individuals = 0;
+    // individuals whose halo didn't fit and were rendered whole in both modes
+    blt::size_t untiled = 0;
+    double whole_ms = 0;
+    double tiled_ms = 0;
+    // largest difference between a tiled and whole render, ignoring trees with random noise in them
+    double max_error = 0;
+    blt::size_t mismatches = 0;
+};
+
+struct progressive_stats_t
+{
+    // renders performed at each level during the last generation
+    std::array<blt::size_t, LEVEL_COUNT> evaluations{};
+    blt::size_t full_avoided = 0;
+    blt::size_t total_full_avoided = 0;
+    blt::size_t total_individuals = 0;
+};
+
+struct racing_stats_t
+{
+    std::atomic_uint64_t raced = 0;
+    std::atomic_uint64_t aborted = 0;
+    // individuals whose halo was too large to split into tiles
+    std::atomic_uint64_t fallbacks = 0;
+    std::atomic_uint64_t tiles = 0;
+    std::atomic_uint64_t tiles_skipped = 0;
+    
+    // totals up to the end of the last generation
+    blt::size_t total_tiles = 0;
+    blt::size_t total_tiles_skipped = 0;
+    
+    void reset()
+    {
+        raced = 0;
+        aborted = 0;
+        fallbacks = 0;
+        tiles = 0;
+        tiles_skipped = 0;
+    }
+    
+    void finish_generation()
+    {
+        total_tiles += tiles;
+        total_tiles_skipped += tiles_skipped;
+    }
+    
+    [[nodiscard]] double skipped_fraction() const
+    {
+        return tiles == 0 ? 0 : static_cast<double>(tiles_skipped) / static_cast<double>(tiles);
+    }
+    
+    [[nodiscard]] double total_skipped_fraction() const
+    {
+        return total_tiles == 0 ? 0 : static_cast<double>(total_tiles_skipped) / static_cast<double>(total_tiles);
+    }
+};
+
+// result of scoring an individual outside of blt-gp's fitness pass
+struct evaluation_result_t
+{
+    fitness_components_t components;
+    // resolution level the components were measured at
+    blt::size_t level = LEVEL_COUNT - 1;
+    // set when the individual was already rendered and scored this generation
+    bool prepared = false;
+    // racing gave up on this individual, the components are worst_components() rather than its real score
+    bool aborted = false;
+    // what the cost model expected rendering it to take, see evaluation_cost.h
+    double predicted_ns = 0;
+    // how long blt-gp's fitness pass or steady state took to render and score it, 0 once learned from or when rendered elsewhere
+    blt::u64 measured_ns = 0;
+};
+
+inline evaluation_settings_t evaluation_settings;
+inline progressive_stats_t progressive_stats;
+inline racing_stats_t racing_stats;
+inline tile_benchmark_t tile_benchmark;
+// added to the fitness of individuals progressive evaluation screened out at each level, see update_screening_penalties()
+inline std::array<double, LEVEL_COUNT> screening_penalties{};
+
+[[nodiscard]] inline double screening_penalty(const evaluation_result_t& result)
+{
+    return screening_penalties[result.level];
+}
+
+full_image_t render_tree(blt::gp::tree_t& tree, blt::size_t size = IMAGE_SIZE);
+
+// renders the population at each resolution level in turn, promoting the best fraction each time. individuals which are screened out keep
+// the score from their highest level, and retained ones have their image stretched back over the canvas.
+void progressive_evaluate(blt::gp::population_t& pop, image_store_t& images, evaluation_result_t* results);
+
+// scores from a lower level can beat scores from a higher one, so each level below the top is pushed up far enough that everyone screened
+// out there ranks below everyone who made it further. order within a level is kept
+void update_screening_penalties(const evaluation_result_t* results, blt::size_t count);
+
+// picks the threshold individual from the population before it is replaced and returns its plain difference, the sum of compare_values
+// over the whole image without score_image's near match discount
+double get_racing_threshold(blt::gp::population_t& pop);
+
+// renders the tree a tile at a time, summing the plain difference as it goes. once the sum passes the threshold the individual is abandoned
+// and given worst_components(). individuals which finish are scored by score_image as usual.
+// this is a heuristic: the discount and the fractal and histogram terms can still rank an aborted individual above the threshold one.
+// score_image's discount shrinks the running total multiplicatively, so no partial image bounds the real fitness tightly enough to abort.
+void race_tree(blt::gp::tree_t& tree, full_image_t& image, evaluation_result_t& result, double threshold);
+
+// renders the tree into image a tile at a time. returns false if the tree's halo was too large and it had to be rendered whole.
+bool render_tree_tiled(blt::gp::tree_t& tree, full_image_t& image);
+
+// renders every individual both whole and tiled, timing each and checking the results agree. results are left in tile_benchmark.
+void benchmark_tiled_evaluation(blt::gp::population_t& pop);
+
+#endif //IMAGE_GP_6_EVALUATION_H
@@ -0,0 +1,84 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_EVALUATION_COST_H
+#define IMAGE_GP_6_EVALUATION_COST_H
+
+#include <blt/gp/program.h>
+#include <evaluation.h>
+#include <atomic>
+
+// what an individual costs to render is predicted from the operators in its tree by the cost model in cost_scheduler.h, which learns from how
+// long individuals actually took. the prediction is added to the fitness through cost_weight, and offspring predicted to take longer than the
+// budget are thrown away before anything renders them, so trees made of stacked blurs and bilateral filters stop slowing down every
+// generation after them.
+struct cost_budget_settings_t
+{
+    // milliseconds, 0 for no budget
+    float budget_ms = 0;
+};
+
+struct cost_budget_stats_t
+{
+    // offspring thrown away for being over the budget
+    std::atomic_uint64_t rejected = 0;
+    std::atomic_uint64_t predicted = 0;
+    std::atomic_uint64_t predicted_ns = 0;
+    
+    void reset()
+    {
+        rejected = 0;
+        predicted = 0;
+        predicted_ns = 0;
+    }
+    
+    void add(double ns)
+    {
+        predicted++;
+        predicted_ns += static_cast<blt::u64>(ns);
+    }
+    
+    [[nodiscard]] double mean_predicted_ms() const
+    {
+        return predicted == 0 ? 0 : static_cast<double>(predicted_ns) / static_cast<double>(predicted) / 1e6;
+    }
+};
+
+inline cost_budget_settings_t cost_budget_settings;
+inline cost_budget_stats_t cost_budget_stats;
+
+[[nodiscard]] inline bool within_cost_budget(double predicted_ns)
+{
+    return cost_budget_settings.budget_ms <= 0 || predicted_ns <= static_cast<double>(cost_budget_settings.budget_ms) * 1e6;
+}
+
+// the fitness term weighted by cost_weight, added on top of the components
+[[nodiscard]] inline double cost_penalty(const evaluation_result_t& result)
+{
+    return result.predicted_ns / 1e6 * cost_weight;
+}
+
+// predicts what every offspring of a new generation costs and replaces each one over the budget with a copy of a random offspring within
+// it, before the generation is rendered. must run on the gp thread
+void enforce_cost_budget(blt::gp::population_t& pop, evaluation_result_t* results);
+
+// teaches the cost model what the individuals rendered since the last call took. the cost scheduler and the farm measure their own renders,
+// this covers blt-gp's fitness pass and steady state. must run on the gp thread while nothing is rendering
+void learn_costs(blt::gp::population_t& pop, evaluation_result_t* results);
+
+#endif //IMAGE_GP_6_EVALUATION_COST_H
@@ -0,0 +1,121 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_FARM_H
+#define IMAGE_GP_6_FARM_H
+
+#include <blt/gp/program.h>
+#include <evaluation.h>
+#include <image_store.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+inline constexpr auto DEFAULT_FARM_SOCKET = "/tmp/image-gp-6-farm.sock";
+
+struct farm_stats_t
+{
+    blt::size_t workers = 0;
+    // individuals scored remotely and locally (no workers, or every worker died mid batch) in the last generation
+    blt::size_t remote = 0;
+    blt::size_t local = 0;
+    // trees sent again after the worker they were on disconnected, over the whole run
+    blt::size_t resent = 0;
+    // workers cut off for sitting on their trees far longer than predicted, over the whole run
+    blt::size_t timeouts = 0;
+    double batch_ms = 0;
+};
+
+struct farm_worker_t;
+
+// hands the rendering and scoring of a generation to worker processes (image-gp-6-worker) connected over a unix socket. workers connect
+// to the farm, so they can be started, killed and restarted at any time; a tree which was on a worker when it disconnected goes back into
+// the queue. each tree goes to the worker with the least predicted outstanding work, predictions come from every worker's measured time
+// per operator, so slow or busy machines are given less.
+class eval_farm_t
+{
+    public:
+        eval_farm_t() = default;
+        
+        eval_farm_t(const eval_farm_t&) = delete;
+        
+        eval_farm_t& operator=(const eval_farm_t&) = delete;
+        
+        // listens for workers, who are told to prepare target_path. thumbnails has the workers send back the images of retained individuals
+        bool start(const std::string& socket_path, const std::string& target_path, bool thumbnails = true);
+        
+        void stop();
+        
+        [[nodiscard]] bool is_running() const
+        {
+            return listen_fd >= 0;
+        }
+        
+        [[nodiscard]] blt::size_t worker_count() const;
+        
+        [[nodiscard]] const std::string& get_target() const
+        {
+            return target_path;
+        }
+        
+        // scores every individual on the workers, marking each result prepared so the fitness pass doesn't render it again. anything the
+        // workers couldn't do is left unprepared and is rendered locally as usual. must be called from the gp thread.
+        void evaluate(blt::gp::population_t& pop, image_store_t& images, evaluation_result_t* results);
+        
+        [[nodiscard]] farm_stats_t get_stats() const;
+        
+        ~eval_farm_t();
+    
+    private:
+        void accept_workers();
+        
+        void read_results(std::shared_ptr<farm_worker_t> worker);
+        
+        void drop_worker(farm_worker_t& worker);
+        
+        mutable std::mutex mutex;
+        std::condition_variable changed;
+        std::vector<std::shared_ptr<farm_worker_t>> workers;
+        std::thread acceptor;
+        int listen_fd = -1;
+        std::string socket_path;
+        std::string target_path;
+        bool thumbnails = true;
+        std::atomic_bool stopping = false;
+        
+        // the batch being evaluated, only touched with the mutex held
+        blt::u64 batch = 0;
+        image_store_t* batch_images = nullptr;
+        evaluation_result_t* batch_results = nullptr;
+        std::vector<bool> finished;
+        std::deque<blt::size_t> pending;
+        blt::size_t remaining = 0;
+        farm_stats_t stats;
+};
+
+inline eval_farm_t eval_farm;
+
+// the worker side, renders whatever the farm at socket_path sends. reconnects whenever the farm goes away, only returns on a fatal error
+int run_farm_worker(const std::string& socket_path);
+
+#endif //IMAGE_GP_6_FARM_H
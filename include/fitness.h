@@ -0,0 +1,94 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_FITNESS_H
+#define IMAGE_GP_6_FITNESS_H
+
+#include <images.h>
+#include "opencv2/imgproc.hpp"
+
+inline float difference_weight = 0.01;
+inline float fractal_weight = 1;
+inline float histogram_weight = 2.0;
+// fitness added per millisecond an individual is predicted to take to render, see evaluation_cost.h
+inline float cost_weight = 0;
+
+// given to images whose fractal dimension comes out as NaN
+inline constexpr double NAN_FRACTAL = 400;
+
+constexpr float compare_values(float a, float b)
+{
+    if (std::isnan(a) || std::isnan(b) || std::isinf(a) || std::isinf(b))
+        return IMAGE_SIZE;
+    auto dist = a - b;
+    //BLT_TRACE(std::sqrt(dist * dist));
+    return std::sqrt(dist * dist);
+}
+
+struct fractal_stats
+{
+    blt::f64 r, g, b, total, combined;
+};
+
+// unweighted fitness terms, kept around so a change in weights doesn't require the image to be scored again
+struct fitness_components_t
+{
+    double difference = 0;
+    double fractal = 0;
+    double histogram = 0;
+    
+    [[nodiscard]] double combine() const
+    {
+        return (difference * difference_weight) + (fractal * fractal_weight) + (histogram * histogram_weight);
+    }
+};
+
+// what an image of nothing but NaNs scores, every pixel as far from the target as compare_values allows
+inline fitness_components_t worst_components()
+{
+    return {static_cast<double>(IMAGE_SIZE * DATA_CHANNELS_SIZE), NAN_FRACTAL, 1};
+}
+
+// the target image prepared for scoring at a single resolution
+struct target_level_t
+{
+    blt::size_t size = IMAGE_SIZE;
+    full_image_t image;
+    cv::Mat hsv;
+    cv::Mat hist;
+    fractal_stats fractal{};
+};
+
+inline std::array<target_level_t, LEVEL_COUNT> target_levels;
+
+inline target_level_t& full_target()
+{
+    return target_levels.back();
+}
+
+// resizes the image to size x size and computes everything scoring needs from it
+void prepare_target(target_level_t& level, const stb_image_t& image, blt::size_t size);
+
+void setup_targets(const stb_image_t& image);
+
+fractal_stats get_fractal_value(const full_image_t& image, blt::size_t size = IMAGE_SIZE);
+
+// scores an image packed at target.size x target.size. the difference term is rescaled so every level is comparable to full resolution
+fitness_components_t score_image(const full_image_t& image, const target_level_t& target);
+
+#endif //IMAGE_GP_6_FITNESS_H
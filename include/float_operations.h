@@ -19,22 +19,23 @@
 #include <blt/gp/program.h>
 #include <functional>
 #include <helper.h>
+#include <operator_profiler.h>
 
 #ifndef IMAGE_GP_6_FLOAT_OPERATIONS_H
 #define IMAGE_GP_6_FLOAT_OPERATIONS_H
 
-inline blt::gp::operation_t f_add([](float a, float b) {
+inline blt::gp::operation_t f_add(profiled("f_add", [](float a, float b) {
     return a + b;
-}, "f_add");
-inline blt::gp::operation_t f_sub([](float a, float b) {
+}), "f_add");
+inline blt::gp::operation_t f_sub(profiled("f_sub", [](float a, float b) {
     return a - b;
-}, "f_sub");
-inline blt::gp::operation_t f_mul([](float a, float b) {
+}), "f_sub");
+inline blt::gp::operation_t f_mul(profiled("f_mul", [](float a, float b) {
     return a * b;
-}, "f_mul");
-inline blt::gp::operation_t f_pro_div([](float a, float b) {
+}), "f_mul");
+inline blt::gp::operation_t f_pro_div(profiled("f_div", [](float a, float b) {
     return b == 0.0f ? 0.0f : (a / b);
-}, "f_div");
+}), "f_div");
 inline auto f_literal = blt::gp::operation_t([]() {
     return program.get_random().get_float(0.0, 1.0);
 }, "float_lit").set_ephemeral();
@@ -0,0 +1,112 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_GP_SYSTEM_H
+#define IMAGE_GP_6_GP_SYSTEM_H
+
+// everything needed to evolve images which doesn't depend on a window, shared by the gui and the headless runner
+
+#include <blt/gp/program.h>
+#include <config.h>
+#include <evaluation.h>
+#include <image_store.h>
+#include <shared_view.h>
+#include <string>
+#include <vector>
+
+// built once by setup_operators, every program (the main one and each island) is handed a copy
+inline blt::gp::operator_storage operator_set;
+
+// fitness assigned by clicking on an individual in the gui, negative when unset
+inline std::vector<double> fitness_values(population_size, -1);
+inline double last_fitness = 0;
+// false while blt-gp re-evaluates the old population before breeding, the images from the last pass are still valid then
+inline bool evaluate = true;
+
+inline image_store_t generation_images;
+inline std::vector<evaluation_result_t> evaluation_results(population_size);
+
+// page of the population shown by the ui, only those individuals keep their rendered image. only touched on the gp thread
+inline blt::size_t visible_page = 0;
+
+// path of the target currently prepared in target_levels, empty until setup_target succeeds
+inline std::string loaded_target;
+
+// only loaded when the target cache is cold
+inline stb_image_t full_base_image;
+
+// the program's population only exists once generate_population has run, after that it is reset instead
+inline bool population_generated = false;
+
+// generations run before the population was restored from a checkpoint, blt-gp's own counter starts over at zero
+inline blt::size_t generation_offset = 0;
+
+inline double racing_threshold = 0;
+inline bool racing_threshold_valid = false;
+
+// every generation's best individual (and optionally the whole population) is handed to the background writer
+inline bool timelapse = false;
+inline bool timelapse_population = false;
+inline std::string timelapse_directory = "timelapse";
+
+// every published snapshot is mirrored here once sharing is enabled, see share_view
+inline shared_view_host_t shared_view;
+
+// registers the types and operators with the program. shared by the gui and the command line renderer, which never opens a window
+void setup_operators();
+
+// prepares every resolution level of the target, from the cache if possible. false if the image can't be loaded
+bool setup_target(const std::string& path);
+
+void generate_population();
+
+// starts over with a fresh random population, generating the first one if needed. must run on the gp thread
+void reset_population();
+
+void execute_generation();
+
+// generation of the current population, including the ones run before it was restored from a checkpoint
+blt::size_t current_generation();
+
+// index of the individual with the highest adjusted fitness in the current population
+blt::size_t best_individual();
+
+// the individual's rendered image, rendered again into the gp thread's scratch image if it wasn't retained. must run on the gp thread
+const full_image_t& individual_image(blt::size_t index);
+
+// makes page the one retained and published to the ui, rendering its individuals. must run on the gp thread
+void show_page(blt::size_t page);
+
+void write_timelapse_frame();
+
+void print_stats();
+
+// copies the current population's images and fitness into the next ui snapshot and publishes it
+void publish_snapshot();
+
+// gives the individual the next user assigned fitness, the same as clicking on it. only call it from the gp thread, through scheduler.post
+void mark_individual(blt::size_t index);
+
+// prints the individual's tree and saves it to tree_<index>.igpt once the current generation is done
+void save_individual(blt::size_t index);
+
+// lets viewers started with 'image-gp-6 attach <name>' watch this process. allow_control is false when something else (the headless runner)
+// decides how many generations run, viewers can then only mark and save individuals
+bool share_view(const std::string& name, bool allow_control);
+
+#endif //IMAGE_GP_6_GP_SYSTEM_H
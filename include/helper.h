@@ -27,7 +27,8 @@ constexpr static auto make_single(SINGLE_FUNC&& func)
 {
     return [func](const full_image_t& a) {
         full_image_t img{};
-        for (blt::size_t i = 0; i < DATA_CHANNELS_SIZE; i++)
+        const auto size = eval_region.channels_size();
+        for (blt::size_t i = 0; i < size; i++)
             img.rgb_data[i] = func(a.rgb_data[i]);
         return img;
     };
@@ -38,7 +39,8 @@ constexpr static auto make_double(DOUBLE_FUNC&& func)
 {
     return [func](const full_image_t& a, const full_image_t& b) {
         full_image_t img{};
-        for (blt::size_t i = 0; i < DATA_CHANNELS_SIZE; i++)
+        const auto size = eval_region.channels_size();
+        for (blt::size_t i = 0; i < size; i++)
             img.rgb_data[i] = func(a.rgb_data[i], b.rgb_data[i]);
         return img;
     };
@@ -49,27 +51,30 @@ struct context
     float x, y;
 };
 
+// canvas coordinates of the value at index i in the current region
 inline context get_ctx(blt::size_t i)
 {
     context ctx{};
     i /= CHANNELS;
-    ctx.y = std::floor(static_cast<float>(i) / static_cast<float>(IMAGE_SIZE));
-    ctx.x = static_cast<float>(i) - (ctx.y * IMAGE_SIZE);
+    auto y = std::floor(static_cast<float>(i) / static_cast<float>(eval_region.width));
+    auto x = static_cast<float>(i) - (y * static_cast<float>(eval_region.width));
+    ctx.x = eval_region.offset_x + x * eval_region.scale;
+    ctx.y = eval_region.offset_y + y * eval_region.scale;
     return ctx;
 }
 
 inline context get_pop_ctx(blt::size_t i)
 {
-    auto const sq = static_cast<float>(std::sqrt(POP_SIZE));
+    auto const sq = static_cast<float>(std::sqrt(PAGE_SIZE));
     context ctx{};
     ctx.y = std::floor(static_cast<float>(i) / static_cast<float>(sq));
     ctx.x = static_cast<float>(i) - (ctx.y * sq);
     return ctx;
 }
 
-inline blt::size_t get_index(blt::size_t x, blt::size_t y)
+inline blt::size_t get_index(blt::size_t x, blt::size_t y, blt::size_t width = IMAGE_SIZE)
 {
-    return y * IMAGE_SIZE + x;
+    return y * width + x;
 }
 
 inline float perlin_noise(float x, float y, float z)
@@ -20,6 +20,8 @@
 #include <blt/gp/program.h>
 #include <functional>
 #include <helper.h>
+#include <operator_profiler.h>
+#include <deadline.h>
 #include <stb_perlin.h>
 #include "opencv2/imgcodecs.hpp"
 #include "opencv2/imgproc.hpp"
@@ -27,91 +29,159 @@
 #ifndef IMAGE_GP_6_IMAGE_OPERATIONS_H
 #define IMAGE_GP_6_IMAGE_OPERATIONS_H
 
-inline blt::gp::operation_t add(make_double(std::plus()), "add");
-inline blt::gp::operation_t sub(make_double(std::minus()), "sub");
-inline blt::gp::operation_t mul(make_double(std::multiplies()), "mul");
-inline blt::gp::operation_t pro_div([](const full_image_t& a, const full_image_t& b) {
+inline blt::gp::operation_t add(cancellable(profiled("add", make_double(std::plus()))), "add");
+inline blt::gp::operation_t sub(cancellable(profiled("sub", make_double(std::minus()))), "sub");
+inline blt::gp::operation_t mul(cancellable(profiled("mul", make_double(std::multiplies()))), "mul");
+inline blt::gp::operation_t pro_div(cancellable(profiled("div", [](const full_image_t& a, const full_image_t& b) {
     full_image_t img{};
-    for (blt::size_t i = 0; i < DATA_CHANNELS_SIZE; i++)
+    const auto size = eval_region.channels_size();
+    for (blt::size_t i = 0; i < size; i++)
         img.rgb_data[i] = b.rgb_data[i] == 0 ? 0 : (a.rgb_data[i] / b.rgb_data[i]);
     return img;
-}, "div");
-inline blt::gp::operation_t op_sin(make_single([](float a) {
+})), "div");
+inline blt::gp::operation_t op_sin(cancellable(profiled("sin", make_single([](float a) {
     return (std::sin(a) + 1.0f) / 2.0f;
-}), "sin");
-inline blt::gp::operation_t op_cos(make_single([](float a) {
+}))), "sin");
+inline blt::gp::operation_t op_cos(cancellable(profiled("cos", make_single([](float a) {
     return (std::cos(a) + 1.0f) / 2.0f;
-}), "cos");
-inline blt::gp::operation_t op_atan(make_single((float (*)(float)) &std::atan), "atan");
-inline blt::gp::operation_t op_exp(make_single((float (*)(float)) &std::exp), "exp");
-inline blt::gp::operation_t op_abs(make_single((float (*)(float)) &std::abs), "abs");
-inline blt::gp::operation_t op_log(make_single((float (*)(float)) &std::log), "log");
-inline blt::gp::operation_t op_round(make_single([](float f) { return std::round(f * 255.0f) / 255.0f; }), "round");
-inline blt::gp::operation_t op_v_mod([](const full_image_t& a, const full_image_t& b) {
+}))), "cos");
+inline blt::gp::operation_t op_atan(cancellable(profiled("atan", make_single((float (*)(float)) &std::atan))), "atan");
+inline blt::gp::operation_t op_exp(cancellable(profiled("exp", make_single((float (*)(float)) &std::exp))), "exp");
+inline blt::gp::operation_t op_abs(cancellable(profiled("abs", make_single((float (*)(float)) &std::abs))), "abs");
+inline blt::gp::operation_t op_log(cancellable(profiled("log", make_single((float (*)(float)) &std::log))), "log");
+inline blt::gp::operation_t op_round(cancellable(profiled("round", make_single([](float f) {
+    return std::round(f * 255.0f) / 255.0f;
+}))), "round");
+inline blt::gp::operation_t op_v_mod(cancellable(profiled("v_mod", [](const full_image_t& a, const full_image_t& b) {
     full_image_t img{};
-    for (blt::size_t i = 0; i < DATA_CHANNELS_SIZE; i++)
+    const auto size = eval_region.channels_size();
+    for (blt::size_t i = 0; i < size; i++)
         img.rgb_data[i] = b.rgb_data[i] <= 0 ? 0 : static_cast<float>(blt::mem::type_cast<unsigned int>(a.rgb_data[i]) %
                                                                       blt::mem::type_cast<unsigned int>(b.rgb_data[i]));
     return img;
-}, "v_mod");
+})), "v_mod");
 
-inline blt::gp::operation_t bitwise_and([](const full_image_t& a, const full_image_t& b) {
+inline blt::gp::operation_t bitwise_and(cancellable(profiled("and", [](const full_image_t& a, const full_image_t& b) {
     using blt::mem::type_cast;
     full_image_t img{};
-    for (blt::size_t i = 0; i < DATA_CHANNELS_SIZE; i++)
+    const auto size = eval_region.channels_size();
+    for (blt::size_t i = 0; i < size; i++)
         img.rgb_data[i] = static_cast<float>(type_cast<unsigned int>(a.rgb_data[i]) & type_cast<unsigned int>(b.rgb_data[i]));
     return img;
-}, "and");
+})), "and");
 
-inline blt::gp::operation_t bitwise_or([](const full_image_t& a, const full_image_t& b) {
+inline blt::gp::operation_t bitwise_or(cancellable(profiled("or", [](const full_image_t& a, const full_image_t& b) {
     using blt::mem::type_cast;
     full_image_t img{};
-    for (blt::size_t i = 0; i < DATA_CHANNELS_SIZE; i++)
+    const auto size = eval_region.channels_size();
+    for (blt::size_t i = 0; i < size; i++)
         img.rgb_data[i] = static_cast<float>(type_cast<unsigned int>(a.rgb_data[i]) | type_cast<unsigned int>(b.rgb_data[i]));
     return img;
-}, "or");
+})), "or");
 
-inline blt::gp::operation_t bitwise_invert([](const full_image_t& a) {
+inline blt::gp::operation_t bitwise_invert(cancellable(profiled("invert", [](const full_image_t& a) {
     using blt::mem::type_cast;
     full_image_t img{};
-    for (blt::size_t i = 0; i < DATA_CHANNELS_SIZE; i++)
+    const auto size = eval_region.channels_size();
+    for (blt::size_t i = 0; i < size; i++)
         img.rgb_data[i] = static_cast<float>(~type_cast<unsigned int>(a.rgb_data[i]));
     return img;
-}, "invert");
+})), "invert");
 
-inline blt::gp::operation_t bitwise_xor([](const full_image_t& a, const full_image_t& b) {
+inline blt::gp::operation_t bitwise_xor(cancellable(profiled("xor", [](const full_image_t& a, const full_image_t& b) {
     using blt::mem::type_cast;
     full_image_t img{};
-    for (blt::size_t i = 0; i < DATA_CHANNELS_SIZE; i++)
+    const auto size = eval_region.channels_size();
+    for (blt::size_t i = 0; i < size; i++)
     {
         auto in_a = type_cast<unsigned int>(a.rgb_data[i]);
         auto in_b = type_cast<unsigned int>(b.rgb_data[i]);
         img.rgb_data[i] = static_cast<float>(in_a ^ in_b);
     }
     return img;
-}, "xor");
+})), "xor");
 
-inline blt::gp::operation_t dissolve([](const full_image_t& a, const full_image_t& b) {
+inline blt::gp::operation_t dissolve(cancellable(profiled("dissolve", [](const full_image_t& a, const full_image_t& b) {
     using blt::mem::type_cast;
     full_image_t img{};
-    for (blt::size_t i = 0; i < DATA_CHANNELS_SIZE; i++)
+    const auto size = eval_region.channels_size();
+    for (blt::size_t i = 0; i < size; i++)
     {
         auto diff = (a.rgb_data[i] - b.rgb_data[i]) / 2.0f;
         img.rgb_data[i] = a.rgb_data[i] + diff;
     }
     return img;
-}, "dissolve");
+})), "dissolve");
 
-//inline blt::gp::operation_t band_pass([](const full_image_t& a, blt::u64 lp, blt::u64 hp) {
-inline blt::gp::operation_t band_pass([](const full_image_t& a, float fa, float fb, blt::u64 size) {
-    cv::Mat src(IMAGE_SIZE, IMAGE_SIZE, CV_32FC3, const_cast<float*>(a.rgb_data));
-    full_image_t img{};
-    std::memcpy(img.rgb_data, a.rgb_data, DATA_CHANNELS_SIZE * sizeof(float));
+// wraps the active region of an image without copying it
+inline cv::Mat make_mat(const full_image_t& image)
+{
+    return cv::Mat{static_cast<int>(eval_region.height), static_cast<int>(eval_region.width), CV_32FC3, const_cast<float*>(image.rgb_data)};
+}
+
+// opencv's default sigma for a kernel of the given size
+inline double kernel_sigma(blt::u64 size)
+{
+    return 0.3 * ((static_cast<double>(size) - 1) * 0.5 - 1) + 0.8;
+}
+
+// the chain of blurs used by gaussian_blur and high_pass is equivalent to one blur with the summed variance
+inline double chained_blur_sigma(blt::u64 size)
+{
+    double variance = 0;
+    for (blt::u64 i = 3; i < size; i += 2)
+        variance += kernel_sigma(i) * kernel_sigma(i);
+    return std::sqrt(variance);
+}
+
+// number of pixels on each side of the output chained_blur reads from in the current region
+inline blt::size_t chained_blur_radius(blt::u64 size)
+{
+    if (size % 2 == 0)
+        size++;
     
-    cv::Mat dst{IMAGE_SIZE, IMAGE_SIZE, CV_32FC3, img.rgb_data};
+    if (eval_region.kernel_scale == 1)
+    {
+        blt::size_t radius = 0;
+        for (blt::u64 i = 3; i < size; i += 2)
+            radius += i / 2;
+        return radius;
+    }
+    
+    auto sigma = chained_blur_sigma(size) / eval_region.kernel_scale;
+    if (sigma <= 0.25)
+        return 0;
+    // matches the kernel size opencv picks for float images when only sigma is given
+    return static_cast<blt::size_t>(cvRound(sigma * 4 * 2 + 1) | 1) / 2;
+}
+
+inline void chained_blur(cv::Mat& mat, blt::u64 size)
+{
     if (size % 2 == 0)
         size++;
     
+    if (eval_region.kernel_scale == 1)
+    {
+        for (blt::u64 i = 1; i < size; i += 2)
+            cv::GaussianBlur(mat, mat, cv::Size(static_cast<int>(i), static_cast<int>(i)), 0, 0);
+        return;
+    }
+    
+    // rescaled kernels are rarely odd integers, so fold the chain into a single blur of the matching width
+    auto sigma = chained_blur_sigma(size) / eval_region.kernel_scale;
+    if (sigma > 0.25)
+        cv::GaussianBlur(mat, mat, cv::Size(0, 0), sigma, sigma);
+}
+
+//inline blt::gp::operation_t band_pass([](const full_image_t& a, blt::u64 lp, blt::u64 hp) {
+inline blt::gp::operation_t band_pass(cancellable(profiled("band_pass", [](const full_image_t& a, float fa, float fb, blt::u64 size) {
+    auto src = make_mat(a);
+    full_image_t img{};
+    std::memcpy(img.rgb_data, a.rgb_data, eval_region.channels_size() * sizeof(float));
+    
+    auto dst = make_mat(img);
+    size = eval_region.kernel_size(size);
+    
     auto min = fa < fb ? fa : fb;
     auto max = fa > fb ? fa : fb;
     
@@ -124,77 +194,77 @@ inline blt::gp::operation_t band_pass([](const full_image_t& a, float fa, float
     cv::sepFilter2D(src, dst, 3, func, funcY);
     
     return img;
-}, "band_pass");
+})), "band_pass");
 
-inline blt::gp::operation_t high_pass([](const full_image_t& a, blt::u64 size) {
+inline blt::gp::operation_t high_pass(cancellable(profiled("high_pass", [](const full_image_t& a, blt::u64 size) {
     full_image_t blur{};
     full_image_t base{};
     full_image_t ret{};
-    std::memcpy(blur.rgb_data, a.rgb_data, DATA_CHANNELS_SIZE * sizeof(float));
-    std::memcpy(base.rgb_data, a.rgb_data, DATA_CHANNELS_SIZE * sizeof(float));
+    std::memcpy(blur.rgb_data, a.rgb_data, eval_region.channels_size() * sizeof(float));
+    std::memcpy(base.rgb_data, a.rgb_data, eval_region.channels_size() * sizeof(float));
     
     
-    cv::Mat blur_mat{IMAGE_SIZE, IMAGE_SIZE, CV_32FC3, blur.rgb_data};
-    cv::Mat base_mat{IMAGE_SIZE, IMAGE_SIZE, CV_32FC3, base.rgb_data};
-    cv::Mat ret_mat{IMAGE_SIZE, IMAGE_SIZE, CV_32FC3, ret.rgb_data};
-    if (size % 2 == 0)
-        size++;
+    auto blur_mat = make_mat(blur);
+    auto base_mat = make_mat(base);
+    auto ret_mat = make_mat(ret);
     
-    for (blt::u64 i = 1; i < size; i += 2)
-        cv::GaussianBlur(blur_mat, blur_mat, cv::Size(static_cast<int>(i), static_cast<int>(i)), 0, 0);
-    
-    const static cv::Mat half{IMAGE_SIZE, IMAGE_SIZE, CV_32FC3, 0.5f};
+    chained_blur(blur_mat, size);
     
     cv::subtract(base_mat, blur_mat, ret_mat);
-    cv::add(ret_mat, half, ret_mat);
+    cv::add(ret_mat, cv::Scalar::all(0.5), ret_mat);
     
     return ret;
-}, "high_pass");
+})), "high_pass");
 
-inline blt::gp::operation_t gaussian_blur([](const full_image_t& a, blt::u64 size) {
+inline blt::gp::operation_t gaussian_blur(cancellable(profiled("gaussian_blur", [](const full_image_t& a, blt::u64 size) {
     full_image_t img{};
-    std::memcpy(img.rgb_data, a.rgb_data, DATA_CHANNELS_SIZE * sizeof(float));
-    
-    cv::Mat dst{IMAGE_SIZE, IMAGE_SIZE, CV_32FC3, img.rgb_data};
-    if (size % 2 == 0)
-        size++;
+    std::memcpy(img.rgb_data, a.rgb_data, eval_region.channels_size() * sizeof(float));
     
-    for (blt::u64 i = 1; i < size; i += 2)
-        cv::GaussianBlur(dst, dst, cv::Size(static_cast<int>(i), static_cast<int>(i)), 0, 0);
+    auto dst = make_mat(img);
+    chained_blur(dst, size);
     
     return img;
-}, "gaussian_blur");
+})), "gaussian_blur");
 
-inline blt::gp::operation_t median_blur([](const full_image_t& a, blt::u64 size) {
-    cv::Mat src(IMAGE_SIZE, IMAGE_SIZE, CV_32FC3, const_cast<float*>(a.rgb_data));
+inline blt::gp::operation_t median_blur(cancellable(profiled("median_blur", [](const full_image_t& a, blt::u64 size) {
+    auto src = make_mat(a);
     full_image_t img{};
-    cv::Mat dst{IMAGE_SIZE, IMAGE_SIZE, CV_32FC3, img.rgb_data};
+    auto dst = make_mat(img);
     if (size % 2 == 0)
         size++;
     if (size > 5)
         size = 5;
-    cv::medianBlur(src, dst, static_cast<int>(size));
+    // opencv only supports 3 and 5 for float images, anything that shrinks below that is a copy
+    size = eval_region.kernel_size(size);
+    if (size < 3)
+        src.copyTo(dst);
+    else
+        cv::medianBlur(src, dst, static_cast<int>(std::min(size, 5ul)));
     return img;
-}, "median_blur");
+})), "median_blur");
 
-inline blt::gp::operation_t bilateral_filter([](const full_image_t& a, blt::u64 size, float color, float space) {
+inline blt::gp::operation_t bilateral_filter(cancellable(profiled("bilateral_filter", [](const full_image_t& a, blt::u64 size,
+                                                                                         float color, float space) {
     full_image_t img{};
-    cv::Mat src(IMAGE_SIZE, IMAGE_SIZE, CV_32FC3, const_cast<float*>(a.rgb_data));
-    cv::Mat dst{IMAGE_SIZE, IMAGE_SIZE, CV_32FC3, img.rgb_data};
+    auto src = make_mat(a);
+    auto dst = make_mat(img);
     if (size % 2 == 0)
         size++;
-    cv::bilateralFilter(src, dst, static_cast<int>(size), color * static_cast<double>(size) * 2.0, space * static_cast<double>(size) * 2.0);
+    auto scaled = eval_region.kernel_size(size);
+    cv::bilateralFilter(src, dst, static_cast<int>(scaled), color * static_cast<double>(size) * 2.0,
+                        space * static_cast<double>(size) * 2.0 / eval_region.kernel_scale);
     return img;
-}, "bilateral_filter");
+})), "bilateral_filter");
 
-inline blt::gp::operation_t l_system([](const full_image_t& a) {
+inline blt::gp::operation_t l_system(cancellable(profiled("l_system", [](const full_image_t& a) {
     return a;
-}, "l_system");
+})), "l_system");
 
-inline blt::gp::operation_t hsv_to_rgb([](const full_image_t& a) {
+inline blt::gp::operation_t hsv_to_rgb(cancellable(profiled("hsv", [](const full_image_t& a) {
     using blt::mem::type_cast;
     full_image_t img{};
-    for (blt::size_t i = 0; i < DATA_SIZE; i++)
+    const auto size = eval_region.size();
+    for (blt::size_t i = 0; i < size; i++)
     {
         auto h = static_cast<blt::i32>(a.rgb_data[i * CHANNELS + 0]) % 360;
         auto s = a.rgb_data[i * CHANNELS + 1];
@@ -222,11 +292,12 @@ inline blt::gp::operation_t hsv_to_rgb([](const full_image_t& a) {
         img.rgb_data[i * CHANNELS + 2] = rgb.z() + m;
     }
     return img;
-}, "hsv");
+})), "hsv");
 
 inline auto lit = blt::gp::operation_t([]() {
     full_image_t img{};
     auto bw = program.get_random().get_float(0.0f, 1.0f);
+    // literals are stored in the tree and reused at every resolution, so they always fill the whole canvas
     for (auto& i : img.rgb_data)
         i = bw;
     return img;
@@ -244,51 +315,63 @@ inline auto vec = blt::gp::operation_t([]() {
     }
     return img;
 }, "vec").set_ephemeral();
-inline blt::gp::operation_t random_val([]() {
+inline blt::gp::operation_t random_val(cancellable(profiled("color_noise", []() {
     full_image_t img{};
-    for (auto& i : img.rgb_data)
-        i = program.get_random().get_float(0.0f, 1.0f);
+    const auto size = eval_region.channels_size();
+    for (blt::size_t i = 0; i < size; i++)
+        img.rgb_data[i] = program.get_random().get_float(0.0f, 1.0f);
     return img;
-}, "color_noise");
-inline blt::gp::operation_t perlin([](const full_image_t& x, const full_image_t& y, const full_image_t& z, const full_image_t& scale) {
+})), "color_noise");
+inline blt::gp::operation_t perlin(cancellable(profiled("perlin", [](const full_image_t& x, const full_image_t& y, const full_image_t& z,
+                                                                     const full_image_t& scale) {
     full_image_t img{};
-    for (blt::size_t i = 0; i < DATA_CHANNELS_SIZE; i++)
+    const auto size = eval_region.channels_size();
+    for (blt::size_t i = 0; i < size; i++)
     {
+        if (row_deadline_passed(i))
+            break;
         auto s = scale.rgb_data[i];
         img.rgb_data[i] = perlin_noise(x.rgb_data[i] / s, y.rgb_data[i] / s, z.rgb_data[i] / s);
     }
     return img;
-}, "perlin");
-inline blt::gp::operation_t perlin_terminal([]() {
+})), "perlin");
+inline blt::gp::operation_t perlin_terminal(cancellable(profiled("perlin_term", []() {
     full_image_t img{};
-    for (blt::size_t i = 0; i < DATA_CHANNELS_SIZE; i++)
+    const auto size = eval_region.channels_size();
+    for (blt::size_t i = 0; i < size; i++)
     {
+        if (row_deadline_passed(i))
+            break;
         auto ctx = get_ctx(i);
         img.rgb_data[i] = perlin_noise(ctx.x / IMAGE_SIZE, ctx.y / IMAGE_SIZE, static_cast<float>(i % CHANNELS) / CHANNELS);
     }
     return img;
-}, "perlin_term");
-inline blt::gp::operation_t perlin_warped([](const full_image_t& u, const full_image_t& v) {
+})), "perlin_term");
+inline blt::gp::operation_t perlin_warped(cancellable(profiled("perlin_warped", [](const full_image_t& u, const full_image_t& v) {
     full_image_t img{};
-    for (blt::size_t i = 0; i < DATA_CHANNELS_SIZE; i++)
+    const auto size = eval_region.channels_size();
+    for (blt::size_t i = 0; i < size; i++)
     {
+        if (row_deadline_passed(i))
+            break;
         auto ctx = get_ctx(i);
         img.rgb_data[i] = perlin_noise((ctx.x + +u.rgb_data[i]) / IMAGE_SIZE, (ctx.y + v.rgb_data[i]) / IMAGE_SIZE,
                                        static_cast<float>(i % CHANNELS) / CHANNELS);
     }
     return img;
-}, "perlin_warped");
-inline blt::gp::operation_t op_img_size([]() {
+})), "perlin_warped");
+inline blt::gp::operation_t op_img_size(cancellable(profiled("img_size", []() {
     full_image_t img{};
     for (float& i : img.rgb_data)
     {
         i = IMAGE_SIZE;
     }
     return img;
-}, "img_size");
-inline blt::gp::operation_t op_x_r([]() {
+})), "img_size");
+inline blt::gp::operation_t op_x_r(cancellable(profiled("x_r", []() {
     full_image_t img{};
-    for (blt::size_t i = 0; i < DATA_SIZE; i++)
+    const auto size = eval_region.size();
+    for (blt::size_t i = 0; i < size; i++)
     {
         auto ctx = get_ctx(i).x;
         img.rgb_data[i * CHANNELS] = ctx;
@@ -296,10 +379,11 @@ inline blt::gp::operation_t op_x_r([]() {
         img.rgb_data[i * CHANNELS + 2] = 0;
     }
     return img;
-}, "x_r");
-inline blt::gp::operation_t op_x_g([]() {
+})), "x_r");
+inline blt::gp::operation_t op_x_g(cancellable(profiled("x_g", []() {
     full_image_t img{};
-    for (blt::size_t i = 0; i < DATA_SIZE; i++)
+    const auto size = eval_region.size();
+    for (blt::size_t i = 0; i < size; i++)
     {
         auto ctx = get_ctx(i).x;
         img.rgb_data[i * CHANNELS] = 0;
@@ -307,10 +391,11 @@ inline blt::gp::operation_t op_x_g([]() {
         img.rgb_data[i * CHANNELS + 2] = 0;
     }
     return img;
-}, "x_g");
-inline blt::gp::operation_t op_x_b([]() {
+})), "x_g");
+inline blt::gp::operation_t op_x_b(cancellable(profiled("x_b", []() {
     full_image_t img{};
-    for (blt::size_t i = 0; i < DATA_SIZE; i++)
+    const auto size = eval_region.size();
+    for (blt::size_t i = 0; i < size; i++)
     {
         auto ctx = get_ctx(i).x;
         img.rgb_data[i * CHANNELS] = 0;
@@ -318,10 +403,11 @@ inline blt::gp::operation_t op_x_b([]() {
         img.rgb_data[i * CHANNELS + 2] = ctx;
     }
     return img;
-}, "x_b");
-inline blt::gp::operation_t op_x_rgb([]() {
+})), "x_b");
+inline blt::gp::operation_t op_x_rgb(cancellable(profiled("x_rgb", []() {
     full_image_t img{};
-    for (blt::size_t i = 0; i < DATA_SIZE; i++)
+    const auto size = eval_region.size();
+    for (blt::size_t i = 0; i < size; i++)
     {
         auto ctx = get_ctx(i).x;
         img.rgb_data[i * CHANNELS] = ctx;
@@ -329,10 +415,11 @@ inline blt::gp::operation_t op_x_rgb([]() {
         img.rgb_data[i * CHANNELS + 2] = ctx;
     }
     return img;
-}, "x_rgb");
-inline blt::gp::operation_t op_y_r([]() {
+})), "x_rgb");
+inline blt::gp::operation_t op_y_r(cancellable(profiled("y_r", []() {
     full_image_t img{};
-    for (blt::size_t i = 0; i < DATA_SIZE; i++)
+    const auto size = eval_region.size();
+    for (blt::size_t i = 0; i < size; i++)
     {
         auto ctx = get_ctx(i).y;
         img.rgb_data[i * CHANNELS] = ctx;
@@ -340,10 +427,11 @@ inline blt::gp::operation_t op_y_r([]() {
         img.rgb_data[i * CHANNELS + 2] = 0;
     }
     return img;
-}, "y_r");
-inline blt::gp::operation_t op_y_g([]() {
+})), "y_r");
+inline blt::gp::operation_t op_y_g(cancellable(profiled("y_g", []() {
     full_image_t img{};
-    for (blt::size_t i = 0; i < DATA_SIZE; i++)
+    const auto size = eval_region.size();
+    for (blt::size_t i = 0; i < size; i++)
     {
         auto ctx = get_ctx(i).y;
         img.rgb_data[i * CHANNELS] = 0;
@@ -351,10 +439,11 @@ inline blt::gp::operation_t op_y_g([]() {
         img.rgb_data[i * CHANNELS + 2] = 0;
     }
     return img;
-}, "y_g");
-inline blt::gp::operation_t op_y_b([]() {
+})), "y_g");
+inline blt::gp::operation_t op_y_b(cancellable(profiled("y_b", []() {
     full_image_t img{};
-    for (blt::size_t i = 0; i < DATA_SIZE; i++)
+    const auto size = eval_region.size();
+    for (blt::size_t i = 0; i < size; i++)
     {
         auto ctx = get_ctx(i).y;
         img.rgb_data[i * CHANNELS] = 0;
@@ -362,10 +451,11 @@ inline blt::gp::operation_t op_y_b([]() {
         img.rgb_data[i * CHANNELS + 2] = ctx;
     }
     return img;
-}, "y_b");
-inline blt::gp::operation_t op_y_rgb([]() {
+})), "y_b");
+inline blt::gp::operation_t op_y_rgb(cancellable(profiled("y_rgb", []() {
     full_image_t img{};
-    for (blt::size_t i = 0; i < DATA_SIZE; i++)
+    const auto size = eval_region.size();
+    for (blt::size_t i = 0; i < size; i++)
     {
         auto ctx = get_ctx(i).y;
         img.rgb_data[i * CHANNELS] = ctx;
@@ -373,7 +463,86 @@ inline blt::gp::operation_t op_y_rgb([]() {
         img.rgb_data[i * CHANNELS + 2] = ctx;
     }
     return img;
-}, "y_rgb");
+})), "y_rgb");
+inline blt::gp::operation_t op_time(cancellable(profiled("time", []() {
+    full_image_t img{};
+    const auto size = eval_region.channels_size();
+    for (blt::size_t i = 0; i < size; i++)
+        img.rgb_data[i] = eval_region.time;
+    return img;
+})), "time");
+
+// operators which read outside of the pixel they are writing. everything else is pointwise and can be evaluated on any part of the canvas.
+enum class operator_kind_t : blt::u8
+{
+    POINTWISE,
+    GAUSSIAN_BLUR,
+    HIGH_PASS,
+    BAND_PASS,
+    MEDIAN_BLUR,
+    BILATERAL_FILTER,
+    // pointwise, but draws new values every time it is evaluated
+    RANDOM,
+    // the only operator whose output changes between frames of an animation
+    TIME,
+    // the image literal, used to splice precomputed values into a tree
+    IMAGE_LITERAL
+};
+
+template<typename T>
+operator_kind_t get_operator_kind(const T& op)
+{
+    const void* ptr = &op;
+    if (ptr == &gaussian_blur)
+        return operator_kind_t::GAUSSIAN_BLUR;
+    if (ptr == &high_pass)
+        return operator_kind_t::HIGH_PASS;
+    if (ptr == &band_pass)
+        return operator_kind_t::BAND_PASS;
+    if (ptr == &median_blur)
+        return operator_kind_t::MEDIAN_BLUR;
+    if (ptr == &bilateral_filter)
+        return operator_kind_t::BILATERAL_FILTER;
+    if (ptr == &random_val)
+        return operator_kind_t::RANDOM;
+    if (ptr == &op_time)
+        return operator_kind_t::TIME;
+    if (ptr == &vec)
+        return operator_kind_t::IMAGE_LITERAL;
+    return operator_kind_t::POINTWISE;
+}
+
+// number of pixels on each side of the output the operator reads from in the current region, given its kernel size argument
+inline blt::size_t operator_radius(operator_kind_t kind, blt::u64 size)
+{
+    switch (kind)
+    {
+        case operator_kind_t::GAUSSIAN_BLUR:
+        case operator_kind_t::HIGH_PASS:
+            return chained_blur_radius(size);
+        case operator_kind_t::BAND_PASS:
+        case operator_kind_t::BILATERAL_FILTER:
+            return eval_region.kernel_size(size) / 2;
+        case operator_kind_t::MEDIAN_BLUR:
+        {
+            if (size % 2 == 0)
+                size++;
+            auto scaled = eval_region.kernel_size(std::min(size, 5ul));
+            return scaled < 3 ? 0 : std::min(scaled, 5ul) / 2;
+        }
+        case operator_kind_t::POINTWISE:
+        case operator_kind_t::RANDOM:
+        case operator_kind_t::TIME:
+        case operator_kind_t::IMAGE_LITERAL:
+        default:
+            return 0;
+    }
+}
+
+// indexed by operator id, filled in when the operators are registered with the program
+inline std::vector<operator_kind_t> operator_kinds;
+// id of the image literal fold_time_independent splices into trees, found when operator_kinds is filled in
+inline blt::gp::operator_id image_literal_id = 0;
 
 template<typename context>
 void create_image_operations(blt::gp::operator_builder<context>& builder)
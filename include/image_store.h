@@ -0,0 +1,80 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_IMAGE_STORE_H
+#define IMAGE_GP_6_IMAGE_STORE_H
+
+#include <images.h>
+#include <memory>
+#include <vector>
+
+// rendered images of the current population. a full image is a couple hundred kilobytes, so only the individuals something will look at
+// again (the page shown by the ui, or everyone while the whole population is being timelapsed) keep theirs. every other individual is
+// rendered into a scratch image owned by the rendering thread, scored and then forgotten, so memory no longer grows with the population.
+class image_store_t
+{
+    public:
+        // sizes the store for a population and picks which individuals keep their image. images of individuals which stay retained are
+        // kept, but anything rendered from now on replaces them. must not overlap with rendering
+        void retain(blt::size_t population, const std::vector<blt::size_t>& indices);
+        
+        // where the individual is rendered to. for individuals which aren't retained this is the calling thread's scratch image, only
+        // valid until the same thread renders something else
+        full_image_t& operator[](blt::size_t index)
+        {
+            const auto slot = slot_of[index];
+            return slot == NOT_RETAINED ? scratch() : *images[slot];
+        }
+        
+        [[nodiscard]] bool retained(blt::size_t index) const
+        {
+            return slot_of[index] != NOT_RETAINED;
+        }
+        
+        [[nodiscard]] blt::size_t size() const
+        {
+            return slot_of.size();
+        }
+        
+        [[nodiscard]] blt::size_t retained_count() const
+        {
+            return images.size();
+        }
+        
+        // memory held by retained images, the scratch images are one per rendering thread on top of this
+        [[nodiscard]] blt::size_t bytes() const
+        {
+            return images.size() * sizeof(full_image_t);
+        }
+        
+        static full_image_t& scratch();
+        
+        // frees the calling thread's scratch image, the next call to scratch allocates (and first touches) a new one on whichever node the
+        // thread runs on by then
+        static void release_scratch();
+    
+    private:
+        static std::unique_ptr<full_image_t>& scratch_slot();
+        
+        static constexpr blt::u32 NOT_RETAINED = static_cast<blt::u32>(-1);
+        
+        std::vector<blt::u32> slot_of;
+        std::vector<std::unique_ptr<full_image_t>> images;
+};
+
+#endif //IMAGE_GP_6_IMAGE_STORE_H
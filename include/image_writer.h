@@ -0,0 +1,106 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_IMAGE_WRITER_H
+#define IMAGE_GP_6_IMAGE_WRITER_H
+
+#include <images.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct image_write_job_t
+{
+    std::string path;
+    blt::size_t width = 0;
+    blt::size_t height = 0;
+    blt::size_t channels = CHANNELS;
+    std::vector<float> data;
+};
+
+// encodes and writes pngs on a small pool of background threads. the queue is bounded, once it is full submit blocks until an encoder
+// frees a slot, so a slow disk holds the caller back instead of piling up images in memory.
+class image_writer_t
+{
+    public:
+        explicit image_writer_t(blt::size_t threads = 2, blt::size_t capacity = 16): thread_count(threads), capacity(capacity)
+        {}
+        
+        image_writer_t(const image_writer_t&) = delete;
+        
+        image_writer_t& operator=(const image_writer_t&) = delete;
+        
+        // takes ownership of the pixel data
+        void submit(image_write_job_t&& job);
+        
+        // copies the canvas of the image, which can be reused as soon as this returns
+        void submit(const std::string& path, const full_image_t& image);
+        
+        // blocks until every submitted image is on disk
+        void flush();
+        
+        [[nodiscard]] blt::size_t written() const
+        {
+            return images_written;
+        }
+        
+        [[nodiscard]] blt::size_t queued() const
+        {
+            std::scoped_lock lock(mutex);
+            return jobs.size() + in_flight;
+        }
+        
+        // total time callers spent blocked on a full queue
+        [[nodiscard]] double stalled_ms() const
+        {
+            return static_cast<double>(stalled_ns) / 1e6;
+        }
+        
+        ~image_writer_t();
+    
+    private:
+        void start();
+        
+        void run();
+        
+        blt::size_t thread_count;
+        blt::size_t capacity;
+        
+        mutable std::mutex mutex;
+        std::condition_variable job_available;
+        std::condition_variable slot_available;
+        std::condition_variable idle;
+        std::deque<image_write_job_t> jobs;
+        blt::size_t in_flight = 0;
+        bool stopping = false;
+        std::vector<std::thread> threads;
+        
+        std::atomic_uint64_t images_written = 0;
+        std::atomic_uint64_t stalled_ns = 0;
+};
+
+inline image_writer_t image_writer;
+
+// path for one frame of a timelapse, numbered so the frames sort in generation order
+std::string timelapse_path(const std::string& directory, const std::string& name, blt::size_t generation);
+
+#endif //IMAGE_GP_6_IMAGE_WRITER_H
@@ -23,16 +23,95 @@
 #include <stb_image.h>
 #include <stb_image_resize2.h>
 #include <stb_image_write.h>
+#include <png_stream.h>
+
+// describes the part of the canvas the current thread is rendering. operators only touch the first width * height pixels of an image,
+// coordinates are mapped back onto the IMAGE_SIZE canvas and kernel sizes are rescaled, so a tree looks the same at every resolution.
+struct eval_region_t
+{
+    blt::size_t width = IMAGE_SIZE;
+    blt::size_t height = IMAGE_SIZE;
+    // canvas position of the first pixel in the buffer
+    float offset_x = 0;
+    float offset_y = 0;
+    // canvas pixels covered by a single buffer pixel
+    float scale = 1;
+    // canvas pixels per buffer pixel used when rescaling kernels. matches scale unless kernels have to be kept small enough to tile
+    float kernel_scale = 1;
+    // position in the animation being rendered, between 0 and 1. read by the time terminal
+    float time = 0;
+    
+    static eval_region_t for_resolution(blt::size_t size)
+    {
+        eval_region_t region;
+        region.width = size;
+        region.height = size;
+        region.scale = static_cast<float>(IMAGE_SIZE) / static_cast<float>(size);
+        region.kernel_scale = region.scale;
+        return region;
+    }
+    
+    [[nodiscard]] blt::size_t size() const
+    {
+        return width * height;
+    }
+    
+    [[nodiscard]] blt::size_t channels_size() const
+    {
+        return size() * CHANNELS;
+    }
+    
+    // maps an odd kernel size on the canvas onto the buffer, keeping it odd
+    [[nodiscard]] blt::u64 kernel_size(blt::u64 size) const
+    {
+        if (size % 2 == 0)
+            size++;
+        if (kernel_scale == 1)
+            return size;
+        auto scaled = static_cast<blt::u64>(std::round(static_cast<float>(size) / kernel_scale));
+        if (scaled % 2 == 0)
+            scaled++;
+        return scaled;
+    }
+};
+
+inline thread_local eval_region_t eval_region;
+
+// sets the region for the current thread, restoring the previous one when it goes out of scope
+class eval_region_guard
+{
+    public:
+        explicit eval_region_guard(const eval_region_t& region): previous(eval_region)
+        {
+            eval_region = region;
+        }
+        
+        eval_region_guard(const eval_region_guard&) = delete;
+        
+        eval_region_guard& operator=(const eval_region_guard&) = delete;
+        
+        ~eval_region_guard()
+        {
+            eval_region = previous;
+        }
+    
+    private:
+        eval_region_t previous;
+};
 
 struct stb_image_t
 {
     public:
         stb_image_t() = default;
         
+        // takes ownership of data, which must have been allocated with malloc
+        stb_image_t(int width, int height, int channels, float* data): width(width), height(height), channels(channels), data(data)
+        {}
+        
         stb_image_t(const stb_image_t& copy) noexcept: width(copy.width), height(copy.height), channels(copy.channels)
         {
-            data = static_cast<float*>(std::malloc(width * height * channels));
-            std::memcpy(data, copy.data, width * height * channels);
+            data = static_cast<float*>(std::malloc(width * height * channels * sizeof(float)));
+            std::memcpy(data, copy.data, width * height * channels * sizeof(float));
         }
         
         stb_image_t(stb_image_t&& move) noexcept:
@@ -51,7 +130,7 @@ struct stb_image_t
                 stbi_image_free(data);
                 data = static_cast<float*>(std::malloc(width * height * channels * sizeof(float)));
             }
-            std::memcpy(data, copy.data, width * height * channels);
+            std::memcpy(data, copy.data, width * height * channels * sizeof(float));
             
             return *this;
         }
@@ -72,6 +151,23 @@ struct stb_image_t
             return *this;
         }
         
+        // loads the image already shrunk to max(size / divisor, min_size). pngs are decoded a row at a time straight into the smaller
+        // image, everything else (or anything which would need upscaling) goes through stb and resize.
+        stb_image_t& load_scaled(const std::string& path, int divisor, int min_size)
+        {
+            stbi_image_free(data);
+            data = load_png_scaled(path, divisor, min_size, width, height);
+            channels = CHANNELS;
+            if (data == nullptr)
+            {
+                // callers check get_data, a missing or unreadable file leaves the image empty
+                if (load(path).data == nullptr)
+                    return *this;
+                resize(std::max(width / divisor, min_size), std::max(height / divisor, min_size));
+            }
+            return *this;
+        }
+        
         stb_image_t& save(const std::string& str)
         {
             if (data == nullptr)
@@ -129,12 +225,12 @@ struct stb_image_t
 
 struct full_image_t
 {
-    float rgb_data[DATA_SIZE * CHANNELS]{};
+    float rgb_data[DATA_SIZE * CHANNELS];
     
+    // only the active region is cleared, so rendering a small tile never touches the rest of the buffer
     full_image_t()
     {
-        for (auto& v : rgb_data)
-            v = 0;
+        std::fill(rgb_data, rgb_data + eval_region.channels_size(), 0.0f);
     }
     
     void load(const std::string& path)
@@ -147,9 +243,20 @@ struct full_image_t
         stbi_image_free(data);
     }
     
-    void load(const stb_image_t& image)
+    void load(const stb_image_t& image, blt::size_t size = IMAGE_SIZE)
+    {
+        stbir_resize_float_linear(image.get_data(), image.get_width(), image.get_height(), 0, rgb_data, static_cast<int>(size),
+                                  static_cast<int>(size), 0, static_cast<stbir_pixel_layout>(CHANNELS));
+    }
+    
+    // stretches a packed size x size image over the whole canvas
+    void expand(blt::size_t size)
     {
-        stbir_resize_float_linear(image.get_data(), image.get_width(), image.get_height(), 0, rgb_data, IMAGE_SIZE, IMAGE_SIZE, 0,
+        if (size == IMAGE_SIZE)
+            return;
+        static thread_local std::vector<float> source;
+        source.assign(rgb_data, rgb_data + size * size * CHANNELS);
+        stbir_resize_float_linear(source.data(), static_cast<int>(size), static_cast<int>(size), 0, rgb_data, IMAGE_SIZE, IMAGE_SIZE, 0,
                                   static_cast<stbir_pixel_layout>(CHANNELS));
     }
     
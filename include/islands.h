@@ -0,0 +1,114 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_ISLANDS_H
+#define IMAGE_GP_6_ISLANDS_H
+
+#include <blt/gp/program.h>
+#include <config.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class migration_topology_t : blt::i32
+{
+    // island i sends its elites to island i + 1
+    RING,
+    // every migration goes to a randomly chosen other island
+    RANDOM
+};
+
+struct island_settings_t
+{
+    // zero or one runs the normal single population instead
+    blt::size_t count = 0;
+    // evaluation threads inside each island
+    blt::size_t threads = 1;
+    // generations between migrations, zero never migrates
+    blt::size_t migration_interval = 5;
+    // elites sent per migration, replacing the receiver's worst individuals
+    blt::size_t migrants = 2;
+    migration_topology_t topology = migration_topology_t::RING;
+    // keep each island's threads on their own cores
+    bool pin_threads = true;
+};
+
+struct island_progress_t
+{
+    // generations finished by the first island
+    blt::size_t generation = 0;
+    // best and worst over every island, average and overall are the mean of each island's
+    double best_fitness = 0;
+    double average_fitness = 0;
+    double worst_fitness = 0;
+    double overall_fitness = 0;
+    blt::u64 evaluations = 0;
+    blt::u64 migrations = 0;
+};
+
+struct island_t;
+
+// independent populations, each a program of its own with its own thread pool, so selection and breeding on one island never waits for
+// another. the only contact between islands is migration, which goes through single slot mailboxes that are swapped atomically. the
+// operator set and the prepared target are shared. islands always score the full resolution target, progressive and racing evaluation,
+// user assigned fitness and the animated target are single population features.
+class island_model_t
+{
+    public:
+        explicit island_model_t(const island_settings_t& settings, blt::u64 seed = SEED);
+        
+        island_model_t(const island_model_t&) = delete;
+        
+        island_model_t& operator=(const island_model_t&) = delete;
+        
+        // runs every island on its own thread until each has done generations generations. progress is called from the first island's thread
+        // after each of its generations, returning false stops every island
+        void run(blt::size_t generations, const std::function<bool(const island_progress_t&)>& progress = {});
+        
+        // the best individual over every island, valid until the next run
+        [[nodiscard]] blt::gp::tree_t& best_tree();
+        
+        [[nodiscard]] double best_fitness() const;
+        
+        [[nodiscard]] blt::u64 evaluations() const;
+        
+        [[nodiscard]] blt::u64 migrations() const;
+        
+        [[nodiscard]] blt::size_t size() const
+        {
+            return islands.size();
+        }
+        
+        ~island_model_t();
+    
+    private:
+        [[nodiscard]] island_progress_t gather_progress(blt::size_t generation) const;
+        
+        // takes in whatever has arrived in the island's mailbox and sends its own elites on
+        void migrate(island_t& island);
+        
+        island_settings_t settings;
+        std::vector<std::unique_ptr<island_t>> islands;
+};
+
+// runs the same number of generations on 1..max(cores) cores, once as that many single threaded islands and once as one population
+// evaluated by that many threads (the generation barrier the islands avoid), and writes the throughput of both to path as csv
+void benchmark_island_scaling(const std::vector<blt::size_t>& cores, blt::size_t generations, const std::string& path);
+
+#endif //IMAGE_GP_6_ISLANDS_H
@@ -0,0 +1,145 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_JOB_H
+#define IMAGE_GP_6_JOB_H
+
+#include <config.h>
+#include <evaluation.h>
+#include <fitness.h>
+#include <islands.h>
+#include <steady_state.h>
+#include <thread_budget.h>
+#include <affinity.h>
+#include <evaluation_cost.h>
+#include <deadline.h>
+#include <functional>
+#include <istream>
+#include <string>
+#include <vector>
+
+// one evolution run, configured by key = value lines with '#' starting a comment:
+//  target = ../hannah.png          image to evolve towards
+//  animated = false                evolve against the frames of target (a gif) instead
+//  generations = 100
+//  output = headless_output        stats.csv, best_NNNNNN.png snapshots and the final best tree go here, utilization.csv with cost_scheduling
+//  snapshot_every = 1              generations between snapshots of the best individual, 0 to disable
+//  population_snapshots = false    snapshot every individual as well
+//  difference_weight, fractal_weight, histogram_weight
+//  cost_weight = 0                 fitness added per millisecond an individual is predicted to take to render, see evaluation_cost.h
+//  cost_budget_ms = 0              offspring predicted to take longer are replaced before they are rendered, 0 for no budget
+//  deadline_ms = 0                 individuals still rendering after this long are cancelled and scored as badly as possible, see deadline.h
+//  progressive, racing, tiled      evaluation modes, see evaluation.h. racing writes how many it aborted to racing.csv
+//  cost_scheduling = false         render on work stealing threads ordered by predicted cost, see cost_scheduler.h
+//  scheduler_threads = 0           threads used by the cost scheduler, 0 uses every core. needs thread_policy = manual
+//  split_expensive = true          let several threads share the tiles of an individual predicted to be too slow for one
+//  steady_state = false            breed and insert one offspring at a time instead of whole generations, see steady_state.h
+//  steady_state_threads = 0        threads breeding offspring in steady state mode, 0 uses every core. needs thread_policy = manual
+//  selection_size, replacement_size  tournament sizes used to pick parents and the individual an offspring replaces
+//  seed, threads, population       passed to blt-gp through IMAGE_GP_SEED, IMAGE_GP_THREADS and IMAGE_GP_POPULATION
+//  thread_policy = adaptive        how cores are shared between individuals and opencv: manual, outer, inner or adaptive. see thread_budget.h
+//  thread_cores = 0                cores shared between them, 0 uses every core
+//  pin_workers = false             pin the threads rendering individuals to a cpu each, see affinity.h
+//  compare_pinning = false         headless only: run the job with pinning off and then on, writing both generation times to pinning.csv
+//  operator_profile = true         write every operator's calls and timings per generation to operators.csv, single population only.
+//                                  does nothing when built without ENABLE_OPERATOR_PROFILER
+//  trace = false                   record a timeline of every thread and write it to trace.json at the end, see tracer.h
+//  share = /image-gp-6             publish every generation to shared memory for 'image-gp-6 attach', off when empty
+//  islands = 0                     independent populations with migration between them, see islands.h. 0 or 1 uses the single population
+//  island_threads = 1              evaluation threads per island
+//  migration_interval, migrants    how often and how many elites move between islands
+//  topology = ring                 ring or random
+//  pin_threads = true              keep each island on its own cores
+//  farm = /tmp/image-gp-6-farm.sock  render on image-gp-6-worker processes connected to this socket, off when empty. see farm.h
+//  farm_thumbnails = true          workers send back the images of the ui's page, without them snapshots only show the locally rendered ones
+//  checkpoint = run.igck           checkpoint the population here every checkpoint_every generations and at the end, off when empty
+//  checkpoint_every = 10
+//  resume = run.igck               start from a checkpoint instead of a random population, see checkpoint.h
+//  scaling = 1,2,4,8               headless only: measure island and single population throughput at each core count instead of evolving
+//  population_scaling = 64,1024    headless only: measure generation time and peak memory at each population size instead of evolving
+struct run_config_t
+{
+    std::string target = load_image;
+    bool animated = false;
+    blt::size_t generations = 100;
+    std::string output = "headless_output";
+    blt::size_t snapshot_every = 1;
+    bool population_snapshots = false;
+    std::string seed;
+    std::string threads;
+    std::string population;
+    std::string share;
+    std::string farm;
+    bool farm_thumbnails = true;
+    std::string checkpoint;
+    blt::size_t checkpoint_every = 10;
+    std::string resume;
+    island_settings_t islands;
+    std::vector<blt::size_t> scaling;
+    std::vector<blt::size_t> population_scaling;
+    // copied from the globals when the config is made, so keys which aren't set keep whatever the program started with
+    float difference_weight = ::difference_weight;
+    float fractal_weight = ::fractal_weight;
+    float histogram_weight = ::histogram_weight;
+    float cost_weight = ::cost_weight;
+    cost_budget_settings_t cost_budget = cost_budget_settings;
+    deadline_settings_t deadline = deadline_settings;
+    evaluation_settings_t evaluation = evaluation_settings;
+    steady_state_settings_t steady_state = steady_state_settings;
+    thread_budget_settings_t thread_budget = ::thread_budget.settings;
+    bool pin_workers = affinity_settings.pin_workers;
+    // scheduler_threads or steady_state_threads was set, which the budget would overwrite under any policy but manual
+    bool manual_threads = false;
+    bool compare_pinning = false;
+    bool operator_profile = true;
+    bool trace = false;
+};
+
+struct job_progress_t
+{
+    // generations finished by this job, starting at 1
+    blt::size_t generation = 0;
+    blt::size_t generations = 0;
+    double best_fitness = 0;
+    double average_fitness = 0;
+    double milliseconds = 0;
+};
+
+struct job_result_t
+{
+    bool success = false;
+    // false if the job was stopped early by its progress callback
+    bool completed = false;
+    blt::size_t generations = 0;
+    double best_fitness = 0;
+    double seconds = 0;
+    std::string error;
+};
+
+// applies a single key = value pair, error describes why it was rejected
+bool set_config_value(run_config_t& config, const std::string& key, const std::string& value, std::string& error);
+
+bool load_config(std::istream& in, const std::string& source, run_config_t& out);
+
+bool load_config(const std::string& path, run_config_t& out);
+
+// runs the job on the gp thread, which must be inside scheduler.run_loop, and blocks until it is finished. progress is called on the gp thread
+// after every generation, returning false stops the job. the operators must already be set up, everything else is reset by the job.
+job_result_t run_job(const run_config_t& config, const std::function<bool(const job_progress_t&)>& progress);
+
+#endif //IMAGE_GP_6_JOB_H
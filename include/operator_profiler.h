@@ -0,0 +1,132 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef IMAGE_GP_6_OPERATOR_PROFILER_H
+#define IMAGE_GP_6_OPERATOR_PROFILER_H
+
+#include <blt/std/types.h>
+#include <blt/std/time.h>
+#include <tracer.h>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// every image and float operator is wrapped by profiled, which times each call into counters owned by the calling thread. the counters are
+// only summed when a generation ends, so the hot path never touches memory another thread writes. the same timings become the operator
+// spans of the tracer while it runs. building with both ENABLE_OPERATOR_PROFILER and ENABLE_TRACER off makes profiled return the operator
+// untouched.
+
+inline constexpr blt::size_t MAX_PROFILED_OPERATORS = 64;
+// four buckets for every power of two nanoseconds, enough for calls up to about four seconds
+inline constexpr blt::size_t PROFILE_BUCKETS = 128;
+
+struct operator_profile_row_t
+{
+    std::string name;
+    blt::u64 calls = 0;
+    blt::u64 total_ns = 0;
+    // upper edges of the histogram buckets the percentiles fall in
+    blt::u64 p50_ns = 0;
+    blt::u64 p99_ns = 0;
+};
+
+class operator_profiler_t
+{
+    public:
+        // slot for an operator's counters, called once per operator when it is defined
+        static blt::size_t register_operator(const char* name);
+        
+        static void record(blt::size_t slot, blt::u64 ns);
+        
+        // merges every thread's counters into the generation's rows and appends them to the csv when one is set. must run on the gp
+        // thread while nothing is rendering
+        void finish_generation(blt::size_t generation);
+        
+        // the last generation's rows, one per operator which was called
+        [[nodiscard]] std::vector<operator_profile_row_t> get_rows() const;
+        
+        // starts a fresh csv at path, empty to stop writing one
+        void set_csv(const std::string& path);
+        
+        [[nodiscard]] static constexpr bool compiled_in()
+        {
+#ifdef IMAGE_GP_PROFILE_OPERATORS
+            return true;
+#else
+            return false;
+#endif
+        }
+    
+    private:
+        mutable std::mutex mutex;
+        std::vector<operator_profile_row_t> rows;
+        std::string csv_path;
+        // totals over every thread at the end of the last generation, the counters themselves are never reset
+        std::vector<blt::u64> last_calls;
+        std::vector<blt::u64> last_ns;
+        std::vector<blt::u64> last_histogram;
+};
+
+inline operator_profiler_t operator_profiler;
+
+class operator_timer_t
+{
+    public:
+        operator_timer_t(blt::size_t slot, const char* name): slot(slot), name(name),
+                                                              start(operator_profiler_t::compiled_in() || tracer.enabled()
+                                                                    ? blt::system::getCurrentTimeNanoseconds() : 0)
+        {}
+        
+        ~operator_timer_t()
+        {
+            if (start == 0)
+                return;
+            const auto end = blt::system::getCurrentTimeNanoseconds();
+            if constexpr (operator_profiler_t::compiled_in())
+                operator_profiler_t::record(slot, end - start);
+            if (tracer.enabled())
+                tracer_t::record(name, start, end);
+        }
+    
+    private:
+        blt::size_t slot;
+        const char* name;
+        blt::u64 start;
+};
+
+template<typename Func, typename Return, typename... Args>
+auto profiled_with(blt::size_t slot, const char* name, Func func, Return (Func::*)(Args...) const)
+{
+    // the exact signature is kept, blt-gp reads the operator's argument and return types from it
+    return [func, slot, name](Args... args) -> Return {
+        operator_timer_t timer{slot, name};
+        return func(std::forward<Args>(args)...);
+    };
+}
+
+template<typename Func>
+auto profiled([[maybe_unused]] const char* name, Func func)
+{
+#if defined(IMAGE_GP_PROFILE_OPERATORS) || defined(IMAGE_GP_TRACE)
+    return profiled_with(operator_profiler_t::register_operator(name), name, func, &Func::operator());
+#else
+    return func;
+#endif
+}
+
+#endif //IMAGE_GP_6_OPERATOR_PROFILER_H
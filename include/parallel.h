@@ -0,0 +1,63 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_PARALLEL_H
+#define IMAGE_GP_6_PARALLEL_H
+
+#include <blt/std/types.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// threads used when parallel_for isn't given a count, set by the thread budget. 0 uses every core
+inline std::atomic_uint64_t default_thread_count = 0;
+
+// runs func(i) for every i in [0, count). work is handed out one index at a time since the cost of rendering a tree varies wildly.
+template<typename Func>
+void parallel_for(blt::size_t count, Func&& func, blt::size_t thread_count = 0)
+{
+    if (thread_count == 0)
+        thread_count = default_thread_count;
+    if (thread_count == 0)
+        thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+    thread_count = std::min(thread_count, count);
+    
+    std::atomic_uint64_t next = 0;
+    auto worker = [&]() {
+        blt::size_t i;
+        while ((i = next.fetch_add(1, std::memory_order_relaxed)) < count)
+            func(i);
+    };
+    
+    if (thread_count <= 1)
+    {
+        worker();
+        return;
+    }
+    
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+    for (blt::size_t i = 0; i < thread_count - 1; i++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads)
+        thread.join();
+}
+
+#endif //IMAGE_GP_6_PARALLEL_H
@@ -0,0 +1,133 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_PNG_STREAM_H
+#define IMAGE_GP_6_PNG_STREAM_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+// writes an 8 bit RGB png one row at a time, so only a single row and the deflate window ever have to be in memory.
+// stbi_write_png needs the whole image up front, which isn't an option past a few thousand pixels on a side.
+class png_stream_t
+{
+    public:
+        png_stream_t(const std::string& path, std::uint32_t width, std::uint32_t height, int compression_level = 6);
+        
+        png_stream_t(const png_stream_t&) = delete;
+        
+        png_stream_t& operator=(const png_stream_t&) = delete;
+        
+        // rows must be written top to bottom, each one width * 3 bytes
+        void write_row(const std::uint8_t* row);
+        
+        // flushes the remaining compressed data and closes the file. called by the destructor if it hasn't been already.
+        bool finish();
+        
+        [[nodiscard]] bool good() const
+        {
+            return file != nullptr && !failed;
+        }
+        
+        [[nodiscard]] std::uint32_t rows_written() const
+        {
+            return rows;
+        }
+        
+        ~png_stream_t();
+    
+    private:
+        void write_chunk(const char* type, const std::uint8_t* data, std::size_t size);
+        
+        void deflate_input(int flush);
+        
+        std::FILE* file = nullptr;
+        z_stream stream{};
+        std::uint32_t width, height;
+        std::uint32_t rows = 0;
+        bool failed = false;
+        bool finished = false;
+        std::vector<std::uint8_t> filtered_row;
+        std::vector<std::uint8_t> output;
+};
+
+// decodes a png one row at a time, only ever holding the current and previous row. handles non-interlaced 8 and 16 bit images of every
+// color type and 8 bit palettes, anything else reports !good() so the caller can fall back to stb.
+class png_reader_t
+{
+    public:
+        explicit png_reader_t(const std::string& path);
+        
+        png_reader_t(const png_reader_t&) = delete;
+        
+        png_reader_t& operator=(const png_reader_t&) = delete;
+        
+        // next unfiltered row in the file's own format, or nullptr once every row has been read or the file turned out to be broken
+        const std::uint8_t* read_row();
+        
+        // converts a row returned by read_row into rgb values between 0 and 1
+        void to_rgb(const std::uint8_t* row, float* rgb) const;
+        
+        [[nodiscard]] bool good() const
+        {
+            return file != nullptr && !failed;
+        }
+        
+        [[nodiscard]] std::uint32_t get_width() const
+        {
+            return width;
+        }
+        
+        [[nodiscard]] std::uint32_t get_height() const
+        {
+            return height;
+        }
+        
+        ~png_reader_t();
+    
+    private:
+        bool read_header();
+        
+        // loads the next IDAT chunk into the inflate input, false if there are none left
+        bool next_idat();
+        
+        std::FILE* file = nullptr;
+        z_stream stream{};
+        bool stream_open = false;
+        bool failed = false;
+        std::uint32_t width = 0, height = 0;
+        std::uint32_t rows = 0;
+        std::uint8_t bit_depth = 0, color_type = 0;
+        // bytes per complete pixel, which is what the filters work in
+        std::size_t pixel_bytes = 0;
+        std::size_t row_bytes = 0;
+        std::vector<std::uint8_t> palette;
+        std::vector<std::uint8_t> input;
+        std::vector<std::uint8_t> current_row;
+        std::vector<std::uint8_t> previous_row;
+};
+
+// decodes a png and box filters it straight down to max(width / divisor, min_size) by max(height / divisor, min_size), so memory stays
+// proportional to the output instead of the source. values are linearized the same way stbi_loadf does. returns a malloc'd buffer, or
+// nullptr if the file can't be streamed or the result would be larger than the source.
+float* load_png_scaled(const std::string& path, int divisor, int min_size, int& width, int& height);
+
+#endif //IMAGE_GP_6_PNG_STREAM_H
@@ -0,0 +1,50 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_RENDER_H
+#define IMAGE_GP_6_RENDER_H
+
+#include <blt/gp/program.h>
+#include <string>
+
+// smallest tile interior worth rendering. kernels are shrunk until the halo leaves at least this much of a tile
+inline constexpr blt::size_t MIN_RENDER_TILE = 64;
+
+struct render_stats_t
+{
+    bool success = false;
+    blt::size_t size = 0;
+    blt::size_t tile_size = 0;
+    blt::size_t halo = 0;
+    // kernel_scale the tree was rendered with. anything above IMAGE_SIZE / size means the kernels were shrunk to fit in a tile
+    float kernel_scale = 1;
+    // operators whose kernels were shrunk by kernel_scale, so the output differs from what the tree produces at this size
+    blt::size_t shrunk_kernels = 0;
+    double seconds = 0;
+    
+    [[nodiscard]] double megapixels_per_second() const
+    {
+        return seconds == 0 ? 0 : static_cast<double>(size * size) / 1e6 / seconds;
+    }
+};
+
+// renders the tree at size x size straight to a png, a band of tiles at a time. only two bands are ever held in memory, one being
+// rendered while the other is compressed, so the output can be far larger than would fit in ram as floats.
+render_stats_t render_large(blt::gp::tree_t& tree, blt::size_t size, const std::string& path, blt::size_t threads = 0);
+
+#endif //IMAGE_GP_6_RENDER_H
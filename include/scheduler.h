@@ -0,0 +1,125 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_SCHEDULER_H
+#define IMAGE_GP_6_SCHEDULER_H
+
+#include <blt/std/types.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+enum class run_mode_t : blt::i32
+{
+    PAUSED,
+    // run a single generation then pause
+    STEP,
+    // run a fixed number of generations then pause
+    RUN_N,
+    RUN,
+    // run until the best fitness reaches the target
+    RUN_UNTIL_FITNESS
+};
+
+// decides when the gp thread runs generations. the thread sleeps on a condition variable whenever there is nothing to do, and any command
+// wakes it immediately. commands can come from any thread, the ui and the headless runner both drive it through the same calls.
+class generation_scheduler_t
+{
+    public:
+        using clock = std::chrono::steady_clock;
+        
+        void pause();
+        
+        void step();
+        
+        void run();
+        
+        void run_n(blt::size_t generations);
+        
+        void run_until_fitness(double fitness);
+        
+        // queues work to run on the gp thread between generations, for anything that must not overlap with one
+        void post(std::function<void()> task);
+        
+        // wakes the loop and makes it return once the current generation is done
+        void stop();
+        
+        // blocks the caller until the scheduler has paused or stopped
+        void wait_idle();
+        
+        // minimum time between the start of two generations, to keep the gui responsive. zero runs them back to back
+        void set_min_interval(std::chrono::milliseconds interval);
+        
+        // called on the gp thread after every generation. the returned id removes the hook again
+        blt::size_t on_generation(std::function<void(blt::size_t generation)> hook);
+        
+        void remove_hook(blt::size_t id);
+        
+        // runs on the gp thread until stop is called. run_generation executes one generation and best_fitness reports the fitness used by
+        // run_until_fitness.
+        void run_loop(const std::function<void()>& run_generation, const std::function<double()>& best_fitness);
+        
+        [[nodiscard]] run_mode_t get_mode() const
+        {
+            std::scoped_lock lock(mutex);
+            return mode;
+        }
+        
+        [[nodiscard]] blt::size_t get_remaining() const
+        {
+            std::scoped_lock lock(mutex);
+            return remaining;
+        }
+        
+        [[nodiscard]] blt::size_t generations_run() const
+        {
+            std::scoped_lock lock(mutex);
+            return generations;
+        }
+    
+    private:
+        void set_mode(run_mode_t new_mode, blt::size_t count = 0, double fitness = 0);
+        
+        [[nodiscard]] bool has_work() const
+        {
+            return stopping || !tasks.empty() || mode != run_mode_t::PAUSED;
+        }
+        
+        mutable std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable idle;
+        run_mode_t mode = run_mode_t::PAUSED;
+        blt::size_t remaining = 0;
+        double target_fitness = 0;
+        blt::size_t generations = 0;
+        bool stopping = false;
+        bool busy = false;
+        std::chrono::milliseconds min_interval{0};
+        clock::time_point last_start{};
+        std::deque<std::function<void()>> tasks;
+        std::vector<std::pair<blt::size_t, std::function<void(blt::size_t)>>> hooks;
+        blt::size_t next_hook = 0;
+};
+
+inline generation_scheduler_t scheduler;
+
+#endif //IMAGE_GP_6_SCHEDULER_H
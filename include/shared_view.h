@@ -0,0 +1,117 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_SHARED_VIEW_H
+#define IMAGE_GP_6_SHARED_VIEW_H
+
+#include <snapshot.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+inline constexpr auto DEFAULT_SHARED_VIEW = "/image-gp-6";
+
+enum class view_command_type_t : blt::u32
+{
+    // give the individual the next user assigned fitness, same as clicking on it in the gui
+    MARK,
+    // print and save the individual's tree
+    SAVE_TREE,
+    STEP,
+    RUN,
+    PAUSE,
+    // show another page of the population, index is the page
+    PAGE
+};
+
+struct view_command_t
+{
+    view_command_type_t type;
+    blt::u32 index;
+};
+
+struct shared_view_header_t;
+
+// publishes snapshots into a posix shared memory segment any number of viewers can map. snapshots go into a ring of slots guarded by
+// sequence numbers, so the gp process never waits on a viewer and a viewer which is mid copy just retries. commands from the viewers
+// come back through a small queue any number of them can send on, polled by a background thread.
+class shared_view_host_t
+{
+    public:
+        shared_view_host_t() = default;
+        
+        shared_view_host_t(const shared_view_host_t&) = delete;
+        
+        shared_view_host_t& operator=(const shared_view_host_t&) = delete;
+        
+        bool open(const std::string& name, std::function<void(const view_command_t&)> handler);
+        
+        void publish(const population_snapshot_t& snapshot);
+        
+        void close();
+        
+        [[nodiscard]] bool is_open() const
+        {
+            return header != nullptr;
+        }
+        
+        ~shared_view_host_t();
+    
+    private:
+        std::string name;
+        shared_view_header_t* header = nullptr;
+        std::atomic_bool polling = false;
+        std::thread poll_thread;
+};
+
+class shared_view_client_t
+{
+    public:
+        shared_view_client_t() = default;
+        
+        shared_view_client_t(const shared_view_client_t&) = delete;
+        
+        shared_view_client_t& operator=(const shared_view_client_t&) = delete;
+        
+        bool attach(const std::string& name);
+        
+        // copies the newest snapshot into out if it is newer than the last one read. never blocks the host
+        bool read(population_snapshot_t& out);
+        
+        // false if the queue is full, the host has stopped draining it. safe to call from several viewers at once
+        bool send(const view_command_t& command);
+        
+        // true while the process which created the segment is still running
+        [[nodiscard]] bool host_alive() const;
+        
+        void detach();
+        
+        [[nodiscard]] bool is_attached() const
+        {
+            return header != nullptr;
+        }
+        
+        ~shared_view_client_t();
+    
+    private:
+        shared_view_header_t* header = nullptr;
+        blt::u64 last_read = 0;
+};
+
+#endif //IMAGE_GP_6_SHARED_VIEW_H
@@ -0,0 +1,61 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_SNAPSHOT_H
+#define IMAGE_GP_6_SNAPSHOT_H
+
+#include <config.h>
+#include <triple_buffer.h>
+#include <algorithm>
+#include <cmath>
+
+inline constexpr blt::size_t SNAPSHOT_IMAGE_BYTES = IMAGE_SIZE * IMAGE_SIZE * CHANNELS;
+
+// everything the ui shows about a generation, copied out by the gp thread so the ui never reads the population while it is being replaced.
+// only the page being shown is copied, individual i of the snapshot is individual first + i of the population
+struct population_snapshot_t
+{
+    // generation the snapshot was taken after
+    blt::u64 version = 0;
+    blt::size_t population = 0;
+    blt::size_t first = 0;
+    blt::size_t count = 0;
+    std::array<std::array<blt::u8, SNAPSHOT_IMAGE_BYTES>, PAGE_SIZE> pixels{};
+    std::array<double, PAGE_SIZE> adjusted_fitness{};
+    std::array<double, PAGE_SIZE> raw_fitness{};
+    // fitness assigned by clicking, negative when unset
+    std::array<double, PAGE_SIZE> user_fitness{};
+    // memory held by the population's retained images
+    blt::size_t image_bytes = 0;
+    double best_fitness = 0;
+    double average_fitness = 0;
+    double worst_fitness = 0;
+    double overall_fitness = 0;
+};
+
+inline triple_buffer_t<population_snapshot_t> population_snapshots;
+
+// matches the conversion opengl applies when uploading floats to an rgb8 texture
+inline blt::u8 quantize_channel(float value)
+{
+    if (!(value > 0))
+        return 0;
+    return static_cast<blt::u8>(std::lround(std::min(value, 1.0f) * 255.0f));
+}
+
+#endif //IMAGE_GP_6_SNAPSHOT_H
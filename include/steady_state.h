@@ -0,0 +1,74 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_STEADY_STATE_H
+#define IMAGE_GP_6_STEADY_STATE_H
+
+#include <blt/std/types.h>
+#include <atomic>
+
+// steady state evolution replaces the generational loop with threads which each breed, evaluate and insert one offspring at a time. a thread
+// which draws a slow tree only holds up itself, the others keep producing offspring. a population's worth of offspring counts as one
+// generation for the scheduler, the stats and everything that runs between generations.
+struct steady_state_settings_t
+{
+    bool enabled = false;
+    // threads breeding offspring, 0 uses every core
+    blt::size_t threads = 0;
+    // individuals drawn when picking a parent, the fittest of them breeds
+    blt::size_t selection_size = 3;
+    // individuals drawn when inserting an offspring, it replaces the least fit of them if it is at least as fit
+    blt::size_t replacement_size = 3;
+};
+
+struct steady_state_stats_t
+{
+    std::atomic_uint64_t offspring = 0;
+    // offspring which lost their replacement tournament and were thrown away
+    std::atomic_uint64_t rejected = 0;
+    // time spent breeding and evaluating, summed over every thread
+    std::atomic_uint64_t busy_ns = 0;
+    std::atomic_uint64_t wall_ns = 0;
+    std::atomic_uint64_t threads = 0;
+    
+    void reset()
+    {
+        offspring = 0;
+        rejected = 0;
+        busy_ns = 0;
+        wall_ns = 0;
+        threads = 0;
+    }
+    
+    // fraction of the threads' time spent on offspring rather than waiting for each other
+    [[nodiscard]] double utilization() const
+    {
+        const auto available = static_cast<double>(wall_ns) * static_cast<double>(threads);
+        return available == 0 ? 0 : static_cast<double>(busy_ns) / available;
+    }
+};
+
+inline steady_state_settings_t steady_state_settings;
+inline steady_state_stats_t steady_state_stats;
+
+// breeds and inserts a population's worth of offspring into the current population. the only wait is for the offspring still in flight
+// once the last one has been handed out, at most one per thread. fitness is left for evaluate_fitness to recombine, which also applies user
+// assigned fitness and refreshes the population stats. must run on the gp thread
+void run_steady_state_epoch();
+
+#endif //IMAGE_GP_6_STEADY_STATE_H
@@ -0,0 +1,37 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_TARGET_CACHE_H
+#define IMAGE_GP_6_TARGET_CACHE_H
+
+#include <blt/std/types.h>
+#include <string>
+
+inline constexpr auto TARGET_CACHE_DIRECTORY = "target_cache";
+
+// hash of the source image's bytes, used to name its cache file
+blt::u64 hash_file(const std::string& path);
+
+// fills target_levels from the cache of the image at path. the file is memory mapped and the hsv and histogram matrices point straight
+// into it, only the images themselves are copied. returns false if there is no cache for this exact file.
+bool load_target_cache(const std::string& path);
+
+// writes the current target_levels to the cache for the image at path
+bool save_target_cache(const std::string& path);
+
+#endif //IMAGE_GP_6_TARGET_CACHE_H
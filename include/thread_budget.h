@@ -0,0 +1,126 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef IMAGE_GP_6_THREAD_BUDGET_H
+#define IMAGE_GP_6_THREAD_BUDGET_H
+
+#include <blt/std/types.h>
+#include <atomic>
+#include <optional>
+
+// rendering has two layers of threads. the outer layer renders different individuals (blt-gp's pool, the cost scheduler, steady state and
+// every parallel_for over the population) while the inner layer works on one image (opencv's own pool, tiles and animation frames). left
+// alone both size themselves to every core, so a 64 core machine ends up with 64 * 64 threads fighting over it. the budget gives each layer
+// an explicit share of the cores.
+enum class thread_policy_t : blt::i32
+{
+    // leave every thread count as it was configured, opencv included
+    MANUAL,
+    // one individual per core, everything inside an individual runs single threaded
+    OUTER,
+    // one individual at a time with every core working on it
+    INNER,
+    // individuals first, with the cores left over once every individual has a thread going to the inner layer
+    ADAPTIVE
+};
+
+struct thread_budget_settings_t
+{
+    thread_policy_t policy = thread_policy_t::ADAPTIVE;
+    // cores shared between the layers, 0 uses every core
+    blt::size_t cores = 0;
+};
+
+struct thread_split_t
+{
+    blt::size_t outer = 1;
+    blt::size_t inner = 1;
+};
+
+// the thread counts each layer reads, as configured by hand
+struct manual_threads_t
+{
+    blt::size_t scheduler = 0;
+    blt::size_t tile = 1;
+    blt::size_t steady_state = 0;
+    blt::size_t animation = 1;
+};
+
+struct thread_budget_stats_t
+{
+    std::atomic_uint64_t outer = 0;
+    std::atomic_uint64_t inner = 0;
+    // blt-gp's pool is sized when the program is constructed and never changes
+    std::atomic_uint64_t program_threads = 0;
+    std::atomic_uint64_t opencv_threads = 0;
+    // context switches during the last generation. involuntary ones are the scheduler taking a core away from a thread which still had work
+    std::atomic_uint64_t voluntary_switches = 0;
+    std::atomic_uint64_t involuntary_switches = 0;
+    std::atomic<double> seconds = 0;
+    // threads the budget allows to be busy at once for each core, anything over 1 is oversubscribed
+    std::atomic<double> oversubscription = 0;
+    
+    [[nodiscard]] double involuntary_per_second() const
+    {
+        return seconds == 0 ? 0 : static_cast<double>(involuntary_switches) / seconds;
+    }
+};
+
+class thread_budget_t
+{
+    public:
+        // share of the cores each layer gets under the policy
+        [[nodiscard]] static thread_split_t split(const thread_budget_settings_t& settings, blt::size_t population);
+        
+        // hands the split out to every thread count the layers read and to opencv, then starts measuring context switches. must run on the
+        // gp thread before the generation is rendered
+        void begin_generation();
+        
+        void end_generation();
+        
+        // replaces the settings along with every thread count the budget would have saved, as a job does. the counts kept from before
+        // no longer apply and aren't restored when the policy goes back to manual
+        void configure(const thread_budget_settings_t& new_settings);
+        
+        // true when the outer share is smaller than blt-gp's pool, which can't shrink once constructed. the generation is then rendered by
+        // the cost scheduler on the outer share instead, leaving blt-gp's threads only recombining fitness
+        [[nodiscard]] bool render_outside_program() const
+        {
+            return render_outside;
+        }
+        
+        thread_budget_settings_t settings;
+    
+    private:
+        bool render_outside = false;
+        // what the thread counts were before the budget started overwriting them, put back once the policy is manual again
+        std::optional<manual_threads_t> manual;
+        blt::u64 start_ns = 0;
+        blt::i64 start_voluntary = 0;
+        blt::i64 start_involuntary = 0;
+};
+
+inline thread_budget_t thread_budget;
+inline thread_budget_stats_t thread_budget_stats;
+
+// cores available to the process, honouring its cpu affinity mask
+blt::size_t available_cores();
+
+// opencv's pool is shared by every thread in the process. 1 runs each call on the thread which made it
+void set_opencv_threads(blt::size_t threads);
+
+#endif //IMAGE_GP_6_THREAD_BUDGET_H
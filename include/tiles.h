@@ -0,0 +1,45 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_TILES_H
+#define IMAGE_GP_6_TILES_H
+
+#include <blt/gp/program.h>
+#include <helper.h>
+
+// a rectangle of the output, in pixels of the region being rendered
+struct tile_t
+{
+    blt::size_t x, y, width, height;
+};
+
+// number of extra pixels a tile needs on each side so every neighbourhood operator in the tree sees the same input it would when rendering
+// the whole region. nested operators add their radii together.
+blt::size_t tree_halo(blt::gp::tree_t& tree, const eval_region_t& region);
+
+// number of operators in the tree whose kernels are smaller under the region's kernel_scale than they would be at its real scale
+blt::size_t count_shrunk_kernels(blt::gp::tree_t& tree, const eval_region_t& region);
+
+// true if a tile of this size plus its halo fits in an image
+bool tile_fits(blt::size_t tile_size, blt::size_t halo);
+
+// renders a single tile of the region. dst points at the tile's first pixel and rows are stride pixels apart. the halo is clamped to the
+// region so tiles on the border are handled by opencv exactly like the whole image is.
+void render_tile(blt::gp::tree_t& tree, const eval_region_t& region, blt::size_t halo, const tile_t& tile, float* dst, blt::size_t stride);
+
+#endif //IMAGE_GP_6_TILES_H
@@ -0,0 +1,90 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_TRACER_H
+#define IMAGE_GP_6_TRACER_H
+
+#include <blt/std/types.h>
+#include <blt/std/time.h>
+#include <atomic>
+#include <string>
+
+// a timeline of what every thread spent its time on: evaluating individuals, breeding, each kind of mutation, crossover and every operator
+// call. spans go into a ring buffer owned by the thread which recorded them, so recording never waits on another thread, and are written
+// out as chrome trace event json, which chrome://tracing and ui.perfetto.dev both open. while the tracer is off a span costs a relaxed
+// load, building with ENABLE_TRACER off removes them entirely.
+
+// spans kept per thread, older ones are overwritten. a generation can call millions of operators, so a long run only keeps its end
+inline constexpr blt::size_t TRACE_BUFFER_EVENTS = 1 << 16;
+
+class tracer_t
+{
+    public:
+        // starting the tracer forgets every span recorded before
+        void set_enabled(bool enabled);
+        
+        [[nodiscard]] bool enabled() const
+        {
+            return compiled_in() && active.load(std::memory_order_relaxed);
+        }
+        
+        // name must outlive the tracer, every caller passes a string literal
+        static void record(const char* name, blt::u64 start, blt::u64 end);
+        
+        // writes the spans still held by every thread's buffer, safe to call while they are recording
+        bool write(const std::string& path) const;
+        
+        [[nodiscard]] static constexpr bool compiled_in()
+        {
+#ifdef IMAGE_GP_TRACE
+            return true;
+#else
+            return false;
+#endif
+        }
+    
+    private:
+        std::atomic_bool active = false;
+        std::atomic_uint64_t since = 0;
+};
+
+inline tracer_t tracer;
+
+// records the time from its construction to its destruction as a span on the calling thread
+class trace_span_t
+{
+    public:
+        explicit trace_span_t(const char* name): name(name), start(tracer.enabled() ? blt::system::getCurrentTimeNanoseconds() : 0)
+        {}
+        
+        trace_span_t(const trace_span_t&) = delete;
+        
+        trace_span_t& operator=(const trace_span_t&) = delete;
+        
+        ~trace_span_t()
+        {
+            if (start != 0)
+                tracer_t::record(name, start, blt::system::getCurrentTimeNanoseconds());
+        }
+    
+    private:
+        const char* name;
+        blt::u64 start;
+};
+
+#endif //IMAGE_GP_6_TRACER_H
@@ -0,0 +1,64 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_TREE_IO_H
+#define IMAGE_GP_6_TREE_IO_H
+
+#include <blt/gp/program.h>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct tree_op_t
+{
+    blt::u64 id;
+    blt::u64 type_size;
+    blt::u8 is_value;
+};
+
+// a tree detached from the program it was made by. programs sharing an operator set (the islands) pass trees around in this form
+struct tree_data_t
+{
+    std::vector<tree_op_t> operations;
+    std::vector<blt::u8> values;
+};
+
+tree_data_t export_tree(blt::gp::tree_t& tree);
+
+blt::gp::tree_t import_tree(const tree_data_t& data, blt::gp::gp_program& destination);
+
+// appends every value of the tree, each tagged with how it is stored. image literals (lit and vec) are a single colour repeated over the
+// whole canvas, so only that colour is stored instead of the few hundred kilobytes of the full image
+void encode_values(const tree_data_t& tree, std::vector<blt::u8>& out);
+
+// expands the values back into the layout of a value stack, false if they don't match the operators
+bool decode_values(const blt::u8* bytes, const blt::u8* end, tree_data_t& tree);
+
+// compact form sent to evaluation workers, 32 bit fields since no tree comes anywhere near the limits. values are stored by encode_values
+void encode_tree(const tree_data_t& data, std::vector<blt::u8>& out);
+
+// checks the operators against this process's operator set, false if the bytes don't describe a tree it can run
+bool decode_tree(const blt::u8* bytes, blt::size_t size, tree_data_t& out);
+
+// trees are saved as their operator list followed by the raw bytes of the value stack. operator ids are only meaningful for the operator
+// set they were written with, so the number of operators is stored and checked on load.
+bool save_tree(blt::gp::tree_t& tree, const std::string& path);
+
+std::optional<blt::gp::tree_t> load_tree(const std::string& path);
+
+#endif //IMAGE_GP_6_TREE_IO_H
@@ -0,0 +1,69 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_6_TRIPLE_BUFFER_H
+#define IMAGE_GP_6_TRIPLE_BUFFER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// hands values from a single writer to a single reader without either ever blocking. the writer fills its buffer and publishes it by
+// swapping it with the shared middle one, the reader swaps its buffer with the middle one whenever something new has been published.
+// the reader always sees the most recent complete value and the writer never waits for the reader to catch up.
+template<typename T>
+class triple_buffer_t
+{
+    public:
+        // only touched by the writer between publishes
+        T& write_buffer()
+        {
+            return buffers[back];
+        }
+        
+        void publish()
+        {
+            back = middle.exchange(static_cast<std::uint8_t>(back | FRESH), std::memory_order_acq_rel) & INDEX_MASK;
+        }
+        
+        // makes the latest published value the read buffer. returns false, leaving the read buffer alone, if nothing was published since
+        bool update()
+        {
+            if ((middle.load(std::memory_order_relaxed) & FRESH) == 0)
+                return false;
+            front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+            return true;
+        }
+        
+        // only touched by the reader between updates
+        const T& read_buffer() const
+        {
+            return buffers[front];
+        }
+    
+    private:
+        static constexpr std::uint8_t INDEX_MASK = 0b011;
+        static constexpr std::uint8_t FRESH = 0b100;
+        
+        std::array<T, 3> buffers{};
+        std::uint8_t back = 0;
+        std::atomic_uint8_t middle = 1;
+        std::uint8_t front = 2;
+};
+
+#endif //IMAGE_GP_6_TRIPLE_BUFFER_H
@@ -0,0 +1,200 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <affinity.h>
+#include <image_store.h>
+#include <blt/std/logging.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <pthread.h>
+#include <thread>
+
+#ifdef IMAGE_GP_HAVE_NUMA
+    #include <numa.h>
+#endif
+
+// "0-3,8,10-11" as found in /sys/devices/system/node/node*/cpulist
+static std::vector<int> parse_cpu_list(const std::string& list)
+{
+    std::vector<int> cpus;
+    std::istringstream in{list};
+    std::string range;
+    while (std::getline(in, range, ','))
+    {
+        const auto dash = range.find('-');
+        try
+        {
+            const auto first = std::stoi(range.substr(0, dash));
+            const auto last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; cpu++)
+                cpus.push_back(cpu);
+        } catch (const std::exception&)
+        {
+            // a trailing newline or an empty list
+        }
+    }
+    return cpus;
+}
+
+static cpu_topology_t detect_topology()
+{
+    cpu_topology_t topology;
+    
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        for (unsigned cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1u); cpu++)
+            CPU_SET(cpu, &allowed);
+    }
+    
+    // node of every cpu, -1 for cpus no node claims
+    std::vector<int> node_of(CPU_SETSIZE, -1);
+    int node_count = 0;
+#ifdef IMAGE_GP_HAVE_NUMA
+    if (numa_available() >= 0)
+    {
+        topology.from_libnuma = true;
+        node_count = numa_num_configured_nodes();
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &allowed))
+                node_of[cpu] = numa_node_of_cpu(cpu);
+        }
+    }
+#endif
+    if (!topology.from_libnuma)
+    {
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", error))
+        {
+            const auto name = entry.path().filename().string();
+            if (name.rfind("node", 0) != 0 || name.size() == 4 || !std::isdigit(static_cast<unsigned char>(name[4])))
+                continue;
+            const auto node = std::stoi(name.substr(4));
+            std::ifstream file{entry.path() / "cpulist"};
+            std::string list;
+            std::getline(file, list);
+            for (auto cpu : parse_cpu_list(list))
+            {
+                if (cpu >= 0 && cpu < CPU_SETSIZE)
+                    node_of[cpu] = node;
+            }
+            node_count = std::max(node_count, node + 1);
+        }
+    }
+    
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, &allowed))
+            topology.cpus.push_back(cpu);
+    }
+    // without any node information everything is one node
+    for (auto& node : node_of)
+        node = std::max(node, 0);
+    std::stable_sort(topology.cpus.begin(), topology.cpus.end(), [&node_of](int a, int b) {
+        return node_of[a] < node_of[b];
+    });
+    for (auto cpu : topology.cpus)
+        topology.nodes.push_back(node_of[cpu]);
+    topology.node_count = static_cast<blt::size_t>(std::max(node_count, 1));
+    return topology;
+}
+
+std::string cpu_topology_t::describe() const
+{
+    std::string out;
+    for (blt::size_t node = 0; node < node_count; node++)
+    {
+        std::string list;
+        for (blt::size_t i = 0; i < cpus.size(); i++)
+        {
+            if (static_cast<blt::size_t>(nodes[i]) == node)
+                list += (list.empty() ? "" : ",") + std::to_string(cpus[i]);
+        }
+        if (!list.empty())
+            out += (out.empty() ? "" : "\n") + ("node " + std::to_string(node) + ": " + list);
+    }
+    return out;
+}
+
+const cpu_topology_t& cpu_topology()
+{
+    static const cpu_topology_t topology = []() {
+        auto detected = detect_topology();
+        BLT_INFO("%ld cpus on %ld numa nodes (from %s)", detected.cpus.size(), detected.node_count, detected.from_libnuma ? "libnuma" : "sysfs");
+        std::istringstream lines{detected.describe()};
+        std::string line;
+        while (std::getline(lines, line))
+            BLT_INFO("  %s", line.c_str());
+        return detected;
+    }();
+    return topology;
+}
+
+void pin_current_thread(const std::vector<int>& cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus)
+        CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+worker_placement_t::worker_placement_t(blt::size_t worker)
+{
+    if (!affinity_settings.pin_workers)
+        return;
+    const auto& topology = cpu_topology();
+    if (topology.cpus.empty())
+        return;
+    
+    const auto slot = worker % topology.cpus.size();
+    if (pthread_getaffinity_np(pthread_self(), sizeof(previous), &previous) != 0)
+        return;
+    pin_current_thread({topology.cpus[slot]});
+    pinned = true;
+    
+    // memory this thread allocated before moving here may sit on another node
+    thread_local int last_node = -1;
+    if (last_node != topology.nodes[slot])
+    {
+        last_node = topology.nodes[slot];
+#ifdef IMAGE_GP_HAVE_NUMA
+        if (topology.from_libnuma)
+            numa_set_localalloc();
+#endif
+        image_store_t::release_scratch();
+    }
+}
+
+worker_placement_t::~worker_placement_t()
+{
+    if (pinned)
+        pthread_setaffinity_np(pthread_self(), sizeof(previous), &previous);
+}
+
+blt::size_t persistent_worker_slot()
+{
+    static std::atomic_uint64_t next_slot = 0;
+    thread_local const blt::size_t slot = next_slot.fetch_add(1, std::memory_order_relaxed);
+    return slot;
+}
@@ -0,0 +1,203 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <animation.h>
+#include <image_operations.h>
+#include <deadline.h>
+#include <parallel.h>
+#include <blt/std/logging.h>
+#include <fstream>
+#include <cmath>
+#include <iterator>
+
+bool load_animation(const std::string& path)
+{
+    std::ifstream file{path, std::ios::binary};
+    if (!file)
+    {
+        BLT_WARN("Unable to open animation %s", path.c_str());
+        return false;
+    }
+    std::vector<stbi_uc> buffer{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    
+    int* delays = nullptr;
+    int width, height, frames, channels;
+    auto* data = stbi_load_gif_from_memory(buffer.data(), static_cast<int>(buffer.size()), &delays, &width, &height, &frames, &channels,
+                                           CHANNELS);
+    if (data == nullptr)
+    {
+        BLT_WARN("Unable to decode animation %s: %s", path.c_str(), stbi_failure_reason());
+        return false;
+    }
+    
+    const auto frame_count = static_cast<blt::size_t>(frames);
+    const auto used = std::min(frame_count, std::max(animation_settings.max_frames, 1ul));
+    const auto frame_size = static_cast<blt::size_t>(width * height) * CHANNELS;
+    
+    animation_frames.clear();
+    animation_frames.resize(used);
+    for (blt::size_t i = 0; i < used; i++)
+    {
+        const auto* frame = data + (i * frame_count / used) * frame_size;
+        // linearized the same way stbi_loadf loads still targets
+        auto* pixels = static_cast<float*>(std::malloc(frame_size * sizeof(float)));
+        for (blt::size_t j = 0; j < frame_size; j++)
+            pixels[j] = std::pow(static_cast<float>(frame[j]) / 255.0f, 2.2f);
+        stb_image_t image{width, height, static_cast<int>(CHANNELS), pixels};
+        prepare_target(animation_frames[i], image, IMAGE_SIZE);
+    }
+    
+    animation_stats.frames = used;
+    stbi_image_free(data);
+    stbi_image_free(delays);
+    BLT_INFO("Loaded %ld of %ld frames from %s", used, frame_count, path.c_str());
+    return true;
+}
+
+struct subtree_t
+{
+    blt::size_t end;
+    bool time_dependent;
+};
+
+blt::gp::tree_t fold_time_independent(blt::gp::tree_t& tree, blt::size_t* folded_ops)
+{
+    auto& ops = tree.get_operations();
+    auto& vals = tree.get_values();
+    
+    // extent and time dependence of the subtree rooted at every op, found with the same reverse walk used for evaluation
+    static thread_local std::vector<subtree_t> subtrees;
+    static thread_local std::vector<blt::size_t> stack;
+    subtrees.resize(ops.size());
+    stack.clear();
+    for (blt::size_t i = ops.size(); i-- > 0;)
+    {
+        const auto& op = ops[i];
+        subtree_t subtree{i + 1, false};
+        if (!op.is_value)
+        {
+            const auto kind = operator_kinds[op.id];
+            subtree.time_dependent = kind == operator_kind_t::TIME || kind == operator_kind_t::RANDOM;
+            auto argc = program.get_operator_info(op.id).argc.argc;
+            for (blt::size_t j = 0; j < argc; j++)
+            {
+                const auto& child = subtrees[stack.back()];
+                subtree.end = child.end;
+                subtree.time_dependent |= child.time_dependent;
+                stack.pop_back();
+            }
+        }
+        subtrees[i] = subtree;
+        stack.push_back(i);
+    }
+    
+    // value bytes of every op, bottom of the stack first
+    const auto total_bytes = tree.total_value_bytes();
+    static thread_local std::vector<blt::u8> values;
+    static thread_local std::vector<blt::size_t> value_offsets;
+    values.resize(total_bytes);
+    vals.copy_to(values.data(), total_bytes);
+    value_offsets.resize(ops.size() + 1);
+    value_offsets[0] = 0;
+    for (blt::size_t i = 0; i < ops.size(); i++)
+        value_offsets[i + 1] = value_offsets[i] + (ops[i].is_value ? blt::gp::stack_allocator::aligned_size(ops[i].type_size) : 0);
+    
+    blt::gp::tree_t folded{program};
+    auto& folded_ops_list = folded.get_operations();
+    std::vector<blt::u8> folded_values;
+    blt::size_t folded_count = 0;
+    
+    for (blt::size_t i = 0; i < ops.size();)
+    {
+        const auto& op = ops[i];
+        const auto& subtree = subtrees[i];
+        // terminals are already as cheap as a literal, only whole image producing subtrees are worth folding
+        const bool foldable = !op.is_value && !subtree.time_dependent && subtree.end - i > 1 && op.type_size == sizeof(full_image_t);
+        if (!foldable)
+        {
+            folded_ops_list.push_back(op);
+            if (op.is_value)
+                folded_values.insert(folded_values.end(), values.begin() + static_cast<blt::ptrdiff_t>(value_offsets[i]),
+                                     values.begin() + static_cast<blt::ptrdiff_t>(value_offsets[i + 1]));
+            i++;
+            continue;
+        }
+        
+        blt::gp::tree_t subtree_tree{program};
+        auto& subtree_ops = subtree_tree.get_operations();
+        subtree_ops.insert(subtree_ops.end(), ops.begin() + static_cast<blt::ptrdiff_t>(i), ops.begin() + static_cast<blt::ptrdiff_t>(subtree.end));
+        subtree_tree.get_values().copy_from(values.data() + value_offsets[i], value_offsets[subtree.end] - value_offsets[i]);
+        
+        static thread_local full_image_t image;
+        image = subtree_tree.get_evaluation_value<full_image_t>(nullptr);
+        
+        folded_ops_list.emplace_back(sizeof(full_image_t), image_literal_id, true);
+        const auto* image_bytes = reinterpret_cast<const blt::u8*>(&image);
+        folded_values.insert(folded_values.end(), image_bytes, image_bytes + sizeof(full_image_t));
+        folded_values.resize(folded_values.size() - sizeof(full_image_t) + blt::gp::stack_allocator::aligned_size(sizeof(full_image_t)), 0);
+        
+        folded_count += subtree.end - i;
+        i = subtree.end;
+    }
+    folded.get_values().copy_from(folded_values.data(), folded_values.size());
+    
+    if (folded_ops != nullptr)
+        *folded_ops = folded_count;
+    return folded;
+}
+
+fitness_components_t evaluate_animation(blt::gp::tree_t& tree, full_image_t& preview)
+{
+    const auto frame_count = animation_frames.size();
+    // animations can be enabled before one has loaded, there is nothing to score against
+    if (frame_count == 0)
+        return worst_components();
+    
+    blt::size_t folded_count = 0;
+    auto folded = animation_settings.fold_static ? fold_time_independent(tree, &folded_count) : tree;
+    animation_stats.evaluations++;
+    animation_stats.total_ops += tree.get_operations().size();
+    animation_stats.folded_ops += folded_count;
+    
+    std::vector<fitness_components_t> components(frame_count);
+    // the frame threads render for the individual's deadline, not one of their own
+    const auto deadline = evaluation_deadline;
+    parallel_for(frame_count, [&](blt::size_t frame) {
+        deadline_guard frame_deadline{deadline};
+        auto region = eval_region_t::for_resolution(IMAGE_SIZE);
+        region.time = static_cast<float>(frame) / static_cast<float>(frame_count);
+        eval_region_guard guard{region};
+        
+        static thread_local full_image_t image;
+        image = folded.get_evaluation_value<full_image_t>(nullptr);
+        components[frame] = score_image(image, animation_frames[frame]);
+        if (frame == 0)
+            preview = image;
+    }, animation_settings.threads);
+    
+    fitness_components_t mean;
+    for (const auto& c : components)
+    {
+        mean.difference += c.difference;
+        mean.fractal += c.fractal;
+        mean.histogram += c.histogram;
+    }
+    mean.difference /= static_cast<double>(frame_count);
+    mean.fractal /= static_cast<double>(frame_count);
+    mean.histogram /= static_cast<double>(frame_count);
+    return mean;
+}
@@ -0,0 +1,388 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <checkpoint.h>
+#include <gp_system.h>
+#include <animation.h>
+#include <image_operations.h>
+#include <target_cache.h>
+#include <tree_io.h>
+#include <blt/std/logging.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// bump whenever the layout changes, older checkpoints are then refused instead of misread
+static constexpr blt::u32 CHECKPOINT_VERSION = 2;
+static constexpr blt::u32 CHECKPOINT_MAGIC = 0x4b434749; // "IGCK"
+
+// followed by the target's path, then one record per individual
+struct checkpoint_header_t
+{
+    blt::u32 magic;
+    blt::u32 version;
+    blt::u64 operator_count;
+    blt::u64 image_size;
+    blt::u64 individual_count;
+    blt::u64 generation;
+    blt::u64 random_seed;
+    blt::u64 target_hash;
+    blt::u64 target_path_length;
+    double last_fitness;
+};
+
+// followed by op_count operators as u32 id, u32 type size, u8 is_value, then value_bytes of values
+struct checkpoint_individual_t
+{
+    fitness_components_t components;
+    blt::u64 level;
+    double user_fitness;
+    blt::u32 op_count;
+    blt::u32 value_bytes;
+};
+
+static_assert(std::is_trivially_copyable_v<checkpoint_header_t> && std::is_trivially_copyable_v<checkpoint_individual_t>);
+
+template<typename T>
+static void append_value(std::vector<blt::u8>& out, const T& value)
+{
+    const auto* bytes = reinterpret_cast<const blt::u8*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template<typename T>
+static bool take_value(const blt::u8*& bytes, const blt::u8* end, T& value)
+{
+    if (static_cast<blt::size_t>(end - bytes) < sizeof(T))
+        return false;
+    std::memcpy(&value, bytes, sizeof(T));
+    bytes += sizeof(T);
+    return true;
+}
+
+// the target is hashed once, not every time a checkpoint is written
+static blt::u64 target_fingerprint()
+{
+    static std::string hashed_target;
+    static blt::u64 hash = 0;
+    if (hashed_target != loaded_target)
+    {
+        hash = hash_file(loaded_target);
+        hashed_target = loaded_target;
+    }
+    return hash;
+}
+
+static bool write_file(const std::string& path, const std::vector<blt::u8>& bytes)
+{
+    const auto temp_path = path + ".tmp";
+    auto fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    blt::size_t written = 0;
+    while (written < bytes.size())
+    {
+        auto result = write(fd, bytes.data() + written, bytes.size() - written);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+        {
+            close(fd);
+            unlink(temp_path.c_str());
+            return false;
+        }
+        written += static_cast<blt::size_t>(result);
+    }
+    // the data has to be on disk before the rename, otherwise a crash can leave the new name pointing at an empty file
+    const bool synced = fsync(fd) == 0;
+    close(fd);
+    if (!synced || std::rename(temp_path.c_str(), path.c_str()) != 0)
+    {
+        unlink(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+// writes checkpoints on a single background thread. a checkpoint that is still queued when a newer one for the same path arrives is
+// replaced, so a slow disk never makes them pile up
+class checkpoint_writer_t
+{
+    public:
+        void submit(const std::string& path, std::vector<blt::u8>&& bytes)
+        {
+            {
+                std::scoped_lock lock(mutex);
+                if (!thread.joinable())
+                    thread = std::thread([this]() { run(); });
+                auto existing = std::find_if(queue.begin(), queue.end(), [&path](const auto& job) { return job.first == path; });
+                if (existing != queue.end())
+                    existing->second = std::move(bytes);
+                else
+                    queue.emplace_back(path, std::move(bytes));
+            }
+            changed.notify_all();
+        }
+        
+        void flush()
+        {
+            std::unique_lock lock(mutex);
+            changed.wait(lock, [this]() { return queue.empty() && !writing; });
+        }
+        
+        ~checkpoint_writer_t()
+        {
+            {
+                std::scoped_lock lock(mutex);
+                stopping = true;
+            }
+            changed.notify_all();
+            if (thread.joinable())
+                thread.join();
+        }
+    
+    private:
+        void run()
+        {
+            std::unique_lock lock(mutex);
+            while (true)
+            {
+                changed.wait(lock, [this]() { return stopping || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                auto job = std::move(queue.front());
+                queue.pop_front();
+                writing = true;
+                lock.unlock();
+                
+                if (write_file(job.first, job.second))
+                    BLT_INFO("Wrote checkpoint %s (%ld bytes)", job.first.c_str(), job.second.size());
+                else
+                    BLT_WARN("Unable to write checkpoint %s", job.first.c_str());
+                
+                lock.lock();
+                writing = false;
+                changed.notify_all();
+            }
+        }
+        
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<std::pair<std::string, std::vector<blt::u8>>> queue;
+        bool writing = false;
+        bool stopping = false;
+        std::thread thread;
+};
+
+static checkpoint_writer_t checkpoint_writer;
+
+bool save_checkpoint(const std::string& path)
+{
+    // animations are scored against every frame, the components wouldn't mean anything against the still target
+    if (animation_settings.enabled || !population_generated)
+    {
+        BLT_WARN("Checkpoints can only be made of a population evolving towards a still target");
+        return false;
+    }
+    
+    auto& individuals = program.get_current_pop().get_individuals();
+    
+    // blt-gp's random state can't be read back out, so a fresh seed is drawn from it and this run continues from that seed just like a
+    // restored one would
+    const auto random_seed = program.get_random().get_u64(1, std::numeric_limits<blt::i64>::max());
+    program.get_random().set_seed(random_seed);
+    
+    std::vector<blt::u8> bytes;
+    checkpoint_header_t header{CHECKPOINT_MAGIC, CHECKPOINT_VERSION, operator_kinds.size(), IMAGE_SIZE, individuals.size(), current_generation(),
+                               random_seed, target_fingerprint(), loaded_target.size(), last_fitness};
+    append_value(bytes, header);
+    bytes.insert(bytes.end(), loaded_target.begin(), loaded_target.end());
+    
+    std::vector<blt::u8> values;
+    for (blt::size_t i = 0; i < individuals.size(); i++)
+    {
+        auto tree = export_tree(individuals[i].tree);
+        values.clear();
+        encode_values(tree, values);
+        
+        checkpoint_individual_t record{evaluation_results[i].components, evaluation_results[i].level, fitness_values[i],
+                                       static_cast<blt::u32>(tree.operations.size()), static_cast<blt::u32>(values.size())};
+        append_value(bytes, record);
+        for (const auto& op : tree.operations)
+        {
+            append_value(bytes, static_cast<blt::u32>(op.id));
+            append_value(bytes, static_cast<blt::u32>(op.type_size));
+            append_value(bytes, op.is_value);
+        }
+        bytes.insert(bytes.end(), values.begin(), values.end());
+    }
+    
+    checkpoint_writer.submit(path, std::move(bytes));
+    return true;
+}
+
+void flush_checkpoints()
+{
+    checkpoint_writer.flush();
+}
+
+struct checkpoint_mapping_t
+{
+    void* data = MAP_FAILED;
+    blt::size_t size = 0;
+    
+    ~checkpoint_mapping_t()
+    {
+        if (data != MAP_FAILED)
+            munmap(data, size);
+    }
+};
+
+struct restored_individual_t
+{
+    checkpoint_individual_t record;
+    tree_data_t tree;
+};
+
+bool load_checkpoint(const std::string& path)
+{
+    if (animation_settings.enabled)
+    {
+        BLT_WARN("Checkpoints can only be loaded while evolving towards a still target");
+        return false;
+    }
+    
+    checkpoint_mapping_t mapping;
+    {
+        auto fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            BLT_WARN("Unable to open checkpoint %s", path.c_str());
+            return false;
+        }
+        struct stat info{};
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            mapping.size = static_cast<blt::size_t>(info.st_size);
+            mapping.data = mmap(nullptr, mapping.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        if (mapping.data == MAP_FAILED)
+        {
+            BLT_WARN("Unable to map checkpoint %s", path.c_str());
+            return false;
+        }
+        // read front to back exactly once
+        madvise(mapping.data, mapping.size, MADV_SEQUENTIAL | MADV_WILLNEED);
+    }
+    
+    const auto* bytes = static_cast<const blt::u8*>(mapping.data);
+    const auto* end = bytes + mapping.size;
+    
+    checkpoint_header_t header{};
+    if (!take_value(bytes, end, header) || header.magic != CHECKPOINT_MAGIC || header.version != CHECKPOINT_VERSION)
+    {
+        BLT_WARN("%s is not a checkpoint or was written by a different version!", path.c_str());
+        return false;
+    }
+    if (header.operator_count != operator_kinds.size() || header.image_size != IMAGE_SIZE || header.individual_count != population_size)
+    {
+        BLT_WARN("%s was written with a different set of operators, image size or population size!", path.c_str());
+        return false;
+    }
+    if (static_cast<blt::size_t>(end - bytes) < header.target_path_length)
+    {
+        BLT_WARN("%s is truncated or corrupt!", path.c_str());
+        return false;
+    }
+    std::string target{reinterpret_cast<const char*>(bytes), header.target_path_length};
+    bytes += header.target_path_length;
+    
+    // everything is checked before the population is touched, a bad checkpoint leaves the run as it was
+    std::vector<restored_individual_t> restored(header.individual_count);
+    for (auto& individual : restored)
+    {
+        bool valid = take_value(bytes, end, individual.record);
+        for (blt::u32 i = 0; valid && i < individual.record.op_count; i++)
+        {
+            blt::u32 id, type_size;
+            blt::u8 is_value;
+            valid = take_value(bytes, end, id) && take_value(bytes, end, type_size) && take_value(bytes, end, is_value) && id < operator_kinds.size();
+            individual.tree.operations.push_back({id, type_size, is_value});
+        }
+        valid = valid && static_cast<blt::size_t>(end - bytes) >= individual.record.value_bytes &&
+                decode_values(bytes, bytes + individual.record.value_bytes, individual.tree) && individual.record.level < LEVEL_COUNT;
+        if (!valid)
+        {
+            BLT_WARN("%s is truncated or corrupt!", path.c_str());
+            return false;
+        }
+        bytes += individual.record.value_bytes;
+    }
+    
+    // the fitness terms are only meaningful against the exact image they were scored on
+    if (loaded_target.empty() || target_fingerprint() != header.target_hash)
+    {
+        if (!setup_target(target) || target_fingerprint() != header.target_hash)
+        {
+            BLT_WARN("%s was made against %s, which has changed or can't be loaded", path.c_str(), target.c_str());
+            return false;
+        }
+    }
+    
+    // the fitness of a fresh population is never looked at, so it doesn't need to be rendered
+    if (!population_generated)
+    {
+        evaluate = false;
+        generate_population();
+    }
+    
+    auto& individuals = program.get_current_pop().get_individuals();
+    for (blt::size_t i = 0; i < individuals.size(); i++)
+    {
+        const auto& individual = restored[i];
+        individuals[i].tree = import_tree(individual.tree, program);
+        evaluation_results[i] = {};
+        evaluation_results[i].components = individual.record.components;
+        evaluation_results[i].level = individual.record.level;
+        fitness_values[i] = individual.record.user_fitness;
+    }
+    last_fitness = header.last_fitness;
+    racing_threshold_valid = false;
+    generation_offset = header.generation - program.get_current_generation();
+    program.get_random().set_seed(header.random_seed);
+    
+    // recombines the saved terms with the current weights without rendering anything
+    update_screening_penalties(evaluation_results.data(), individuals.size());
+    evaluate = false;
+    program.evaluate_fitness();
+    // images aren't saved, only the page the ui is showing is rendered again
+    show_page(visible_page);
+    BLT_INFO("Restored generation %ld from %s", header.generation, path.c_str());
+    return true;
+}
@@ -0,0 +1,327 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cost_scheduler.h>
+#include <affinity.h>
+#include <deadline.h>
+#include <tracer.h>
+#include <helper.h>
+#include <image_operations.h>
+#include <parallel.h>
+#include <tiles.h>
+#include <blt/std/logging.h>
+#include <blt/std/time.h>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+// fraction of a tree's prediction error corrected by each measurement, low enough that one noisy render doesn't swing the model
+static constexpr double LEARNING_RATE = 0.25;
+
+void cost_model_t::ensure_costs()
+{
+    if (costs.size() == operator_kinds.size())
+        return;
+    // starting guesses for a full resolution render, only their ratio matters until the first generation has been measured
+    costs.resize(operator_kinds.size());
+    for (blt::size_t i = 0; i < costs.size(); i++)
+        costs[i] = operator_radius(operator_kinds[i], u64_size_max) > 0 ? 500000 : 20000;
+}
+
+double cost_model_t::predict(blt::gp::tree_t& tree)
+{
+    ensure_costs();
+    double total = base_cost;
+    for (const auto& op : tree.get_operations())
+        total += costs[op.id];
+    return total;
+}
+
+void cost_model_t::learn(blt::gp::tree_t& tree, double measured_ns)
+{
+    // predicted again rather than reusing the prediction the schedule was made with, which trees learned from since have already corrected
+    const auto error = measured_ns - predict(tree);
+    
+    static thread_local std::vector<double> counts;
+    counts.assign(costs.size(), 0);
+    // the base cost is a feature every tree has exactly once
+    double norm = 1;
+    for (const auto& op : tree.get_operations())
+    {
+        norm += counts[op.id] * 2 + 1;
+        counts[op.id]++;
+    }
+    
+    const auto step = LEARNING_RATE * error / norm;
+    // a cost never drops to nothing, or an operator could never be predicted as expensive again
+    base_cost = std::max(base_cost + step, 1.0);
+    for (const auto& op : tree.get_operations())
+    {
+        if (counts[op.id] == 0)
+            continue;
+        costs[op.id] = std::max(costs[op.id] + step * counts[op.id], 1.0);
+        counts[op.id] = 0;
+    }
+}
+
+namespace
+{
+    // tile of a split individual, whole individuals use WHOLE
+    constexpr blt::size_t WHOLE = std::numeric_limits<blt::size_t>::max();
+    
+    struct task_t
+    {
+        blt::size_t index;
+        blt::size_t tile;
+        blt::u64 cost;
+    };
+    
+    struct task_queue_t
+    {
+        std::mutex mutex;
+        std::deque<task_t> tasks;
+        // predicted nanoseconds still queued, read without the lock when looking for something to steal
+        std::atomic_uint64_t remaining = 0;
+    };
+    
+    struct split_t
+    {
+        blt::size_t halo = 0;
+        blt::size_t tiles_x = 0;
+        // the retained image when there is one, the scratch images belong to whichever thread happens to render a tile
+        full_image_t* image = nullptr;
+        std::unique_ptr<full_image_t> owned;
+        std::atomic_uint64_t tiles_left = 0;
+        // started by whichever thread renders the first tile, every tile after it shares the deadline
+        std::atomic_uint64_t deadline = 0;
+    };
+}
+
+void scheduled_evaluate(blt::gp::population_t& pop, image_store_t& images, evaluation_result_t* results, double racing_threshold)
+{
+    auto& individuals = pop.get_individuals();
+    const auto count = individuals.size();
+    if (count == 0)
+        return;
+    
+    const auto region = eval_region_t::for_resolution(IMAGE_SIZE);
+    const auto tile_size = evaluation_settings.tile_size;
+    const bool racing = std::isfinite(racing_threshold);
+    blt::size_t threads = evaluation_settings.scheduler_threads == 0 ? std::max(std::thread::hardware_concurrency(), 1u)
+                                                                      : evaluation_settings.scheduler_threads;
+    threads = std::clamp(threads, 1ul, MAX_SCHEDULER_THREADS);
+    
+    schedule_stats.reset();
+    schedule_stats.threads = threads;
+    const auto start = blt::system::getCurrentTimeNanoseconds();
+    
+    std::vector<double> predicted(count);
+    double total_predicted = 0;
+    for (blt::size_t i = 0; i < count; i++)
+    {
+        predicted[i] = cost_model.predict(individuals[i].tree);
+        total_predicted += predicted[i];
+    }
+    
+    // racing gives up part way through a tree, which only works if one thread sees every tile in order
+    const auto split_above = total_predicted / static_cast<double>(threads) * evaluation_settings.split_share;
+    const bool allow_split = evaluation_settings.split_expensive && !racing && threads > 1;
+    const auto tiles_x = (region.width + tile_size - 1) / tile_size;
+    const auto tiles_y = (region.height + tile_size - 1) / tile_size;
+    
+    std::vector<task_t> tasks;
+    tasks.reserve(count);
+    std::vector<std::unique_ptr<split_t>> splits(count);
+    for (blt::size_t i = 0; i < count; i++)
+    {
+        const auto cost = static_cast<blt::u64>(predicted[i]);
+        if (allow_split && predicted[i] > split_above)
+        {
+            const auto halo = tree_halo(individuals[i].tree, region);
+            if (tile_fits(tile_size, halo))
+            {
+                auto split = std::make_unique<split_t>();
+                split->halo = halo;
+                split->tiles_x = tiles_x;
+                split->tiles_left = tiles_x * tiles_y;
+                if (images.retained(i))
+                    split->image = &images[i];
+                else
+                {
+                    split->owned = std::make_unique<full_image_t>();
+                    split->image = split->owned.get();
+                }
+                splits[i] = std::move(split);
+                for (blt::size_t tile = 0; tile < tiles_x * tiles_y; tile++)
+                    tasks.push_back({i, tile, cost / (tiles_x * tiles_y)});
+                schedule_stats.split++;
+                schedule_stats.tiles += tiles_x * tiles_y;
+                continue;
+            }
+        }
+        tasks.push_back({i, WHOLE, cost});
+    }
+    
+    // longest first onto whichever queue has the least predicted work, so the queues start out balanced and only the error needs stealing
+    std::stable_sort(tasks.begin(), tasks.end(), [](const task_t& a, const task_t& b) {
+        return a.cost > b.cost;
+    });
+    std::vector<task_queue_t> queues(threads);
+    for (const auto& task : tasks)
+    {
+        auto& queue = *std::min_element(queues.begin(), queues.end(), [](const task_queue_t& a, const task_queue_t& b) {
+            return a.remaining < b.remaining;
+        });
+        queue.tasks.push_back(task);
+        queue.remaining += task.cost;
+    }
+    
+    std::vector<std::atomic_uint64_t> measured(count);
+    
+    const auto run_task = [&](const task_t& task) {
+        auto& tree = individuals[task.index].tree;
+        auto& result = results[task.index];
+        if (task.tile == WHOLE)
+        {
+            trace_span_t span{"evaluate"};
+            deadline_guard deadline;
+            auto& image = images[task.index];
+            if (racing)
+                race_tree(tree, image, result, racing_threshold);
+            else
+            {
+                result.aborted = false;
+                if (evaluation_settings.tiled)
+                    render_tree_tiled(tree, image);
+                else
+                    image = tree.get_evaluation_value<full_image_t>(nullptr);
+                result.components = score_image(image, full_target());
+            }
+            deadline.finish(result.components);
+            result.level = LEVEL_COUNT - 1;
+            result.prepared = true;
+            return;
+        }
+        
+        trace_span_t span{"evaluate tile"};
+        auto& split = *splits[task.index];
+        auto shared_deadline = split.deadline.load();
+        if (shared_deadline == 0)
+        {
+            const auto started = deadline_guard::start_deadline();
+            if (split.deadline.compare_exchange_strong(shared_deadline, started))
+                shared_deadline = started;
+        }
+        deadline_guard deadline{shared_deadline};
+        tile_t tile{};
+        tile.x = (task.tile % split.tiles_x) * tile_size;
+        tile.y = (task.tile / split.tiles_x) * tile_size;
+        tile.width = std::min(tile_size, region.width - tile.x);
+        tile.height = std::min(tile_size, region.height - tile.y);
+        render_tile(tree, region, split.halo, tile, split.image->rgb_data + (tile.y * region.width + tile.x) * CHANNELS, region.width);
+        // whoever renders the last tile scores the whole image
+        if (split.tiles_left.fetch_sub(1) == 1)
+        {
+            result.components = score_image(*split.image, full_target());
+            deadline.finish(result.components);
+            result.aborted = false;
+            result.level = LEVEL_COUNT - 1;
+            result.prepared = true;
+        }
+    };
+    
+    const auto take = [&](task_queue_t& queue, bool front, task_t& task) {
+        std::scoped_lock lock(queue.mutex);
+        if (queue.tasks.empty())
+            return false;
+        task = front ? queue.tasks.front() : queue.tasks.back();
+        if (front)
+            queue.tasks.pop_front();
+        else
+            queue.tasks.pop_back();
+        queue.remaining -= task.cost;
+        return true;
+    };
+    
+    parallel_for(threads, [&](blt::size_t thread) {
+        worker_placement_t placement{thread};
+        auto& own = queues[thread];
+        task_t task{};
+        while (true)
+        {
+            if (!take(own, true, task))
+            {
+                // steal from the back of whichever queue has the most predicted work left, where its cheapest tasks are
+                bool stolen = false;
+                while (!stolen)
+                {
+                    task_queue_t* victim = nullptr;
+                    for (auto& queue : queues)
+                    {
+                        if (queue.remaining > 0 && (victim == nullptr || queue.remaining > victim->remaining))
+                            victim = &queue;
+                    }
+                    // tasks predicted to cost nothing still count, so look for any non empty queue before giving up
+                    if (victim == nullptr)
+                    {
+                        for (auto& queue : queues)
+                        {
+                            if (take(queue, false, task))
+                            {
+                                stolen = true;
+                                break;
+                            }
+                        }
+                        if (!stolen)
+                            return;
+                    } else
+                        stolen = take(*victim, false, task);
+                }
+                schedule_stats.steals++;
+            }
+            
+            const auto task_start = blt::system::getCurrentTimeNanoseconds();
+            run_task(task);
+            const auto elapsed = blt::system::getCurrentTimeNanoseconds() - task_start;
+            schedule_stats.busy_ns[thread] += elapsed;
+            measured[task.index] += elapsed;
+        }
+    }, threads);
+    
+    schedule_stats.wall_ns = blt::system::getCurrentTimeNanoseconds() - start;
+    
+    double error = 0;
+    double total_measured = 0;
+    for (blt::size_t i = 0; i < count; i++)
+    {
+        // an aborted race only paid for part of the tree
+        if (results[i].aborted || measured[i] == 0)
+            continue;
+        const auto measured_ns = static_cast<double>(measured[i].load());
+        error += std::abs(measured_ns - predicted[i]);
+        total_measured += measured_ns;
+        cost_model.learn(individuals[i].tree, measured_ns);
+    }
+    schedule_stats.prediction_error = total_measured == 0 ? 0 : error / total_measured;
+    
+    BLT_DEBUG("Cost scheduler: %ld threads at %lf%% utilization, %ld steals, %ld individuals split into %ld tiles, %lf%% prediction error",
+              threads, schedule_stats.utilization() * 100, schedule_stats.steals.load(), schedule_stats.split.load(), schedule_stats.tiles.load(),
+              schedule_stats.prediction_error.load() * 100);
+}
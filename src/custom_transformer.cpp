@@ -20,6 +20,7 @@
 #include <images.h>
 #include <image_operations.h>
 #include <float_operations.h>
+#include <tracer.h>
 
 namespace blt::gp
 {
@@ -39,13 +40,19 @@ namespace blt::gp
         return buffer.data();
     }
     
+    // span names of the mutation operators, indexed by mutation_operator
+    static constexpr const char* mutation_span_names[] = {"mutate expression", "mutate adjust", "mutate sub func", "mutate jump func",
+                                                          "mutate copy"};
+    
     blt::expected<crossover_t::result_t, crossover_t::error_t> image_crossover_t::apply(gp_program& program, const tree_t& p1, const tree_t& p2)
     {
+        trace_span_t span{"crossover"};
         return crossover_t::apply(program, p1, p2);
     }
     
     tree_t image_mutation_t::apply(gp_program& program, const tree_t& p)
     {
+        trace_span_t span{"mutate"};
         // child tree
         tree_t c = p;
         
@@ -84,6 +91,7 @@ namespace blt::gp
                 }
             }
             
+            trace_span_t operator_span{mutation_span_names[selected_point]};
             switch (static_cast<mutation_operator>(selected_point))
             {
                 case mutation_operator::EXPRESSION:
@@ -0,0 +1,294 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <evaluation.h>
+#include <helper.h>
+#include <parallel.h>
+#include <tiles.h>
+#include <image_operations.h>
+#include <deadline.h>
+#include <evaluation_cost.h>
+#include <blt/std/logging.h>
+#include <blt/std/time.h>
+#include <numeric>
+
+full_image_t render_tree(blt::gp::tree_t& tree, blt::size_t size)
+{
+    eval_region_guard guard{eval_region_t::for_resolution(size)};
+    return tree.get_evaluation_value<full_image_t>(nullptr);
+}
+
+void progressive_evaluate(blt::gp::population_t& pop, image_store_t& images, evaluation_result_t* results)
+{
+    auto& individuals = pop.get_individuals();
+    
+    std::vector<blt::size_t> candidates(individuals.size());
+    std::iota(candidates.begin(), candidates.end(), 0);
+    
+    progressive_stats.evaluations = {};
+    for (blt::size_t level = 0; level < LEVEL_COUNT; level++)
+    {
+        const auto size = RESOLUTION_LEVELS[level];
+        parallel_for(candidates.size(), [&](blt::size_t i) {
+            auto index = candidates[i];
+            auto& image = images[index];
+            deadline_guard deadline;
+            image = render_tree(individuals[index].tree, size);
+            results[index].components = score_image(image, target_levels[level]);
+            deadline.finish(results[index].components);
+            results[index].level = level;
+            results[index].prepared = true;
+        });
+        progressive_stats.evaluations[level] = candidates.size();
+        
+        if (level == LEVEL_COUNT - 1)
+            break;
+        
+        std::sort(candidates.begin(), candidates.end(), [results](blt::size_t a, blt::size_t b) {
+            return results[a].components.combine() < results[b].components.combine();
+        });
+        auto promoted = static_cast<blt::size_t>(std::ceil(static_cast<float>(candidates.size()) * evaluation_settings.promotion_ratios[level]));
+        candidates.resize(std::clamp(promoted, 1ul, candidates.size()));
+    }
+    
+    // only the full resolution renders are ready to be displayed
+    parallel_for(individuals.size(), [&](blt::size_t i) {
+        if (results[i].level != LEVEL_COUNT - 1 && images.retained(i))
+            images[i].expand(RESOLUTION_LEVELS[results[i].level]);
+    });
+    
+    update_screening_penalties(results, individuals.size());
+    
+    progressive_stats.full_avoided = individuals.size() - progressive_stats.evaluations.back();
+    progressive_stats.total_full_avoided += progressive_stats.full_avoided;
+    progressive_stats.total_individuals += individuals.size();
+    
+    BLT_DEBUG("Progressive evaluation: %ld / %ld / %ld renders, %ld full resolution evaluations avoided (%ld total)",
+              progressive_stats.evaluations[0], progressive_stats.evaluations[1], progressive_stats.evaluations[2], progressive_stats.full_avoided,
+              progressive_stats.total_full_avoided);
+}
+
+void update_screening_penalties(const evaluation_result_t* results, blt::size_t count)
+{
+    screening_penalties = {};
+    // worst fitness of everyone who made it past the current level, their penalties included
+    auto ceiling = -std::numeric_limits<double>::infinity();
+    for (blt::size_t level = LEVEL_COUNT; level-- > 0;)
+    {
+        auto best = std::numeric_limits<double>::infinity();
+        auto worst = -std::numeric_limits<double>::infinity();
+        for (blt::size_t i = 0; i < count; i++)
+        {
+            if (results[i].level != level)
+                continue;
+            // the same terms the fitness function adds, apart from the user's marks which are ranked separately
+            const auto score = results[i].components.combine() + cost_penalty(results[i]);
+            if (score < best)
+                best = score;
+            if (score > worst)
+                worst = score;
+        }
+        if (best > worst)
+            continue;
+        // the top level starts against an empty ceiling, so it is never penalized
+        if (best <= ceiling)
+            screening_penalties[level] = ceiling - best + 1;
+        ceiling = std::max(ceiling, worst + screening_penalties[level]);
+    }
+}
+
+// sum of compare_values over every value, without score_image's near match discount. unlike the discounted difference it only ever grows
+// as more of the image is scored, so a partial sum can be compared against a whole one
+static double plain_difference(const float* image, const float* target, blt::size_t begin, blt::size_t end)
+{
+    double total = 0;
+    for (blt::size_t i = begin; i < end; i++)
+        total += compare_values(image[i], target[i]);
+    return total;
+}
+
+double get_racing_threshold(blt::gp::population_t& pop)
+{
+    auto& individuals = pop.get_individuals();
+    if (individuals.empty())
+        return std::numeric_limits<double>::infinity();
+    
+    std::vector<blt::size_t> order(individuals.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&individuals](blt::size_t a, blt::size_t b) {
+        return individuals[a].fitness.raw_fitness < individuals[b].fitness.raw_fitness;
+    });
+    
+    blt::size_t index = 0;
+    switch (evaluation_settings.racing_threshold)
+    {
+        case racing_threshold_t::WORST_ELITE:
+            index = std::max(ELITE_COUNT, 1ul) - 1;
+            break;
+        case racing_threshold_t::PERCENTILE:
+            index = static_cast<blt::size_t>(evaluation_settings.racing_percentile * static_cast<float>(order.size() - 1));
+            break;
+    }
+    
+    // only a page of images is kept around, so the threshold individual is rendered again. once per generation is nothing next to racing
+    static full_image_t image;
+    image = render_tree(individuals[order[std::min(index, order.size() - 1)]].tree);
+    const auto& target = full_target();
+    return plain_difference(image.rgb_data, target.image.rgb_data, 0, DATA_CHANNELS_SIZE);
+}
+
+void race_tree(blt::gp::tree_t& tree, full_image_t& image, evaluation_result_t& result, double threshold)
+{
+    const auto& target = full_target();
+    const auto region = eval_region_t::for_resolution(IMAGE_SIZE);
+    const auto tile_size = evaluation_settings.tile_size;
+    
+    result.aborted = false;
+    auto halo = tree_halo(tree, region);
+    if (!tile_fits(tile_size, halo))
+    {
+        racing_stats.fallbacks++;
+        image = render_tree(tree);
+        result.components = score_image(image, target);
+        return;
+    }
+    racing_stats.raced++;
+    
+    const auto tiles_x = (region.width + tile_size - 1) / tile_size;
+    const auto tiles_y = (region.height + tile_size - 1) / tile_size;
+    const auto tile_count = tiles_x * tiles_y;
+    racing_stats.tiles += tile_count;
+    
+    // the plain difference of the tiles scored so far can only grow, so once it passes the threshold the whole image is further from the
+    // target than the threshold individual was
+    double difference = 0;
+    for (blt::size_t i = 0; i < tile_count; i++)
+    {
+        tile_t tile{};
+        tile.x = (i % tiles_x) * tile_size;
+        tile.y = (i / tiles_x) * tile_size;
+        tile.width = std::min(tile_size, region.width - tile.x);
+        tile.height = std::min(tile_size, region.height - tile.y);
+        render_tile(tree, region, halo, tile, image.rgb_data + (tile.y * region.width + tile.x) * CHANNELS, region.width);
+        
+        for (blt::size_t y = tile.y; y < tile.y + tile.height; y++)
+        {
+            const auto begin = (y * region.width + tile.x) * CHANNELS;
+            difference += plain_difference(image.rgb_data, target.image.rgb_data, begin, begin + tile.width * CHANNELS);
+        }
+        
+        if (difference > threshold && i + 1 < tile_count)
+        {
+            racing_stats.aborted++;
+            racing_stats.tiles_skipped += tile_count - i - 1;
+            // blank out whatever is left over from the last individual so the partial render is obvious in the ui
+            for (blt::size_t y = tile.y; y < region.height; y++)
+            {
+                const auto x = y < tile.y + tile.height ? tile.x + tile.width : 0;
+                std::fill(image.rgb_data + (y * region.width + x) * CHANNELS, image.rgb_data + (y + 1) * region.width * CHANNELS, 0.0f);
+            }
+            // the score it would have finished with is unknown, the worst score keeps it below every individual which finished
+            result.components = worst_components();
+            result.aborted = true;
+            return;
+        }
+    }
+    
+    result.components = score_image(image, target);
+}
+
+bool render_tree_tiled(blt::gp::tree_t& tree, full_image_t& image)
+{
+    const auto region = eval_region_t::for_resolution(IMAGE_SIZE);
+    const auto tile_size = evaluation_settings.tile_size;
+    
+    auto halo = tree_halo(tree, region);
+    if (!tile_fits(tile_size, halo))
+    {
+        image = render_tree(tree);
+        return false;
+    }
+    
+    const auto tiles_x = (region.width + tile_size - 1) / tile_size;
+    const auto tiles_y = (region.height + tile_size - 1) / tile_size;
+    const auto deadline = evaluation_deadline;
+    parallel_for(tiles_x * tiles_y, [&](blt::size_t i) {
+        deadline_guard tile_deadline{deadline};
+        tile_t tile{};
+        tile.x = (i % tiles_x) * tile_size;
+        tile.y = (i / tiles_x) * tile_size;
+        tile.width = std::min(tile_size, region.width - tile.x);
+        tile.height = std::min(tile_size, region.height - tile.y);
+        render_tile(tree, region, halo, tile, image.rgb_data + (tile.y * region.width + tile.x) * CHANNELS, region.width);
+    }, evaluation_settings.tile_threads);
+    return true;
+}
+
+// color noise is drawn fresh for every evaluation, so tiles can never match a whole render of trees which use it
+static bool uses_random_noise(blt::gp::tree_t& tree)
+{
+    for (const auto& op : tree.get_operations())
+    {
+        if (!op.is_value && operator_kinds[op.id] == operator_kind_t::RANDOM)
+            return true;
+    }
+    return false;
+}
+
+void benchmark_tiled_evaluation(blt::gp::population_t& pop)
+{
+    auto& individuals = pop.get_individuals();
+    tile_benchmark = {};
+    
+    static full_image_t whole;
+    static full_image_t tiled;
+    for (auto& ind : individuals)
+    {
+        auto start = blt::system::getCurrentTimeNanoseconds();
+        whole = render_tree(ind.tree);
+        auto mid = blt::system::getCurrentTimeNanoseconds();
+        auto was_tiled = render_tree_tiled(ind.tree, tiled);
+        auto end = blt::system::getCurrentTimeNanoseconds();
+        
+        tile_benchmark.individuals++;
+        tile_benchmark.whole_ms += static_cast<double>(mid - start) / 1e6;
+        tile_benchmark.tiled_ms += static_cast<double>(end - mid) / 1e6;
+        if (!was_tiled)
+        {
+            tile_benchmark.untiled++;
+            continue;
+        }
+        if (uses_random_noise(ind.tree))
+            continue;
+        
+        double error = 0;
+        for (blt::size_t i = 0; i < DATA_CHANNELS_SIZE; i++)
+        {
+            // nan and inf show up in plenty of evolved trees, they only need to agree with each other
+            if (std::isfinite(whole.rgb_data[i]) && std::isfinite(tiled.rgb_data[i]))
+                error = std::max(error, static_cast<double>(std::abs(whole.rgb_data[i] - tiled.rgb_data[i])));
+        }
+        if (error > 1e-4)
+            tile_benchmark.mismatches++;
+        tile_benchmark.max_error = std::max(tile_benchmark.max_error, error);
+    }
+    
+    BLT_INFO("Tiled evaluation benchmark over %ld individuals (%ld untiled): whole %lfms, tiled %lfms (%lfx), max error %lf, %ld mismatches",
+             tile_benchmark.individuals, tile_benchmark.untiled, tile_benchmark.whole_ms, tile_benchmark.tiled_ms,
+             tile_benchmark.tiled_ms == 0 ? 0 : tile_benchmark.whole_ms / tile_benchmark.tiled_ms, tile_benchmark.max_error,
+             tile_benchmark.mismatches);
+}
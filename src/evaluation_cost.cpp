@@ -0,0 +1,65 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <evaluation_cost.h>
+#include <cost_scheduler.h>
+#include <gp_system.h>
+#include <blt/std/logging.h>
+#include <vector>
+
+void enforce_cost_budget(blt::gp::population_t& pop, evaluation_result_t* results)
+{
+    auto& individuals = pop.get_individuals();
+    cost_budget_stats.reset();
+    
+    std::vector<blt::size_t> within;
+    std::vector<blt::size_t> over;
+    for (blt::size_t i = 0; i < individuals.size(); i++)
+    {
+        results[i].predicted_ns = cost_model.predict(individuals[i].tree);
+        cost_budget_stats.add(results[i].predicted_ns);
+        (within_cost_budget(results[i].predicted_ns) ? within : over).push_back(i);
+    }
+    if (over.empty())
+        return;
+    // nothing to replace them with, the budget is below what the model thinks any tree costs
+    if (within.empty())
+    {
+        BLT_WARN("Every offspring is predicted to take longer than the %fms budget, keeping them all", cost_budget_settings.budget_ms);
+        return;
+    }
+    
+    for (const auto index : over)
+    {
+        const auto copy = within[program.get_random().get_u64(0, within.size()) % within.size()];
+        individuals[index].tree = individuals[copy].tree;
+        results[index].predicted_ns = results[copy].predicted_ns;
+    }
+    cost_budget_stats.rejected = over.size();
+}
+
+void learn_costs(blt::gp::population_t& pop, evaluation_result_t* results)
+{
+    auto& individuals = pop.get_individuals();
+    for (blt::size_t i = 0; i < individuals.size(); i++)
+    {
+        // an aborted race only rendered part of the image
+        if (results[i].measured_ns > 0 && !results[i].aborted)
+            cost_model.learn(individuals[i].tree, static_cast<double>(results[i].measured_ns));
+        results[i].measured_ns = 0;
+    }
+}
@@ -0,0 +1,578 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <farm.h>
+#include <gp_system.h>
+#include <fitness.h>
+#include <snapshot.h>
+#include <tree_io.h>
+#include <image_operations.h>
+#include <blt/std/logging.h>
+#include <blt/std/time.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// bumped whenever a message changes, workers from another build are turned away
+static constexpr blt::u32 FARM_VERSION = 3;
+// trees sent to a worker before it has answered any of them. enough to hide the round trip, small enough that a worker which dies
+// doesn't take much of the generation with it
+static constexpr blt::size_t WORKER_WINDOW = 4;
+static constexpr blt::u32 MAX_MESSAGE_SIZE = 64 * 1024 * 1024;
+// a worker which holds on to its trees for longer than this many times the prediction for the one it is on, and longer than the minimum,
+// is cut off and its trees go to the others
+static constexpr double WORKER_TIMEOUT_FACTOR = 10;
+static constexpr double MIN_WORKER_TIMEOUT_NS = 30e9;
+
+enum class farm_message_t : blt::u32
+{
+    // worker -> farm: version, operator count, pid
+    HELLO,
+    // farm -> worker: target path
+    SETUP,
+    // farm -> worker: batch, index, thumbnail flag, encoded tree
+    EVALUATE,
+    // worker -> farm: batch, index, fitness components, render nanoseconds, thumbnails flag, pixels
+    RESULT
+};
+
+struct farm_worker_t
+{
+    struct in_flight_t
+    {
+        blt::size_t index;
+        blt::size_t operations;
+        double predicted_ns;
+    };
+    
+    explicit farm_worker_t(int fd, blt::u32 pid): fd(fd), pid(pid)
+    {}
+    
+    ~farm_worker_t()
+    {
+        close(fd);
+    }
+    
+    int fd;
+    blt::u32 pid;
+    bool measured = false;
+    // smoothed render time per operator, which is what the next tree's cost is predicted from
+    double ns_per_op = 0;
+    double outstanding_ns = 0;
+    // when the worker last answered, or was given work while idle
+    blt::u64 last_progress_ns = 0;
+    std::vector<in_flight_t> in_flight;
+};
+
+static bool write_all(int fd, const void* data, blt::size_t size)
+{
+    const auto* bytes = static_cast<const blt::u8*>(data);
+    while (size > 0)
+    {
+        auto written = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        bytes += written;
+        size -= static_cast<blt::size_t>(written);
+    }
+    return true;
+}
+
+static bool read_all(int fd, void* data, blt::size_t size)
+{
+    auto* bytes = static_cast<blt::u8*>(data);
+    while (size > 0)
+    {
+        auto received = recv(fd, bytes, size, 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return false;
+        bytes += received;
+        size -= static_cast<blt::size_t>(received);
+    }
+    return true;
+}
+
+static bool send_message(int fd, farm_message_t type, const std::vector<blt::u8>& payload)
+{
+    const blt::u32 header[2] = {static_cast<blt::u32>(type), static_cast<blt::u32>(payload.size())};
+    return write_all(fd, header, sizeof(header)) && write_all(fd, payload.data(), payload.size());
+}
+
+static bool receive_message(int fd, farm_message_t& type, std::vector<blt::u8>& payload)
+{
+    blt::u32 header[2];
+    if (!read_all(fd, header, sizeof(header)) || header[1] > MAX_MESSAGE_SIZE)
+        return false;
+    type = static_cast<farm_message_t>(header[0]);
+    payload.resize(header[1]);
+    return read_all(fd, payload.data(), payload.size());
+}
+
+template<typename T>
+static void append_value(std::vector<blt::u8>& out, const T& value)
+{
+    const auto* bytes = reinterpret_cast<const blt::u8*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+// reads fields back out of a payload in the order they were appended
+class payload_reader_t
+{
+    public:
+        explicit payload_reader_t(const std::vector<blt::u8>& payload): at(payload.data()), end(payload.data() + payload.size())
+        {}
+        
+        template<typename T>
+        bool take(T& value)
+        {
+            if (remaining() < sizeof(T))
+                return false;
+            std::memcpy(&value, at, sizeof(T));
+            at += sizeof(T);
+            return true;
+        }
+        
+        const blt::u8* rest()
+        {
+            return at;
+        }
+        
+        [[nodiscard]] blt::size_t remaining() const
+        {
+            return static_cast<blt::size_t>(end - at);
+        }
+    
+    private:
+        const blt::u8* at;
+        const blt::u8* end;
+};
+
+static sockaddr_un socket_address(const std::string& path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    return address;
+}
+
+bool eval_farm_t::start(const std::string& path, const std::string& target, bool send_thumbnails)
+{
+    stop();
+    auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    auto address = socket_address(path);
+    unlink(path.c_str());
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, 64) != 0)
+    {
+        BLT_WARN("Unable to listen for evaluation workers on %s", path.c_str());
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    
+    listen_fd = fd;
+    socket_path = path;
+    target_path = target;
+    thumbnails = send_thumbnails;
+    acceptor = std::thread(&eval_farm_t::accept_workers, this);
+    BLT_INFO("Evaluation farm listening on %s, start workers with: image-gp-6-worker %s", path.c_str(), path.c_str());
+    return true;
+}
+
+void eval_farm_t::stop()
+{
+    if (listen_fd < 0)
+        return;
+    stopping = true;
+    ::shutdown(listen_fd, SHUT_RDWR);
+    acceptor.join();
+    close(listen_fd);
+    listen_fd = -1;
+    unlink(socket_path.c_str());
+    
+    // every reader notices its socket closing and removes its worker. the workers themselves just go back to waiting for a farm
+    std::unique_lock lock(mutex);
+    for (auto& worker : workers)
+        ::shutdown(worker->fd, SHUT_RDWR);
+    changed.wait(lock, [this]() { return workers.empty(); });
+    stopping = false;
+}
+
+blt::size_t eval_farm_t::worker_count() const
+{
+    std::scoped_lock lock(mutex);
+    return workers.size();
+}
+
+farm_stats_t eval_farm_t::get_stats() const
+{
+    std::scoped_lock lock(mutex);
+    auto copy = stats;
+    copy.workers = workers.size();
+    return copy;
+}
+
+void eval_farm_t::accept_workers()
+{
+    while (!stopping)
+    {
+        auto fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0)
+        {
+            if (stopping)
+                break;
+            if (errno != EINTR)
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+        
+        // a connection which never says hello mustn't hold up the next worker
+        timeval timeout{5, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        
+        farm_message_t type;
+        std::vector<blt::u8> payload;
+        blt::u32 version = 0, pid = 0;
+        blt::u64 operator_count = 0;
+        if (!receive_message(fd, type, payload) || type != farm_message_t::HELLO)
+        {
+            close(fd);
+            continue;
+        }
+        payload_reader_t hello{payload};
+        if (!hello.take(version) || !hello.take(operator_count) || !hello.take(pid) || version != FARM_VERSION ||
+            operator_count != operator_kinds.size())
+        {
+            BLT_WARN("Turned away a worker built with a different protocol or operator set");
+            close(fd);
+            continue;
+        }
+        
+        std::vector<blt::u8> setup;
+        setup.insert(setup.end(), target_path.begin(), target_path.end());
+        if (!send_message(fd, farm_message_t::SETUP, setup))
+        {
+            close(fd);
+            continue;
+        }
+        timeout = {0, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        
+        auto worker = std::make_shared<farm_worker_t>(fd, pid);
+        blt::size_t count;
+        {
+            std::scoped_lock lock(mutex);
+            workers.push_back(worker);
+            count = workers.size();
+        }
+        changed.notify_all();
+        std::thread(&eval_farm_t::read_results, this, worker).detach();
+        BLT_INFO("Worker %u connected, %ld workers", pid, count);
+    }
+}
+
+void eval_farm_t::read_results(std::shared_ptr<farm_worker_t> worker)
+{
+    farm_message_t type;
+    std::vector<blt::u8> payload;
+    while (receive_message(worker->fd, type, payload) && type == farm_message_t::RESULT)
+    {
+        payload_reader_t reader{payload};
+        blt::u64 result_batch, render_ns;
+        blt::u32 index;
+        fitness_components_t components;
+        blt::u8 has_thumbnail;
+        if (!reader.take(result_batch) || !reader.take(index) || !reader.take(components.difference) || !reader.take(components.fractal) ||
+            !reader.take(components.histogram) || !reader.take(render_ns) || !reader.take(has_thumbnail))
+            break;
+        if (has_thumbnail && reader.remaining() != SNAPSHOT_IMAGE_BYTES)
+            break;
+        
+        std::scoped_lock lock(mutex);
+        auto entry = std::find_if(worker->in_flight.begin(), worker->in_flight.end(), [index](const auto& e) { return e.index == index; });
+        if (entry != worker->in_flight.end())
+        {
+            const auto measured = static_cast<double>(render_ns) / static_cast<double>(std::max(entry->operations, 1ul));
+            worker->ns_per_op = worker->measured ? worker->ns_per_op * 0.8 + measured * 0.2 : measured;
+            worker->measured = true;
+            worker->outstanding_ns = std::max(worker->outstanding_ns - entry->predicted_ns, 0.0);
+            worker->in_flight.erase(entry);
+            worker->last_progress_ns = blt::system::getCurrentTimeNanoseconds();
+        }
+        // results from a batch which has already given up on this worker are of no use
+        if (result_batch == batch && batch_results != nullptr && index < finished.size() && !finished[index])
+        {
+            auto& result = batch_results[index];
+            result.components = components;
+            result.level = LEVEL_COUNT - 1;
+            result.prepared = true;
+            if (has_thumbnail && batch_images->retained(index))
+            {
+                const auto* pixels = reader.rest();
+                auto& image = (*batch_images)[index];
+                for (blt::size_t i = 0; i < SNAPSHOT_IMAGE_BYTES; i++)
+                    image.rgb_data[i] = static_cast<float>(pixels[i]) / 255.0f;
+            }
+            finished[index] = true;
+            remaining--;
+        }
+        changed.notify_all();
+    }
+    
+    std::scoped_lock lock(mutex);
+    drop_worker(*worker);
+    changed.notify_all();
+}
+
+void eval_farm_t::drop_worker(farm_worker_t& worker)
+{
+    // whatever the worker was holding goes back to the front of the queue, those are the largest trees still left
+    for (const auto& entry : worker.in_flight)
+    {
+        if (batch_results != nullptr && entry.index < finished.size() && !finished[entry.index])
+        {
+            pending.push_front(entry.index);
+            stats.resent++;
+        }
+    }
+    worker.in_flight.clear();
+    ::shutdown(worker.fd, SHUT_RDWR);
+    workers.erase(std::remove_if(workers.begin(), workers.end(), [&worker](const auto& w) { return w.get() == &worker; }), workers.end());
+    BLT_INFO("Worker %u disconnected, %ld workers left", worker.pid, workers.size());
+}
+
+void eval_farm_t::evaluate(blt::gp::population_t& pop, image_store_t& images, evaluation_result_t* results)
+{
+    auto& individuals = pop.get_individuals();
+    const auto start = blt::system::getCurrentTimeNanoseconds();
+    
+    std::unique_lock lock(mutex);
+    stats.remote = 0;
+    stats.local = individuals.size();
+    if (workers.empty())
+        return;
+    
+    batch++;
+    batch_images = &images;
+    batch_results = results;
+    finished.assign(individuals.size(), false);
+    remaining = individuals.size();
+    
+    // largest trees first, so the expensive ones aren't left to finish on a single worker at the end
+    std::vector<blt::size_t> order(individuals.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&individuals](auto a, auto b) {
+        return individuals[a].tree.get_operations().size() > individuals[b].tree.get_operations().size();
+    });
+    pending.assign(order.begin(), order.end());
+    
+    // workers which haven't rendered anything yet are predicted to be as fast as the average measured one
+    double known_ns_per_op = 0;
+    blt::size_t known = 0;
+    for (const auto& worker : workers)
+    {
+        if (worker->measured)
+        {
+            known_ns_per_op += worker->ns_per_op;
+            known++;
+        }
+    }
+    known_ns_per_op = known > 0 ? known_ns_per_op / static_cast<double>(known) : 1.0;
+    
+    std::vector<blt::u8> payload;
+    while (remaining > 0 && !workers.empty())
+    {
+        while (!pending.empty())
+        {
+            const auto index = pending.front();
+            const auto operations = individuals[index].tree.get_operations().size();
+            
+            std::shared_ptr<farm_worker_t> target;
+            double best_finish = std::numeric_limits<double>::infinity();
+            for (const auto& worker : workers)
+            {
+                if (worker->in_flight.size() >= WORKER_WINDOW)
+                    continue;
+                const auto speed = worker->measured ? worker->ns_per_op : known_ns_per_op;
+                const auto finish = worker->outstanding_ns + static_cast<double>(operations) * speed;
+                if (finish < best_finish)
+                {
+                    best_finish = finish;
+                    target = worker;
+                }
+            }
+            if (target == nullptr)
+                break;
+            
+            pending.pop_front();
+            const auto predicted = best_finish - target->outstanding_ns;
+            if (target->in_flight.empty())
+                target->last_progress_ns = blt::system::getCurrentTimeNanoseconds();
+            target->in_flight.push_back({index, operations, predicted});
+            target->outstanding_ns += predicted;
+            const auto current_batch = batch;
+            const bool send_thumbnail = thumbnails && images.retained(index);
+            
+            // sending can block on a full socket, and the reader needs the lock to drain the other direction
+            lock.unlock();
+            payload.clear();
+            append_value(payload, current_batch);
+            append_value(payload, static_cast<blt::u32>(index));
+            // only individuals the ui is showing need their image back
+            append_value(payload, static_cast<blt::u8>(send_thumbnail));
+            encode_tree(export_tree(individuals[index].tree), payload);
+            const bool sent = send_message(target->fd, farm_message_t::EVALUATE, payload);
+            lock.lock();
+            // the reader sees the broken connection as well and puts the tree back in the queue
+            if (!sent)
+                ::shutdown(target->fd, SHUT_RDWR);
+        }
+        changed.wait_for(lock, std::chrono::milliseconds(100));
+        
+        // a worker which is still connected but has stopped answering would hold the generation forever. cutting it off puts its trees
+        // back in the queue the same way a disconnect does
+        const auto now = blt::system::getCurrentTimeNanoseconds();
+        for (const auto& worker : workers)
+        {
+            if (worker->in_flight.empty())
+                continue;
+            const auto allowed = std::max(MIN_WORKER_TIMEOUT_NS, worker->in_flight.front().predicted_ns * WORKER_TIMEOUT_FACTOR);
+            const auto waited = static_cast<double>(now - worker->last_progress_ns);
+            if (waited > allowed)
+            {
+                BLT_WARN("Worker %u hasn't answered in %lfs, sending its trees to the others", worker->pid, waited / 1e9);
+                stats.timeouts++;
+                worker->last_progress_ns = now;
+                ::shutdown(worker->fd, SHUT_RDWR);
+            }
+        }
+    }
+    
+    // anything the workers didn't get to is rendered locally by the fitness pass
+    stats.remote = individuals.size() - remaining;
+    stats.local = remaining;
+    stats.batch_ms = static_cast<double>(blt::system::getCurrentTimeNanoseconds() - start) / 1e6;
+    batch_images = nullptr;
+    batch_results = nullptr;
+    pending.clear();
+    for (auto& worker : workers)
+    {
+        worker->in_flight.clear();
+        worker->outstanding_ns = 0;
+    }
+}
+
+eval_farm_t::~eval_farm_t()
+{
+    stop();
+}
+
+int run_farm_worker(const std::string& path)
+{
+    std::string prepared_target;
+    bool waiting_logged = false;
+    auto image = std::make_unique<full_image_t>();
+    while (true)
+    {
+        auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        auto address = socket_address(path);
+        if (fd < 0)
+            return 1;
+        if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            close(fd);
+            if (!waiting_logged)
+                BLT_INFO("Waiting for an evaluation farm on %s", path.c_str());
+            waiting_logged = true;
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            continue;
+        }
+        waiting_logged = false;
+        
+        std::vector<blt::u8> payload;
+        append_value(payload, FARM_VERSION);
+        append_value(payload, static_cast<blt::u64>(operator_kinds.size()));
+        append_value(payload, static_cast<blt::u32>(getpid()));
+        farm_message_t type;
+        if (!send_message(fd, farm_message_t::HELLO, payload) || !receive_message(fd, type, payload) || type != farm_message_t::SETUP ||
+            payload.empty())
+        {
+            close(fd);
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            continue;
+        }
+        std::string target{payload.begin(), payload.end()};
+        if (target != prepared_target)
+        {
+            if (!setup_target(target))
+            {
+                close(fd);
+                return 1;
+            }
+            prepared_target = target;
+        }
+        BLT_INFO("Connected to the farm, evaluating against %s", target.c_str());
+        
+        tree_data_t data;
+        std::vector<blt::u8> result;
+        while (receive_message(fd, type, payload) && type == farm_message_t::EVALUATE)
+        {
+            payload_reader_t reader{payload};
+            blt::u64 batch;
+            blt::u32 index;
+            blt::u8 thumbnail;
+            if (!reader.take(batch) || !reader.take(index) || !reader.take(thumbnail) || !decode_tree(reader.rest(), reader.remaining(), data))
+            {
+                BLT_WARN("Received a tree this worker can't run, reconnecting");
+                break;
+            }
+            auto tree = import_tree(data, program);
+            
+            const auto render_start = blt::system::getCurrentTimeNanoseconds();
+            *image = tree.get_evaluation_value<full_image_t>(nullptr);
+            const auto render_ns = blt::system::getCurrentTimeNanoseconds() - render_start;
+            const auto components = score_image(*image, full_target());
+            
+            result.clear();
+            append_value(result, batch);
+            append_value(result, index);
+            append_value(result, components.difference);
+            append_value(result, components.fractal);
+            append_value(result, components.histogram);
+            append_value(result, static_cast<blt::u64>(render_ns));
+            append_value(result, thumbnail);
+            if (thumbnail)
+            {
+                for (blt::size_t i = 0; i < SNAPSHOT_IMAGE_BYTES; i++)
+                    result.push_back(quantize_channel(image->rgb_data[i]));
+            }
+            if (!send_message(fd, farm_message_t::RESULT, result))
+                break;
+        }
+        close(fd);
+        BLT_INFO("Lost the evaluation farm, reconnecting");
+    }
+}
@@ -0,0 +1,192 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <fitness.h>
+#include <helper.h>
+#include <blt/std/logging.h>
+#include "slr.h"
+
+const static int h_bins = 50, s_bins = 60;
+const static int histSize[] = {h_bins, s_bins};
+// hue varies from 0 to 179, saturation from 0 to 255
+const static float h_ranges[] = {0, 180};
+const static float s_ranges[] = {0, 256};
+const static float* ranges[] = {h_ranges, s_ranges};
+// Use the 0-th and 1-st channels
+const static int channels[] = {0, 1};
+
+template<blt::size_t SIZE>
+bool in_box(const full_image_t& image, blt::size_t channel, blt::size_t box_size, blt::size_t i, blt::size_t j)
+{
+    // TODO: this could be made better by starting from the smallest boxes, moving upwards and using the last set of boxes
+    //  instead of pixels, since they contain already computed information about if a box is in foam
+    for (blt::size_t x = i; x < i + box_size; x++)
+    {
+        for (blt::size_t y = j; y < j + box_size; y++)
+        {
+            if (image.rgb_data[get_index(x, y, SIZE) * CHANNELS + channel] > THRESHOLD)
+                return true;
+        }
+    }
+    return false;
+}
+
+template<blt::size_t SIZE>
+fractal_stats get_fractal_value(const full_image_t& image)
+{
+    constexpr auto box_count = static_cast<blt::size_t>(log2(SIZE / 2));
+    
+    fractal_stats stats{};
+    std::array<double, box_count> x_data{};
+    std::array<double, box_count> boxes_r{};
+    std::array<double, box_count> boxes_g{};
+    std::array<double, box_count> boxes_b{};
+    std::array<double, box_count> boxes_total{};
+    std::array<double, box_count> boxes_combined{};
+    for (blt::size_t box_size = SIZE / 2; box_size > 1; box_size /= 2)
+    {
+        blt::ptrdiff_t num_boxes_r = 0;
+        blt::ptrdiff_t num_boxes_g = 0;
+        blt::ptrdiff_t num_boxes_b = 0;
+        blt::ptrdiff_t num_boxes_total = 0;
+        blt::ptrdiff_t num_boxes_combined = 0;
+        for (blt::size_t i = 0; i < SIZE; i += box_size)
+        {
+            for (blt::size_t j = 0; j < SIZE; j += box_size)
+            {
+                auto r = in_box<SIZE>(image, 0, box_size, i, j);
+                auto g = in_box<SIZE>(image, 1, box_size, i, j);
+                auto b = in_box<SIZE>(image, 2, box_size, i, j);
+                
+                if (r)
+                    num_boxes_r++;
+                if (g)
+                    num_boxes_g++;
+                if (b)
+                    num_boxes_b++;
+                if (r && g && b)
+                    num_boxes_combined++;
+                if (r || g || b)
+                    num_boxes_total++;
+            }
+        }
+        auto x = static_cast<blt::f64>(std::log2(box_size));
+        
+        x_data[static_cast<blt::size_t>(std::log2(box_size)) - 1] = x;
+        boxes_r[static_cast<blt::size_t>(std::log2(box_size)) - 1] = static_cast<blt::f64>(num_boxes_r == 0 ? 0 : std::log2(num_boxes_r));
+        boxes_g[static_cast<blt::size_t>(std::log2(box_size)) - 1] = static_cast<blt::f64>(num_boxes_g == 0 ? 0 : std::log2(num_boxes_g));
+        boxes_b[static_cast<blt::size_t>(std::log2(box_size)) - 1] = static_cast<blt::f64>(num_boxes_b == 0 ? 0 : std::log2(num_boxes_b));
+        boxes_total[static_cast<blt::size_t>(std::log2(box_size)) - 1] = static_cast<blt::f64>(num_boxes_combined == 0 ? 0 : std::log2(
+                num_boxes_combined));
+        boxes_combined[static_cast<blt::size_t>(std::log2(box_size)) - 1] = static_cast<blt::f64>(num_boxes_total == 0 ? 0 : std::log2(
+                num_boxes_total));
+    }
+    
+    slr count_r{x_data, boxes_r};
+    slr count_g{x_data, boxes_g};
+    slr count_b{x_data, boxes_b};
+    slr count_total{x_data, boxes_total};
+    slr count_combined{x_data, boxes_combined};
+    
+#define FUNC(f) (-f)
+    stats.r = FUNC(count_r.beta);
+    stats.g = FUNC(count_g.beta);
+    stats.b = FUNC(count_b.beta);
+    stats.total = FUNC(count_total.beta);
+    stats.combined = FUNC(count_combined.beta);
+#undef FUNC
+
+    return stats;
+}
+
+template<blt::size_t level = 0>
+fractal_stats get_fractal_value_for_level(const full_image_t& image, blt::size_t size)
+{
+    if constexpr (level < LEVEL_COUNT)
+    {
+        if (size == RESOLUTION_LEVELS[level])
+            return get_fractal_value<RESOLUTION_LEVELS[level]>(image);
+        return get_fractal_value_for_level<level + 1>(image, size);
+    } else
+    {
+        BLT_ABORT("Fractal value requested for a size which isn't a resolution level!");
+        return {};
+    }
+}
+
+fractal_stats get_fractal_value(const full_image_t& image, blt::size_t size)
+{
+    return get_fractal_value_for_level(image, size);
+}
+
+void prepare_target(target_level_t& level, const stb_image_t& image, blt::size_t size)
+{
+    level.size = size;
+    level.image.load(image, level.size);
+    // a warm start leaves these wrapped around the read only cache mapping, opencv would write into it when the sizes match
+    level.hsv.release();
+    level.hist.release();
+    
+    cv::Mat base{static_cast<int>(level.size), static_cast<int>(level.size), CV_32FC3, level.image.rgb_data};
+    cv::cvtColor(base, level.hsv, cv::COLOR_RGB2HSV);
+    
+    cv::calcHist(&level.hsv, 1, channels, cv::Mat(), level.hist, 2, histSize, ranges, true, false);
+    cv::normalize(level.hist, level.hist, 0, 1, cv::NORM_MINMAX, -1, cv::Mat());
+    
+    level.fractal = get_fractal_value(level.image, level.size);
+}
+
+void setup_targets(const stb_image_t& image)
+{
+    for (const auto& [index, level] : blt::enumerate(target_levels))
+        prepare_target(level, image, RESOLUTION_LEVELS[index]);
+}
+
+fitness_components_t score_image(const full_image_t& image, const target_level_t& target)
+{
+    fitness_components_t components;
+    const auto values = target.size * target.size * CHANNELS;
+    
+    double total_difference = 0;
+    for (blt::size_t i = 0; i < values; i++)
+    {
+        auto diff = compare_values(image.rgb_data[i], target.image.rgb_data[i]);
+        total_difference += diff;
+        if (diff < 0.01)
+            total_difference -= total_difference * 0.02;
+    }
+    components.difference = total_difference * static_cast<double>(DATA_CHANNELS_SIZE) / static_cast<double>(values);
+    
+    auto raw = get_fractal_value(image, target.size);
+    if (std::isnan(raw.total) || std::isnan(raw.combined))
+        components.fractal = NAN_FRACTAL;
+    else
+        components.fractal = raw.total + raw.combined + 1.0;
+    
+    cv::Mat src{static_cast<int>(target.size), static_cast<int>(target.size), CV_32FC3, const_cast<float*>(image.rgb_data)};
+    cv::Mat src_hsv;
+    cv::Mat src_hist;
+    
+    cv::cvtColor(src, src_hsv, cv::COLOR_RGB2HSV);
+    calcHist(&src_hsv, 1, channels, cv::Mat(), src_hist, 2, histSize, ranges, true, false);
+    normalize(src_hist, src_hist, 0, 1, cv::NORM_MINMAX, -1, cv::Mat());
+
+//    components.histogram = compareHist(target.hist, src_hist, cv::HISTCMP_BHATTACHARYYA);
+    components.histogram = compareHist(target.hist, src_hist, cv::HISTCMP_CORREL);
+    
+    return components;
+}
@@ -0,0 +1,459 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <gp_system.h>
+#include <blt/std/logging.h>
+#include <blt/std/assert.h>
+#include <blt/std/time.h>
+#include <float_operations.h>
+#include <image_operations.h>
+#include <image_writer.h>
+#include <target_cache.h>
+#include <animation.h>
+#include <snapshot.h>
+#include <scheduler.h>
+#include <tree_io.h>
+#include <farm.h>
+#include <checkpoint.h>
+#include <parallel.h>
+#include <steady_state.h>
+#include <cost_scheduler.h>
+#include <thread_budget.h>
+#include <affinity.h>
+#include <operator_profiler.h>
+#include <evaluation_cost.h>
+#include <deadline.h>
+#include <tracer.h>
+#include <algorithm>
+#include <limits>
+
+constexpr auto create_fitness_function()
+{
+    return [](blt::gp::tree_t& current_tree, blt::gp::fitness_t& fitness, blt::size_t index) {
+        // blt-gp's threads live for the whole run, so each keeps the same slot. the thread is only pinned while it renders, the gp thread
+        // may be one of them
+        worker_placement_t placement{persistent_worker_slot()};
+        auto& v = generation_images[index];
+        auto& result = evaluation_results[index];
+        if (evaluate)
+        {
+            trace_span_t span{"evaluate"};
+            const auto render_start = blt::system::getCurrentTimeNanoseconds();
+            deadline_guard deadline;
+            bool rendered = true;
+            if (animation_settings.enabled)
+            {
+                result.prepared = false;
+                result.components = evaluate_animation(current_tree, v);
+                result.level = LEVEL_COUNT - 1;
+            }
+            // progressive evaluation has already rendered and scored this individual
+            else if (result.prepared)
+            {
+                result.prepared = false;
+                rendered = false;
+            }
+            else if (evaluation_settings.racing && racing_threshold_valid)
+            {
+                race_tree(current_tree, v, result, racing_threshold);
+                result.level = LEVEL_COUNT - 1;
+            } else if (evaluation_settings.tiled)
+            {
+                render_tree_tiled(current_tree, v);
+                result.components = score_image(v, full_target());
+                result.level = LEVEL_COUNT - 1;
+            } else
+            {
+                v = current_tree.get_evaluation_value<full_image_t>(nullptr);
+                result.components = score_image(v, full_target());
+                result.level = LEVEL_COUNT - 1;
+            }
+            if (rendered)
+                deadline.finish(result.components);
+            // the cost scheduler learns from its own renders, progressive levels and the farm's don't time one whole render
+            result.measured_ns = rendered ? blt::system::getCurrentTimeNanoseconds() - render_start : 0;
+        }
+        
+        if (fitness_values[index] < 0)
+        {
+            fitness.raw_fitness = result.components.combine() + cost_penalty(result) + screening_penalty(result);
+            /*BLT_TRACE(
+                    "Normal Variants: {Difference: %lf | Fractal: %lf | Histogram: %lf } Weighted Variants: { Difference: %lf | Fractal: %lf | Histogram: %lf } Total Fitness: %lf",
+                    result.components.difference, result.components.fractal, result.components.histogram,
+                    (result.components.difference * difference_weight), (result.components.fractal * fractal_weight),
+                    (result.components.histogram * histogram_weight), fitness.raw_fitness);*/
+            
+            fitness.raw_fitness += last_fitness;
+        } else
+            fitness.raw_fitness = fitness_values[index];
+        fitness.standardized_fitness = fitness.raw_fitness;
+        fitness.adjusted_fitness = (1.0 / (1.0 + fitness.standardized_fitness));
+    };
+}
+
+blt::size_t best_individual()
+{
+    auto& individuals = program.get_current_pop().get_individuals();
+    blt::size_t best = 0;
+    for (blt::size_t i = 0; i < individuals.size(); i++)
+    {
+        if (individuals[i].fitness.adjusted_fitness > individuals[best].fitness.adjusted_fitness)
+            best = i;
+    }
+    return best;
+}
+
+// the ui's page, plus everyone while the whole population is being timelapsed
+static void retain_images()
+{
+    std::vector<blt::size_t> indices;
+    const auto first = timelapse_population ? 0 : std::min(visible_page * PAGE_SIZE, population_size);
+    const auto last = timelapse_population ? population_size : std::min(first + PAGE_SIZE, population_size);
+    for (blt::size_t i = first; i < last; i++)
+        indices.push_back(i);
+    generation_images.retain(population_size, indices);
+}
+
+static void render_individual(blt::gp::tree_t& tree, full_image_t& image)
+{
+    if (animation_settings.enabled)
+        evaluate_animation(tree, image);
+    else
+        image = tree.get_evaluation_value<full_image_t>(nullptr);
+}
+
+const full_image_t& individual_image(blt::size_t index)
+{
+    if (generation_images.retained(index))
+        return generation_images[index];
+    auto& image = image_store_t::scratch();
+    render_individual(program.get_current_pop().get_individuals()[index].tree, image);
+    return image;
+}
+
+void show_page(blt::size_t page)
+{
+    const auto pages = (population_size + PAGE_SIZE - 1) / PAGE_SIZE;
+    visible_page = std::min(page, pages - 1);
+    retain_images();
+    if (population_generated)
+    {
+        auto& individuals = program.get_current_pop().get_individuals();
+        const auto first = visible_page * PAGE_SIZE;
+        parallel_for(std::min(PAGE_SIZE, individuals.size() - first), [&](blt::size_t i) {
+            render_individual(individuals[first + i].tree, generation_images[first + i]);
+        });
+        publish_snapshot();
+    }
+}
+
+void write_timelapse_frame()
+{
+    auto& individuals = program.get_current_pop().get_individuals();
+    const auto generation = current_generation();
+    
+    image_writer.submit(timelapse_path(timelapse_directory, "best", generation), individual_image(best_individual()));
+    
+    if (timelapse_population)
+    {
+        for (blt::size_t i = 0; i < individuals.size(); i++)
+            image_writer.submit(timelapse_path(timelapse_directory + "/" + std::to_string(i), "individual", generation), individual_image(i));
+    }
+}
+
+void execute_generation()
+{
+    BLT_TRACE("------------{Begin Generation %ld}------------", current_generation());
+    thread_budget.begin_generation();
+    deadline_stats.reset();
+    if (steady_state_settings.enabled)
+    {
+        BLT_START_INTERVAL("Image Test", "Steady State");
+        trace_span_t span{"steady state epoch"};
+        animation_stats.reset();
+        retain_images();
+        run_steady_state_epoch();
+        // offspring were scored as they were inserted, this only recombines them with the fitness assigned by clicking
+        evaluate = false;
+        program.evaluate_fitness();
+        evaluate = true;
+        // blt-gp's generation counter only moves in next_generation, which steady state never calls
+        generation_offset++;
+        BLT_END_INTERVAL("Image Test", "Steady State");
+        BLT_DEBUG("Steady state: %ld offspring, %ld rejected, %lf%% utilization", steady_state_stats.offspring.load(),
+                  steady_state_stats.rejected.load(), steady_state_stats.utilization() * 100);
+    } else
+    {
+        BLT_TRACE("Evaluate Fitness");
+        BLT_START_INTERVAL("Image Test", "Fitness");
+        evaluate = false;
+        program.evaluate_fitness();
+        // finding the threshold renders an individual, so it is skipped when nothing races
+        racing_threshold_valid = evaluation_settings.racing;
+        if (racing_threshold_valid)
+            racing_threshold = get_racing_threshold(program.get_current_pop());
+        racing_stats.reset();
+        BLT_END_INTERVAL("Image Test", "Fitness");
+        BLT_START_INTERVAL("Image Test", "Gen");
+        {
+            // blt-gp selects the parents and breeds them in one go
+            trace_span_t span{"select and breed"};
+            program.create_next_generation();
+        }
+        BLT_END_INTERVAL("Image Test", "Gen");
+        BLT_TRACE("Move to next generation");
+        program.next_generation();
+        enforce_cost_budget(program.get_current_pop(), evaluation_results.data());
+        BLT_TRACE("Evaluate Image");
+        BLT_START_INTERVAL("Image Test", "Image Eval");
+        {
+            trace_span_t span{"evaluate generation"};
+            animation_stats.reset();
+            retain_images();
+            // workers, progressive levels and the cost scheduler only know about the still target
+            if (eval_farm.worker_count() > 0 && !animation_settings.enabled)
+                eval_farm.evaluate(program.get_current_pop(), generation_images, evaluation_results.data());
+            else if (evaluation_settings.progressive && !animation_settings.enabled)
+                progressive_evaluate(program.get_current_pop(), generation_images, evaluation_results.data());
+            else if ((evaluation_settings.cost_scheduling || thread_budget.render_outside_program()) && !animation_settings.enabled)
+                scheduled_evaluate(program.get_current_pop(), generation_images, evaluation_results.data(),
+                                   evaluation_settings.racing && racing_threshold_valid ? racing_threshold
+                                                                                        : std::numeric_limits<double>::infinity());
+            evaluate = true;
+            program.evaluate_fitness();
+        }
+        BLT_END_INTERVAL("Image Test", "Image Eval");
+        racing_stats.finish_generation();
+        if (evaluation_settings.racing)
+            BLT_DEBUG("Racing: %ld / %ld aborted, %lf%% of tiles skipped", racing_stats.aborted.load(), racing_stats.raced.load(),
+                      racing_stats.skipped_fraction() * 100);
+    }
+    learn_costs(program.get_current_pop(), evaluation_results.data());
+    deadline_stats.finish_generation();
+    if (deadline_settings.deadline_ms > 0)
+        BLT_DEBUG("Deadline: %ld individuals ran past %fms (%ld in total)", deadline_stats.timeouts.load(), deadline_settings.deadline_ms,
+                  deadline_stats.total_timeouts);
+    thread_budget.end_generation();
+    operator_profiler.finish_generation(current_generation());
+    if (timelapse)
+        write_timelapse_frame();
+    publish_snapshot();
+    BLT_TRACE("----------------------------------------------");
+    std::cout << std::endl;
+    // reset all fitness values.
+    for (auto& v : fitness_values)
+        v = -1;
+    last_fitness = 0;
+    if (checkpoint_every != 0 && current_generation() % checkpoint_every == 0)
+        save_checkpoint(checkpoint_path);
+}
+
+blt::size_t current_generation()
+{
+    return program.get_current_generation() + generation_offset;
+}
+
+void print_stats()
+{
+    auto& stats = program.get_population_stats();
+    BLT_INFO("Stats:");
+    BLT_INFO("Average fitness: %lf", stats.average_fitness.load());
+    BLT_INFO("Best fitness: %lf", stats.best_fitness.load());
+    BLT_INFO("Worst fitness: %lf", stats.worst_fitness.load());
+    BLT_INFO("Overall fitness: %lf", stats.overall_fitness.load());
+}
+
+template<typename... Operators>
+void build_operators(blt::gp::operator_builder<context>& builder, Operators&... operators)
+{
+    operator_set = builder.build(operators...);
+    program.set_operations(operator_set);
+    // operator ids are handed out in the order they are passed to the builder
+    operator_kinds = {get_operator_kind(operators)...};
+    
+    const auto literal = std::find(operator_kinds.begin(), operator_kinds.end(), operator_kind_t::IMAGE_LITERAL);
+    BLT_ASSERT(literal != operator_kinds.end() && "The image literal must be registered, animations fold trees into it!");
+    image_literal_id = static_cast<blt::gp::operator_id>(literal - operator_kinds.begin());
+}
+
+void setup_operators()
+{
+    BLT_DEBUG("Setup Types and Operators");
+    type_system.register_type<full_image_t>();
+    type_system.register_type<float>();
+    type_system.register_type<blt::u64>();
+    
+    blt::gp::operator_builder<context> builder{type_system};
+#if CV_VERSION_MAJOR >= 4 && CV_VERSION_MINOR >= 10
+    build_operators(builder, perlin, perlin_terminal, perlin_warped, add, sub, mul, pro_div, op_sin, op_cos, op_atan, op_exp, op_log, op_abs,
+                    op_round, op_v_mod, bitwise_and, bitwise_or, bitwise_invert, bitwise_xor, dissolve, band_pass, hsv_to_rgb, gaussian_blur,
+                    median_blur, l_system, high_pass, bilateral_filter, lit, vec, random_val, op_x_r, op_x_g, op_x_b, op_x_rgb, op_y_r, op_y_g,
+                    op_y_b, op_y_rgb, op_time, f_literal, i_literal);
+#else
+    build_operators(builder, perlin, perlin_terminal, perlin_warped, add, sub, mul, pro_div, op_sin, op_cos, op_atan, op_exp, op_log, op_abs,
+                    op_round, op_v_mod, bitwise_and, bitwise_or, bitwise_invert, bitwise_xor, dissolve, band_pass, hsv_to_rgb, gaussian_blur,
+                    median_blur, l_system, high_pass, lit, vec, random_val, op_x_r, op_x_g, op_x_b, op_x_rgb, op_y_r, op_y_g, op_y_b, op_y_rgb,
+                    op_time, f_literal, i_literal);
+#endif
+    
+    // every executable sets up the operators, so this is where the topology pinning will use gets logged
+    cpu_topology();
+}
+
+bool setup_target(const std::string& path)
+{
+    // the levels of the last target are still in memory, a service running several jobs on one target only prepares it once
+    if (path == loaded_target)
+        return true;
+    
+    auto target_start = blt::system::getCurrentTimeNanoseconds();
+    if (load_target_cache(path))
+        BLT_INFO("Warm start, loaded target from cache in %lfms", static_cast<double>(blt::system::getCurrentTimeNanoseconds() - target_start) / 1e6);
+    else
+    {
+        full_base_image.load_scaled(path, 2, static_cast<int>(IMAGE_SIZE));
+        if (full_base_image.get_data() == nullptr)
+        {
+            BLT_WARN("Unable to load target %s", path.c_str());
+            return false;
+        }
+        setup_targets(full_base_image);
+        if (!save_target_cache(path))
+            BLT_WARN("Unable to cache the target image, the next start will be cold as well");
+        BLT_INFO("Cold start, prepared target in %lfms", static_cast<double>(blt::system::getCurrentTimeNanoseconds() - target_start) / 1e6);
+    }
+    loaded_target = path;
+    return true;
+}
+
+void generate_population()
+{
+    BLT_DEBUG("Generate Initial Population");
+    static constexpr auto fitness_func = create_fitness_function();
+    auto sel = blt::gp::select_tournament_t{};
+//    auto sel = blt::gp::select_fitness_proportionate_t{};
+    retain_images();
+    program.generate_population(type_system.get_type<full_image_t>().id(), fitness_func, sel, sel, sel);
+    population_generated = true;
+    publish_snapshot();
+}
+
+void reset_population()
+{
+    if (!population_generated)
+    {
+        generate_population();
+        return;
+    }
+    for (auto& v : fitness_values)
+        v = -1;
+    last_fitness = 0;
+    racing_threshold_valid = false;
+    generation_offset = 0;
+    for (auto& result : evaluation_results)
+        result.prepared = false;
+    retain_images();
+    program.reset_program(type_system.get_type<full_image_t>().id(), true);
+    publish_snapshot();
+}
+
+void publish_snapshot()
+{
+    auto& snapshot = population_snapshots.write_buffer();
+    auto& individuals = program.get_current_pop().get_individuals();
+    
+    snapshot.version = current_generation();
+    snapshot.population = individuals.size();
+    snapshot.first = std::min(visible_page * PAGE_SIZE, individuals.size());
+    snapshot.count = std::min(individuals.size() - snapshot.first, PAGE_SIZE);
+    for (blt::size_t i = 0; i < snapshot.count; i++)
+    {
+        const auto index = snapshot.first + i;
+        const auto& image = individual_image(index);
+        for (blt::size_t j = 0; j < SNAPSHOT_IMAGE_BYTES; j++)
+            snapshot.pixels[i][j] = quantize_channel(image.rgb_data[j]);
+        snapshot.adjusted_fitness[i] = individuals[index].fitness.adjusted_fitness;
+        snapshot.raw_fitness[i] = individuals[index].fitness.raw_fitness;
+        snapshot.user_fitness[i] = fitness_values[index];
+    }
+    auto& stats = program.get_population_stats();
+    snapshot.best_fitness = stats.best_fitness.load();
+    snapshot.average_fitness = stats.average_fitness.load();
+    snapshot.worst_fitness = stats.worst_fitness.load();
+    snapshot.overall_fitness = stats.overall_fitness.load();
+    snapshot.image_bytes = generation_images.bytes();
+    shared_view.publish(snapshot);
+    population_snapshots.publish();
+}
+
+void mark_individual(blt::size_t index)
+{
+    fitness_values[index] = last_fitness;
+    last_fitness += 1;
+    // the ui only reads marks through the snapshot, so republish instead of waiting on the next generation
+    if (population_generated)
+        publish_snapshot();
+}
+
+void save_individual(blt::size_t index)
+{
+    // the trees belong to the gp thread, so they are read between generations
+    scheduler.post([index]() {
+        auto& ind = program.get_current_pop().get_individuals()[index];
+        std::cout << "Fitness: " << ind.fitness.adjusted_fitness << " " << ind.fitness.raw_fitness << " ";
+        ind.tree.print(program, std::cout, false);
+        std::cout << std::endl;
+        
+        auto tree_path = "tree_" + std::to_string(index) + ".igpt";
+        if (save_tree(ind.tree, tree_path))
+            BLT_INFO("Saved tree to %s, render it with: image-gp-6 render %s <size> <output.png> [threads]", tree_path.c_str(),
+                     tree_path.c_str());
+    });
+}
+
+bool share_view(const std::string& name, bool allow_control)
+{
+    return shared_view.open(name, [allow_control](const view_command_t& command) {
+        switch (command.type)
+        {
+            case view_command_type_t::MARK:
+                // fitness_values is read by the gp thread while it selects, so marks land between generations
+                if (command.index < population_size)
+                    scheduler.post([index = command.index]() { mark_individual(index); });
+                break;
+            case view_command_type_t::SAVE_TREE:
+                if (command.index < population_size)
+                    save_individual(command.index);
+                break;
+            case view_command_type_t::PAGE:
+                scheduler.post([page = command.index]() { show_page(page); });
+                break;
+            case view_command_type_t::STEP:
+                if (allow_control)
+                    scheduler.step();
+                break;
+            case view_command_type_t::RUN:
+                if (allow_control)
+                    scheduler.run();
+                break;
+            case view_command_type_t::PAUSE:
+                if (allow_control)
+                    scheduler.pause();
+                break;
+        }
+    });
+}
@@ -0,0 +1,211 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <gp_system.h>
+#include <job.h>
+#include <farm.h>
+#include <islands.h>
+#include <scheduler.h>
+#include <blt/std/logging.h>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// runs generations back to back without a window, configured by a file of key = value lines. see job.h for the keys
+
+// the program has already been constructed by the time the config is read, so a different seed or thread count needs a fresh process
+static void apply_environment(const run_config_t& cfg, char** argv)
+{
+    bool changed = false;
+    const auto set = [&changed](const char* name, const std::string& value) {
+        if (value.empty())
+            return;
+        auto current = std::getenv(name);
+        if (current != nullptr && value == current)
+            return;
+        setenv(name, value.c_str(), 1);
+        changed = true;
+    };
+    set("IMAGE_GP_SEED", cfg.seed);
+    set("IMAGE_GP_THREADS", cfg.threads);
+    set("IMAGE_GP_POPULATION", cfg.population);
+    if (!changed)
+        return;
+    execv("/proc/self/exe", argv);
+    BLT_WARN("Unable to restart with the configured seed, thread count and population size, continuing with the defaults");
+}
+
+// the population size is fixed for the life of a process, so every size is measured by a fresh copy of this process running the config
+// with IMAGE_GP_POPULATION_BENCHMARK pointing at the csv it adds its row to
+static constexpr auto BENCHMARK_ENVIRONMENT = "IMAGE_GP_POPULATION_BENCHMARK";
+
+static int benchmark_population_scaling(const run_config_t& cfg, char** argv)
+{
+    std::error_code error;
+    std::filesystem::create_directories(cfg.output, error);
+    const auto csv_path = cfg.output + "/population_scaling.csv";
+    {
+        std::ofstream csv{csv_path};
+        csv << "population,generations,seconds,ms_per_generation,peak_rss_mb,retained_images_mb\n";
+    }
+    
+    for (auto size : cfg.population_scaling)
+    {
+        BLT_INFO("Measuring a population of %ld", size);
+        auto pid = fork();
+        if (pid == 0)
+        {
+            setenv("IMAGE_GP_POPULATION", std::to_string(size).c_str(), 1);
+            setenv(BENCHMARK_ENVIRONMENT, csv_path.c_str(), 1);
+            execv("/proc/self/exe", argv);
+            _exit(1);
+        }
+        int status = 0;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            BLT_WARN("Population of %ld failed", size);
+    }
+    BLT_INFO("Wrote %s", csv_path.c_str());
+    return 0;
+}
+
+// highest resident set size of this process so far, in kilobytes
+static blt::size_t peak_rss_kb()
+{
+    std::ifstream status{"/proc/self/status"};
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.rfind("VmHWM:", 0) == 0)
+            return std::stoull(line.substr(6));
+    }
+    return 0;
+}
+
+// runs the job twice from the same seed, with pinning off and then on, writing every generation's time from both runs to pinning.csv
+static job_result_t compare_pinning(const run_config_t& cfg)
+{
+    std::error_code error;
+    std::filesystem::create_directories(cfg.output, error);
+    std::ofstream csv{cfg.output + "/pinning.csv"};
+    csv << "pinned,generation,milliseconds\n";
+    
+    job_result_t result;
+    std::array<double, 2> total_ms{};
+    for (bool pinned : {false, true})
+    {
+        scheduler.post([]() { program.get_random().set_seed(SEED); });
+        scheduler.wait_idle();
+        
+        auto run = cfg;
+        run.pin_workers = pinned;
+        run.output = cfg.output + (pinned ? "/pinned" : "/unpinned");
+        result = run_job(run, [&](const job_progress_t& progress) {
+            csv << pinned << ',' << progress.generation << ',' << progress.milliseconds << '\n';
+            total_ms[pinned] += progress.milliseconds;
+            return true;
+        });
+        if (!result.success)
+            return result;
+    }
+    
+    const auto generations = static_cast<double>(std::max(result.generations, 1ul));
+    BLT_INFO("Mean generation time: %lfms unpinned, %lfms pinned (%lfx)", total_ms[0] / generations, total_ms[1] / generations,
+             total_ms[1] == 0 ? 0 : total_ms[0] / total_ms[1]);
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        BLT_WARN("Usage: %s <config>", argv[0]);
+        return 1;
+    }
+    
+    run_config_t cfg;
+    if (!load_config(argv[1], cfg))
+        return 1;
+    
+    const auto benchmark_csv = std::getenv(BENCHMARK_ENVIRONMENT);
+    if (benchmark_csv != nullptr)
+    {
+        // one measurement of the size picked by the parent process
+        cfg.population.clear();
+        cfg.population_scaling.clear();
+        cfg.output += "/population_" + std::to_string(population_size);
+        cfg.snapshot_every = 0;
+        cfg.population_snapshots = false;
+    } else if (!cfg.population_scaling.empty())
+        return benchmark_population_scaling(cfg, argv);
+    
+    apply_environment(cfg, argv);
+    
+    BLT_INFO("Starting headless run of %ld generations, seed %ld, population %ld", cfg.generations, SEED, population_size);
+    setup_operators();
+    
+    if (!cfg.scaling.empty())
+    {
+        std::error_code error;
+        std::filesystem::create_directories(cfg.output, error);
+        if (!setup_target(cfg.target))
+            return 1;
+        benchmark_island_scaling(cfg.scaling, cfg.generations, cfg.output + "/scaling.csv");
+        program.kill();
+        return 0;
+    }
+    
+    // viewers can mark and save individuals, but the config decides how many generations run
+    if (!cfg.share.empty())
+        share_view(cfg.share, false);
+    
+    std::thread gp_thread([]() {
+        scheduler.run_loop(execute_generation, []() {
+            return program.get_population_stats().best_fitness.load();
+        });
+    });
+    
+    auto result = cfg.compare_pinning ? compare_pinning(cfg) : run_job(cfg, [](const job_progress_t&) {
+        print_stats();
+        return true;
+    });
+    
+    scheduler.stop();
+    gp_thread.join();
+    eval_farm.stop();
+    shared_view.close();
+    
+    if (!result.success)
+    {
+        BLT_WARN("Headless run failed: %s", result.error.c_str());
+        program.kill();
+        return 1;
+    }
+    BLT_INFO("Finished %ld generations in %lfs", result.generations, result.seconds);
+    if (benchmark_csv != nullptr)
+    {
+        std::ofstream csv{benchmark_csv, std::ios::app};
+        csv << population_size << ',' << result.generations << ',' << result.seconds << ','
+            << result.seconds * 1000.0 / static_cast<double>(std::max(result.generations, 1ul)) << ','
+            << static_cast<double>(peak_rss_kb()) / 1024.0 << ',' << static_cast<double>(generation_images.bytes()) / 1e6 << '\n';
+    }
+    
+    program.kill();
+    return 0;
+}
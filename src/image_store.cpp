@@ -0,0 +1,78 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <image_store.h>
+
+void image_store_t::retain(blt::size_t population, const std::vector<blt::size_t>& indices)
+{
+    std::vector<blt::u32> new_slots(population, NOT_RETAINED);
+    std::vector<std::unique_ptr<full_image_t>> new_images;
+    new_images.reserve(indices.size());
+    for (auto index : indices)
+    {
+        if (index >= population || new_slots[index] != NOT_RETAINED)
+            continue;
+        // an individual which was already retained keeps its buffer and with it the image it was last rendered to
+        std::unique_ptr<full_image_t> image;
+        if (index < slot_of.size() && slot_of[index] != NOT_RETAINED)
+            image = std::move(images[slot_of[index]]);
+        new_slots[index] = static_cast<blt::u32>(new_images.size());
+        new_images.push_back(std::move(image));
+    }
+    
+    // buffers no longer needed are handed to newly retained individuals before anything new is allocated
+    std::vector<std::unique_ptr<full_image_t>> spare;
+    for (auto& image : images)
+    {
+        if (image != nullptr)
+            spare.push_back(std::move(image));
+    }
+    for (auto& image : new_images)
+    {
+        if (image != nullptr)
+            continue;
+        if (!spare.empty())
+        {
+            image = std::move(spare.back());
+            spare.pop_back();
+        } else
+            image = std::make_unique<full_image_t>();
+    }
+    
+    slot_of = std::move(new_slots);
+    images = std::move(new_images);
+}
+
+std::unique_ptr<full_image_t>& image_store_t::scratch_slot()
+{
+    thread_local std::unique_ptr<full_image_t> image;
+    return image;
+}
+
+full_image_t& image_store_t::scratch()
+{
+    // allocated on first use, a thread which never renders never pays for one
+    auto& image = scratch_slot();
+    if (image == nullptr)
+        image = std::make_unique<full_image_t>();
+    return *image;
+}
+
+void image_store_t::release_scratch()
+{
+    scratch_slot().reset();
+}
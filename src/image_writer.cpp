@@ -0,0 +1,125 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <image_writer.h>
+#include <blt/std/logging.h>
+#include <blt/std/time.h>
+#include <algorithm>
+#include <filesystem>
+#include <cstdio>
+
+static void write_png(const image_write_job_t& job)
+{
+    std::vector<unsigned char> bytes(job.data.size());
+    for (blt::size_t i = 0; i < job.data.size(); i++)
+        bytes[i] = static_cast<unsigned char>(std::clamp(job.data[i], 0.0f, 1.0f) * std::numeric_limits<unsigned char>::max());
+    
+    auto parent = std::filesystem::path(job.path).parent_path();
+    std::error_code error;
+    if (!parent.empty())
+        std::filesystem::create_directories(parent, error);
+    
+    if (!stbi_write_png(job.path.c_str(), static_cast<int>(job.width), static_cast<int>(job.height), static_cast<int>(job.channels),
+                        bytes.data(), 0))
+        BLT_WARN("Failed to write %s", job.path.c_str());
+}
+
+void image_writer_t::submit(image_write_job_t&& job)
+{
+    std::unique_lock lock(mutex);
+    if (threads.empty())
+        start();
+    if (jobs.size() >= capacity)
+    {
+        auto start_time = blt::system::getCurrentTimeNanoseconds();
+        slot_available.wait(lock, [this]() { return jobs.size() < capacity; });
+        stalled_ns += blt::system::getCurrentTimeNanoseconds() - start_time;
+    }
+    jobs.push_back(std::move(job));
+    job_available.notify_one();
+}
+
+void image_writer_t::submit(const std::string& path, const full_image_t& image)
+{
+    image_write_job_t job;
+    job.path = path;
+    job.width = IMAGE_SIZE;
+    job.height = IMAGE_SIZE;
+    job.data.assign(image.rgb_data, image.rgb_data + DATA_CHANNELS_SIZE);
+    submit(std::move(job));
+}
+
+void image_writer_t::flush()
+{
+    std::unique_lock lock(mutex);
+    idle.wait(lock, [this]() { return jobs.empty() && in_flight == 0; });
+}
+
+image_writer_t::~image_writer_t()
+{
+    {
+        std::scoped_lock lock(mutex);
+        stopping = true;
+    }
+    job_available.notify_all();
+    // workers drain the queue before they exit, so nothing submitted is lost
+    for (auto& thread : threads)
+    {
+        if (thread.joinable())
+            thread.join();
+    }
+}
+
+void image_writer_t::start()
+{
+    for (blt::size_t i = 0; i < std::max(thread_count, 1ul); i++)
+        threads.emplace_back([this]() { run(); });
+}
+
+void image_writer_t::run()
+{
+    while (true)
+    {
+        image_write_job_t job;
+        {
+            std::unique_lock lock(mutex);
+            job_available.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            in_flight++;
+        }
+        slot_available.notify_one();
+        
+        write_png(job);
+        images_written++;
+        
+        {
+            std::scoped_lock lock(mutex);
+            in_flight--;
+        }
+        idle.notify_all();
+    }
+}
+
+std::string timelapse_path(const std::string& directory, const std::string& name, blt::size_t generation)
+{
+    char frame[32];
+    std::snprintf(frame, sizeof(frame), "_%06lu.png", static_cast<unsigned long>(generation));
+    return directory + "/" + name + frame;
+}
@@ -0,0 +1,308 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <islands.h>
+#include <gp_system.h>
+#include <fitness.h>
+#include <tree_io.h>
+#include <affinity.h>
+#include <blt/std/logging.h>
+#include <blt/std/time.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <thread>
+
+struct migrant_t
+{
+    tree_data_t tree;
+    blt::gp::fitness_t fitness;
+};
+
+using migrant_batch_t = std::vector<migrant_t>;
+
+// a single slot the sender swaps a batch into and the receiver swaps out, neither side ever waits on the other. a batch the receiver hasn't
+// picked up yet is simply replaced, migrants are only worth anything while they're fresh.
+class migration_mailbox_t
+{
+    public:
+        void send(std::unique_ptr<migrant_batch_t> batch)
+        {
+            delete slot.exchange(batch.release(), std::memory_order_acq_rel);
+        }
+        
+        std::unique_ptr<migrant_batch_t> receive()
+        {
+            return std::unique_ptr<migrant_batch_t>(slot.exchange(nullptr, std::memory_order_acq_rel));
+        }
+        
+        ~migration_mailbox_t()
+        {
+            delete slot.load();
+        }
+    
+    private:
+        std::atomic<migrant_batch_t*> slot = nullptr;
+};
+
+struct island_fitness_t
+{
+    island_t* island;
+    
+    void operator()(blt::gp::tree_t& tree, blt::gp::fitness_t& fitness, blt::size_t) const;
+};
+
+struct island_t
+{
+    island_t(blt::size_t index, blt::u64 seed, const blt::gp::prog_config_t& island_config):
+            index(index), config(island_config), program{type_system, seed, config}, fitness{this}, random(seed)
+    {}
+    
+    blt::size_t index;
+    blt::gp::prog_config_t config;
+    blt::gp::gp_program program;
+    // the program keeps references to both of these
+    island_fitness_t fitness;
+    blt::gp::select_tournament_t selection{};
+    migration_mailbox_t mailbox;
+    std::vector<int> cpus;
+    std::mt19937_64 random;
+    bool generated = false;
+    std::atomic_uint64_t evaluations = 0;
+    std::atomic_uint64_t received = 0;
+};
+
+void island_fitness_t::operator()(blt::gp::tree_t& tree, blt::gp::fitness_t& fitness, blt::size_t) const
+{
+    // every program has its own threads, so a thread only ever evaluates for one island and only needs pinning once
+    thread_local const island_t* pinned = nullptr;
+    if (pinned != island && !island->cpus.empty())
+    {
+        pin_current_thread(island->cpus);
+        pinned = island;
+    }
+    
+    thread_local full_image_t image;
+    image = tree.get_evaluation_value<full_image_t>(nullptr);
+    fitness.raw_fitness = score_image(image, full_target()).combine();
+    fitness.standardized_fitness = fitness.raw_fitness;
+    fitness.adjusted_fitness = (1.0 / (1.0 + fitness.standardized_fitness));
+    island->evaluations.fetch_add(1, std::memory_order_relaxed);
+}
+
+island_model_t::island_model_t(const island_settings_t& settings, blt::u64 seed): settings(settings)
+{
+    const auto count = std::max(settings.count, 1ul);
+    const auto threads = std::max(settings.threads, 1ul);
+    // consecutive cpus share a node, so an island's threads stay on one node whenever it has enough of them
+    const auto& cpus = cpu_topology().cpus;
+    for (blt::size_t i = 0; i < count; i++)
+    {
+        auto island_config = config;
+        island_config.set_thread_count(threads);
+        auto island = std::make_unique<island_t>(i, seed + i, island_config);
+        island->program.set_operations(operator_set);
+        if (settings.pin_threads)
+        {
+            for (blt::size_t t = 0; t < threads; t++)
+                island->cpus.push_back(cpus[(i * threads + t) % cpus.size()]);
+        }
+        islands.push_back(std::move(island));
+    }
+}
+
+void island_model_t::run(blt::size_t generations, const std::function<bool(const island_progress_t&)>& progress)
+{
+    std::atomic_bool stopping = false;
+    auto drive = [&](island_t& island) {
+        if (!island.cpus.empty())
+            pin_current_thread(island.cpus);
+        if (!island.generated)
+        {
+            island.program.generate_population(type_system.get_type<full_image_t>().id(), island.fitness, island.selection, island.selection,
+                                               island.selection);
+            island.generated = true;
+        }
+        
+        for (blt::size_t generation = 1; generation <= generations && !stopping; generation++)
+        {
+            island.program.create_next_generation();
+            island.program.next_generation();
+            island.program.evaluate_fitness();
+            
+            if (settings.migration_interval != 0 && islands.size() > 1 && generation % settings.migration_interval == 0)
+                migrate(island);
+            if (island.index == 0 && progress && !progress(gather_progress(generation)))
+                stopping = true;
+        }
+    };
+    
+    // the caller's thread isn't used, it would stay pinned after the run
+    std::vector<std::thread> threads;
+    threads.reserve(islands.size());
+    for (auto& island : islands)
+        threads.emplace_back(drive, std::ref(*island));
+    for (auto& thread : threads)
+        thread.join();
+}
+
+void island_model_t::migrate(island_t& island)
+{
+    auto& individuals = island.program.get_current_pop().get_individuals();
+    std::vector<blt::size_t> order(individuals.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&individuals](auto a, auto b) {
+        return individuals[a].fitness.adjusted_fitness < individuals[b].fitness.adjusted_fitness;
+    });
+    
+    // arrivals were scored against the same target, so their fitness carries over without evaluating them again
+    if (auto arrived = island.mailbox.receive())
+    {
+        const auto count = std::min(arrived->size(), order.size());
+        for (blt::size_t i = 0; i < count; i++)
+        {
+            auto& individual = individuals[order[i]];
+            individual.tree = import_tree((*arrived)[i].tree, island.program);
+            individual.fitness = (*arrived)[i].fitness;
+        }
+        island.received.fetch_add(count, std::memory_order_relaxed);
+    }
+    
+    auto batch = std::make_unique<migrant_batch_t>();
+    const auto count = std::min(settings.migrants, order.size());
+    for (blt::size_t i = 0; i < count; i++)
+    {
+        auto& individual = individuals[order[order.size() - 1 - i]];
+        batch->push_back({export_tree(individual.tree), individual.fitness});
+    }
+    
+    blt::size_t destination;
+    if (settings.topology == migration_topology_t::RING)
+        destination = (island.index + 1) % islands.size();
+    else
+    {
+        destination = std::uniform_int_distribution<blt::size_t>{0, islands.size() - 2}(island.random);
+        if (destination >= island.index)
+            destination++;
+    }
+    islands[destination]->mailbox.send(std::move(batch));
+}
+
+island_progress_t island_model_t::gather_progress(blt::size_t generation) const
+{
+    island_progress_t progress;
+    progress.generation = generation;
+    progress.best_fitness = -std::numeric_limits<double>::infinity();
+    progress.worst_fitness = std::numeric_limits<double>::infinity();
+    for (const auto& island : islands)
+    {
+        auto& stats = island->program.get_population_stats();
+        progress.best_fitness = std::max(progress.best_fitness, stats.best_fitness.load());
+        progress.worst_fitness = std::min(progress.worst_fitness, stats.worst_fitness.load());
+        progress.average_fitness += stats.average_fitness.load();
+        progress.overall_fitness += stats.overall_fitness.load();
+    }
+    progress.average_fitness /= static_cast<double>(islands.size());
+    progress.overall_fitness /= static_cast<double>(islands.size());
+    progress.evaluations = evaluations();
+    progress.migrations = migrations();
+    return progress;
+}
+
+blt::gp::tree_t& island_model_t::best_tree()
+{
+    blt::gp::tree_t* best = nullptr;
+    double best_fitness = -std::numeric_limits<double>::infinity();
+    for (auto& island : islands)
+    {
+        for (auto& individual : island->program.get_current_pop().get_individuals())
+        {
+            if (individual.fitness.adjusted_fitness > best_fitness)
+            {
+                best_fitness = individual.fitness.adjusted_fitness;
+                best = &individual.tree;
+            }
+        }
+    }
+    return *best;
+}
+
+double island_model_t::best_fitness() const
+{
+    double best = -std::numeric_limits<double>::infinity();
+    for (const auto& island : islands)
+        best = std::max(best, island->program.get_population_stats().best_fitness.load());
+    return best;
+}
+
+blt::u64 island_model_t::evaluations() const
+{
+    blt::u64 total = 0;
+    for (const auto& island : islands)
+        total += island->evaluations.load(std::memory_order_relaxed);
+    return total;
+}
+
+blt::u64 island_model_t::migrations() const
+{
+    blt::u64 total = 0;
+    for (const auto& island : islands)
+        total += island->received.load(std::memory_order_relaxed);
+    return total;
+}
+
+island_model_t::~island_model_t()
+{
+    for (auto& island : islands)
+        island->program.kill();
+}
+
+void benchmark_island_scaling(const std::vector<blt::size_t>& cores, blt::size_t generations, const std::string& path)
+{
+    std::ofstream out{path};
+    out << "cores,model,islands,threads_per_island,seconds,evaluations,evaluations_per_second,speedup\n";
+    
+    // speedups are relative to the first core count of each model
+    double island_base = 0;
+    double shared_base = 0;
+    for (auto core_count : cores)
+    {
+        for (bool use_islands : {true, false})
+        {
+            island_settings_t settings;
+            settings.count = use_islands ? core_count : 1;
+            settings.threads = use_islands ? 1 : core_count;
+            island_model_t model{settings};
+            
+            const auto start = blt::system::getCurrentTimeNanoseconds();
+            model.run(generations);
+            const auto seconds = static_cast<double>(blt::system::getCurrentTimeNanoseconds() - start) / 1e9;
+            const auto throughput = static_cast<double>(model.evaluations()) / seconds;
+            
+            auto& base = use_islands ? island_base : shared_base;
+            if (base == 0)
+                base = throughput;
+            out << core_count << ',' << (use_islands ? "islands" : "shared") << ',' << settings.count << ',' << settings.threads << ','
+                << seconds << ',' << model.evaluations() << ',' << throughput << ',' << throughput / base << '\n';
+            BLT_INFO("%ld cores as %s: %.1lf evaluations/s (%.2lfx)", core_count, use_islands ? "islands" : "one population", throughput,
+                     throughput / base);
+        }
+    }
+}
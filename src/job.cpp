@@ -0,0 +1,487 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <job.h>
+#include <gp_system.h>
+#include <animation.h>
+#include <image_writer.h>
+#include <scheduler.h>
+#include <tree_io.h>
+#include <farm.h>
+#include <checkpoint.h>
+#include <cost_scheduler.h>
+#include <operator_profiler.h>
+#include <tracer.h>
+#include <blt/std/logging.h>
+#include <blt/std/time.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+static std::string trim(const std::string& str)
+{
+    auto begin = str.find_first_not_of(" \t\r");
+    if (begin == std::string::npos)
+        return "";
+    auto end = str.find_last_not_of(" \t\r");
+    return str.substr(begin, end - begin + 1);
+}
+
+static bool parse_bool(const std::string& value)
+{
+    return value == "true" || value == "1" || value == "yes" || value == "on";
+}
+
+bool set_config_value(run_config_t& config, const std::string& key, const std::string& value, std::string& error)
+{
+    try
+    {
+        if (key == "target")
+            config.target = value;
+        else if (key == "animated")
+            config.animated = parse_bool(value);
+        else if (key == "generations")
+            config.generations = std::stoull(value);
+        else if (key == "output")
+            config.output = value;
+        else if (key == "snapshot_every")
+            config.snapshot_every = std::stoull(value);
+        else if (key == "population_snapshots")
+            config.population_snapshots = parse_bool(value);
+        else if (key == "difference_weight")
+            config.difference_weight = std::stof(value);
+        else if (key == "fractal_weight")
+            config.fractal_weight = std::stof(value);
+        else if (key == "histogram_weight")
+            config.histogram_weight = std::stof(value);
+        else if (key == "cost_weight")
+            config.cost_weight = std::stof(value);
+        else if (key == "cost_budget_ms")
+            config.cost_budget.budget_ms = std::stof(value);
+        else if (key == "trace")
+            config.trace = parse_bool(value);
+        else if (key == "deadline_ms")
+            config.deadline.deadline_ms = std::stof(value);
+        else if (key == "progressive")
+            config.evaluation.progressive = parse_bool(value);
+        else if (key == "racing")
+            config.evaluation.racing = parse_bool(value);
+        else if (key == "tiled")
+            config.evaluation.tiled = parse_bool(value);
+        else if (key == "cost_scheduling")
+            config.evaluation.cost_scheduling = parse_bool(value);
+        else if (key == "scheduler_threads")
+        {
+            config.evaluation.scheduler_threads = std::stoull(value);
+            config.manual_threads = true;
+        }
+        else if (key == "split_expensive")
+            config.evaluation.split_expensive = parse_bool(value);
+        else if (key == "steady_state")
+            config.steady_state.enabled = parse_bool(value);
+        else if (key == "steady_state_threads")
+        {
+            config.steady_state.threads = std::stoull(value);
+            config.manual_threads = true;
+        }
+        else if (key == "selection_size" || key == "replacement_size")
+        {
+            const auto size = std::stoull(value);
+            if (size == 0)
+            {
+                error = key + " must be at least 1";
+                return false;
+            }
+            (key == "selection_size" ? config.steady_state.selection_size : config.steady_state.replacement_size) = size;
+        }
+        else if (key == "seed")
+            config.seed = value;
+        else if (key == "threads")
+            config.threads = value;
+        else if (key == "population")
+            config.population = value;
+        else if (key == "thread_policy")
+        {
+            if (value == "manual")
+                config.thread_budget.policy = thread_policy_t::MANUAL;
+            else if (value == "outer")
+                config.thread_budget.policy = thread_policy_t::OUTER;
+            else if (value == "inner")
+                config.thread_budget.policy = thread_policy_t::INNER;
+            else if (value == "adaptive")
+                config.thread_budget.policy = thread_policy_t::ADAPTIVE;
+            else
+            {
+                error = "thread_policy must be manual, outer, inner or adaptive";
+                return false;
+            }
+        } else if (key == "thread_cores")
+            config.thread_budget.cores = std::stoull(value);
+        else if (key == "pin_workers")
+            config.pin_workers = parse_bool(value);
+        else if (key == "compare_pinning")
+            config.compare_pinning = parse_bool(value);
+        else if (key == "operator_profile")
+            config.operator_profile = parse_bool(value);
+        else if (key == "share")
+            config.share = value;
+        else if (key == "farm")
+            config.farm = value;
+        else if (key == "farm_thumbnails")
+            config.farm_thumbnails = parse_bool(value);
+        else if (key == "checkpoint")
+            config.checkpoint = value;
+        else if (key == "checkpoint_every")
+            config.checkpoint_every = std::stoull(value);
+        else if (key == "resume")
+            config.resume = value;
+        else if (key == "islands")
+            config.islands.count = std::stoull(value);
+        else if (key == "island_threads")
+            config.islands.threads = std::stoull(value);
+        else if (key == "migration_interval")
+            config.islands.migration_interval = std::stoull(value);
+        else if (key == "migrants")
+            config.islands.migrants = std::stoull(value);
+        else if (key == "topology")
+        {
+            if (value != "ring" && value != "random")
+            {
+                error = "topology must be ring or random";
+                return false;
+            }
+            config.islands.topology = value == "ring" ? migration_topology_t::RING : migration_topology_t::RANDOM;
+        } else if (key == "pin_threads")
+            config.islands.pin_threads = parse_bool(value);
+        else if (key == "scaling" || key == "population_scaling")
+        {
+            auto& list = key == "scaling" ? config.scaling : config.population_scaling;
+            list.clear();
+            std::istringstream values{value};
+            std::string count;
+            while (std::getline(values, count, ','))
+                list.push_back(std::stoull(count));
+        }
+        else
+        {
+            error = "unknown key '" + key + "'";
+            return false;
+        }
+    } catch (const std::exception&)
+    {
+        error = "bad value '" + value + "' for " + key;
+        return false;
+    }
+    return true;
+}
+
+bool load_config(std::istream& in, const std::string& source, run_config_t& out)
+{
+    std::string line;
+    blt::size_t line_number = 0;
+    while (std::getline(in, line))
+    {
+        line_number++;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty())
+            continue;
+        auto equals = line.find('=');
+        if (equals == std::string::npos)
+        {
+            BLT_WARN("%s:%ld: expected key = value", source.c_str(), line_number);
+            return false;
+        }
+        std::string error;
+        if (!set_config_value(out, trim(line.substr(0, equals)), trim(line.substr(equals + 1)), error))
+        {
+            BLT_WARN("%s:%ld: %s", source.c_str(), line_number, error.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+bool load_config(const std::string& path, run_config_t& out)
+{
+    std::ifstream file{path};
+    if (!file)
+    {
+        BLT_WARN("Unable to open config %s", path.c_str());
+        return false;
+    }
+    return load_config(file, path, out);
+}
+
+static void finish_trace(const run_config_t& config)
+{
+    if (!config.trace)
+        return;
+    tracer.set_enabled(false);
+    tracer.write(config.output + "/trace.json");
+}
+
+// runs on the gp thread, the population and every global the fitness function reads belong to it
+static bool prepare_job(const run_config_t& config, std::string& error)
+{
+    difference_weight = config.difference_weight;
+    fractal_weight = config.fractal_weight;
+    histogram_weight = config.histogram_weight;
+    cost_weight = config.cost_weight;
+    cost_budget_settings = config.cost_budget;
+    deadline_settings = config.deadline;
+    evaluation_settings = config.evaluation;
+    steady_state_settings = config.steady_state;
+    thread_budget.configure(config.thread_budget);
+    affinity_settings.pin_workers = config.pin_workers;
+    
+    timelapse_directory = config.output;
+    timelapse_population = config.population_snapshots;
+    timelapse = config.snapshot_every != 0;
+    
+    animation_settings.enabled = false;
+    if (config.animated)
+    {
+        if (!load_animation(config.target))
+        {
+            error = "unable to load animation " + config.target;
+            return false;
+        }
+        animation_settings.enabled = true;
+    } else if (!setup_target(config.target))
+    {
+        error = "unable to load target " + config.target;
+        return false;
+    }
+    
+    checkpoint_path = config.checkpoint;
+    checkpoint_every = config.checkpoint.empty() ? 0 : config.checkpoint_every;
+    // a checkpoint may switch to the target it was made against, so it has to be loaded before the workers are told which one to use
+    if (!config.resume.empty())
+    {
+        if (!load_checkpoint(config.resume))
+        {
+            error = "unable to resume from " + config.resume;
+            return false;
+        }
+    } else
+        reset_population();
+    
+    // workers are told the target when they connect, so a new target means sending them all through setup again. they may not share
+    // this process's working directory
+    const auto farm_target = std::filesystem::absolute(loaded_target).string();
+    if (config.farm.empty())
+        eval_farm.stop();
+    else if (!eval_farm.is_running() || eval_farm.get_target() != farm_target)
+        eval_farm.start(config.farm, farm_target, config.farm_thumbnails);
+    return true;
+}
+
+static job_result_t run_island_job(const run_config_t& config, std::ofstream& stats_file,
+                                   const std::function<bool(const job_progress_t&)>& progress)
+{
+    job_result_t result;
+    auto job_start = blt::system::getCurrentTimeNanoseconds();
+    if (config.animated)
+    {
+        result.error = "islands only evolve still targets";
+        return result;
+    }
+    if (!config.checkpoint.empty() || !config.resume.empty())
+    {
+        result.error = "checkpoints only cover the single population";
+        return result;
+    }
+    if (config.steady_state.enabled)
+    {
+        result.error = "islands always evolve whole generations";
+        return result;
+    }
+    if (config.cost_weight != 0 || config.cost_budget.budget_ms > 0)
+    {
+        result.error = "evaluation costs are only predicted for the single population";
+        return result;
+    }
+    if (config.deadline.deadline_ms > 0)
+    {
+        result.error = "islands render without deadlines";
+        return result;
+    }
+    
+    bool prepared = false;
+    scheduler.post([&]() {
+        difference_weight = config.difference_weight;
+        fractal_weight = config.fractal_weight;
+        histogram_weight = config.histogram_weight;
+        prepared = setup_target(config.target);
+    });
+    scheduler.wait_idle();
+    if (!prepared)
+    {
+        result.error = "unable to load target " + config.target;
+        return result;
+    }
+    
+    island_model_t model{config.islands};
+    // every island's threads are the outer layer, opencv gets whatever cores they leave over
+    if (config.thread_budget.policy != thread_policy_t::MANUAL)
+    {
+        const auto cores = config.thread_budget.cores == 0 ? available_cores() : config.thread_budget.cores;
+        set_opencv_threads(cores / (model.size() * std::max(config.islands.threads, 1ul)));
+    }
+    auto generation_start = blt::system::getCurrentTimeNanoseconds();
+    model.run(config.generations, [&](const island_progress_t& island_progress) {
+        const auto now = blt::system::getCurrentTimeNanoseconds();
+        job_progress_t current;
+        current.generation = island_progress.generation;
+        current.generations = config.generations;
+        current.best_fitness = island_progress.best_fitness;
+        current.average_fitness = island_progress.average_fitness;
+        current.milliseconds = static_cast<double>(now - generation_start) / 1e6;
+        generation_start = now;
+        
+        stats_file << current.generation << ',' << current.best_fitness << ',' << current.average_fitness << ',' << island_progress.worst_fitness
+                   << ',' << island_progress.overall_fitness << ',' << current.milliseconds << '\n';
+        result.generations = current.generation;
+        result.best_fitness = current.best_fitness;
+        return progress(current);
+    });
+    BLT_INFO("%ld islands, %ld evaluations, %ld migrants moved", model.size(), model.evaluations(), model.migrations());
+    stats_file.flush();
+    
+    auto& best = model.best_tree();
+    image_writer.submit(config.output + "/best.png", best.get_evaluation_value<full_image_t>(nullptr));
+    save_tree(best, config.output + "/best.igpt");
+    image_writer.flush();
+    
+    result.success = true;
+    result.completed = result.generations == config.generations;
+    result.seconds = static_cast<double>(blt::system::getCurrentTimeNanoseconds() - job_start) / 1e9;
+    return result;
+}
+
+job_result_t run_job(const run_config_t& config, const std::function<bool(const job_progress_t&)>& progress)
+{
+    job_result_t result;
+    auto job_start = blt::system::getCurrentTimeNanoseconds();
+    
+    // any other policy hands out its own thread counts every generation
+    if (config.manual_threads && config.thread_budget.policy != thread_policy_t::MANUAL)
+    {
+        result.error = "scheduler_threads and steady_state_threads need thread_policy = manual";
+        return result;
+    }
+    
+    std::error_code fs_error;
+    std::filesystem::create_directories(config.output, fs_error);
+    std::ofstream stats_file{config.output + "/stats.csv"};
+    if (!stats_file)
+    {
+        result.error = "unable to write to " + config.output;
+        return result;
+    }
+    stats_file << "generation,best_fitness,average_fitness,worst_fitness,overall_fitness,milliseconds\n";
+    
+    tracer.set_enabled(config.trace);
+    if (config.islands.count > 1)
+    {
+        auto island_result = run_island_job(config, stats_file, progress);
+        finish_trace(config);
+        return island_result;
+    }
+    
+    bool prepared = false;
+    scheduler.post([&]() { prepared = prepare_job(config, result.error); });
+    scheduler.wait_idle();
+    if (!prepared)
+        return result;
+    
+    // one column per scheduler thread, the thread count can't change during a job
+    std::ofstream utilization_file;
+    if (config.evaluation.cost_scheduling)
+    {
+        utilization_file.open(config.output + "/utilization.csv");
+        utilization_file << "generation,milliseconds,steals,split,prediction_error,thread_utilization...\n";
+    }
+    std::ofstream racing_file;
+    if (config.evaluation.racing)
+    {
+        racing_file.open(config.output + "/racing.csv");
+        racing_file << "generation,raced,aborted,fallbacks,tiles_skipped_fraction\n";
+    }
+    if (config.operator_profile && operator_profiler_t::compiled_in())
+        operator_profiler.set_csv(config.output + "/operators.csv");
+    
+    const auto first_generation = scheduler.generations_run();
+    auto generation_start = blt::system::getCurrentTimeNanoseconds();
+    auto hook = scheduler.on_generation([&](blt::size_t generation) {
+        const auto now = blt::system::getCurrentTimeNanoseconds();
+        auto& stats = program.get_population_stats();
+        
+        job_progress_t current;
+        current.generation = generation - first_generation;
+        current.generations = config.generations;
+        current.best_fitness = stats.best_fitness.load();
+        current.average_fitness = stats.average_fitness.load();
+        current.milliseconds = static_cast<double>(now - generation_start) / 1e6;
+        generation_start = now;
+        
+        stats_file << current_generation() << ',' << current.best_fitness << ',' << current.average_fitness << ','
+                   << stats.worst_fitness.load() << ',' << stats.overall_fitness.load() << ',' << current.milliseconds << '\n';
+        if (utilization_file.is_open())
+        {
+            utilization_file << current_generation() << ',' << static_cast<double>(schedule_stats.wall_ns) / 1e6 << ','
+                             << schedule_stats.steals.load() << ',' << schedule_stats.split.load() << ',' << schedule_stats.prediction_error.load();
+            for (blt::size_t i = 0; i < schedule_stats.threads; i++)
+                utilization_file << ',' << schedule_stats.utilization(i);
+            utilization_file << '\n';
+        }
+        if (racing_file.is_open())
+            racing_file << current_generation() << ',' << racing_stats.raced.load() << ',' << racing_stats.aborted.load() << ','
+                        << racing_stats.fallbacks.load() << ',' << racing_stats.skipped_fraction() << '\n';
+        result.generations = current.generation;
+        result.best_fitness = current.best_fitness;
+        // decides whether the next generation gets a snapshot
+        timelapse = config.snapshot_every != 0 && current.generation % config.snapshot_every == 0;
+        if (!progress(current))
+            scheduler.pause();
+    });
+    
+    scheduler.run_n(config.generations);
+    scheduler.wait_idle();
+    scheduler.remove_hook(hook);
+    stats_file.flush();
+    operator_profiler.set_csv("");
+    finish_trace(config);
+    
+    scheduler.post([&]() {
+        auto best = best_individual();
+        image_writer.submit(config.output + "/best.png", individual_image(best));
+        save_tree(program.get_current_pop().get_individuals()[best].tree, config.output + "/best.igpt");
+        if (!config.checkpoint.empty())
+            save_checkpoint(config.checkpoint);
+        timelapse = false;
+        checkpoint_every = 0;
+    });
+    scheduler.wait_idle();
+    image_writer.flush();
+    flush_checkpoints();
+    
+    result.success = true;
+    result.completed = result.generations == config.generations;
+    result.seconds = static_cast<double>(blt::system::getCurrentTimeNanoseconds() - job_start) / 1e9;
+    return result;
+}
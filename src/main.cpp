@@ -31,11 +31,32 @@
 #include "opencv2/imgcodecs.hpp"
 #include "opencv2/imgproc.hpp"
 #include <random>
-#include "slr.h"
+#include <string_view>
 #include "float_operations.h"
 #include <images.h>
 #include <helper.h>
 #include <image_operations.h>
+#include <fitness.h>
+#include <evaluation.h>
+#include <gp_system.h>
+#include <scheduler.h>
+#include <snapshot.h>
+#include <render.h>
+#include <tree_io.h>
+#include <image_writer.h>
+#include <animation.h>
+#include <farm.h>
+#include <checkpoint.h>
+#include <steady_state.h>
+#include <cost_scheduler.h>
+#include <thread_budget.h>
+#include <affinity.h>
+#include <operator_profiler.h>
+#include <evaluation_cost.h>
+#include <deadline.h>
+#include <tracer.h>
+#include <algorithm>
+#include <filesystem>
 
 blt::gfx::matrix_state_manager global_matrices;
 blt::gfx::resource_manager resources;
@@ -44,24 +65,8 @@ blt::gfx::first_person_camera_2d camera;
 
 static constexpr blt::size_t TYPE_COUNT = 3;
 
-const static int h_bins = 50, s_bins = 60;
-const static int histSize[] = {h_bins, s_bins};
-// hue varies from 0 to 179, saturation from 0 to 255
-const static float h_ranges[] = {0, 180};
-const static float s_ranges[] = {0, 256};
-const static float* ranges[] = {h_ranges, s_ranges};
-// Use the 0-th and 1-st channels
-const static int channels[] = {0, 1};
-
-float difference_weight = 0.01;
-float fractal_weight = 1;
-float histogram_weight = 2.0;
-
-std::array<double, POP_SIZE> fitness_values{};
-double last_fitness = 0;
 double hovered_fitness = 0;
 double hovered_fitness_value = 0;
-bool evaluate = true;
 
 std::array<bool, TYPE_COUNT> has_literal_converter = {
         true,
@@ -121,289 +126,269 @@ std::array<std::function<void(blt::gp::gp_program& program, void*, void*)>, TYPE
         }
 };
 
-std::array<full_image_t, POP_SIZE> generation_images;
-
-full_image_t base_image;
-cv::Mat hsv_base;
-cv::Mat hist_base;
-stb_image_t full_base_image;
-blt::size_t last_run = 0;
 blt::i32 time_between_runs = 16;
-bool is_running = false;
 
 std::unique_ptr<std::thread> gp_thread = nullptr;
 
-constexpr float compare_values(float a, float b)
-{
-    if (std::isnan(a) || std::isnan(b) || std::isinf(a) || std::isinf(b))
-        return IMAGE_SIZE;
-    auto dist = a - b;
-    //BLT_TRACE(std::sqrt(dist * dist));
-    return std::sqrt(dist * dist);
-}
+// set by 'image-gp-6 attach [name]', the window then only shows another process's population
+bool attached = false;
+std::string view_name = DEFAULT_SHARED_VIEW;
+shared_view_client_t viewer;
+// the viewer copies out of shared memory into its own snapshot, it is too large for the stack
+population_snapshot_t remote_snapshot;
 
-struct fractal_stats
-{
-    blt::f64 r, g, b, total, combined;
-};
+// page of the population picked in the ui, the snapshot says which one is actually being shown
+int page = 0;
+
+// set by 'image-gp-6 resume <checkpoint>'
+std::string resume_checkpoint;
 
-bool in_box(full_image_t& image, blt::size_t channel, blt::size_t box_size, blt::size_t i, blt::size_t j)
+// settings the gp thread and its workers read during a generation are edited on a copy in the ui and handed over between generations
+template<typename T>
+void post_setting(T& setting, T value)
 {
-    // TODO: this could be made better by starting from the smallest boxes, moving upwards and using the last set of boxes
-    //  instead of pixels, since they contain already computed information about if a box is in foam
-    for (blt::size_t x = i; x < i + box_size; x++)
-    {
-        for (blt::size_t y = j; y < j + box_size; y++)
-        {
-            if (image.rgb_data[get_index(x, y) * CHANNELS + channel] > THRESHOLD)
-                return true;
-        }
-    }
-    return false;
+    scheduler.post([&setting, value]() { setting = value; });
 }
 
-fractal_stats get_fractal_value(full_image_t& image)
+void run_gp()
 {
-    fractal_stats stats{};
-    std::array<double, BOX_COUNT> x_data{};
-    std::array<double, BOX_COUNT> boxes_r{};
-    std::array<double, BOX_COUNT> boxes_g{};
-    std::array<double, BOX_COUNT> boxes_b{};
-    std::array<double, BOX_COUNT> boxes_total{};
-    std::array<double, BOX_COUNT> boxes_combined{};
-    for (blt::size_t box_size = IMAGE_SIZE / 2; box_size > 1; box_size /= 2)
-    {
-        blt::ptrdiff_t num_boxes_r = 0;
-        blt::ptrdiff_t num_boxes_g = 0;
-        blt::ptrdiff_t num_boxes_b = 0;
-        blt::ptrdiff_t num_boxes_total = 0;
-        blt::ptrdiff_t num_boxes_combined = 0;
-        for (blt::size_t i = 0; i < IMAGE_SIZE; i += box_size)
-        {
-            for (blt::size_t j = 0; j < IMAGE_SIZE; j += box_size)
-            {
-                auto r = in_box(image, 0, box_size, i, j);
-                auto g = in_box(image, 1, box_size, i, j);
-                auto b = in_box(image, 2, box_size, i, j);
-                
-                if (r)
-                    num_boxes_r++;
-                if (g)
-                    num_boxes_g++;
-                if (b)
-                    num_boxes_b++;
-                if (r && g && b)
-                    num_boxes_combined++;
-                if (r || g || b)
-                    num_boxes_total++;
-            }
-        }
-        auto x = static_cast<blt::f64>(std::log2(box_size));
-        
-        x_data[static_cast<blt::size_t>(std::log2(box_size)) - 1] = x;
-        boxes_r[static_cast<blt::size_t>(std::log2(box_size)) - 1] = static_cast<blt::f64>(num_boxes_r == 0 ? 0 : std::log2(num_boxes_r));
-        boxes_g[static_cast<blt::size_t>(std::log2(box_size)) - 1] = static_cast<blt::f64>(num_boxes_g == 0 ? 0 : std::log2(num_boxes_g));
-        boxes_b[static_cast<blt::size_t>(std::log2(box_size)) - 1] = static_cast<blt::f64>(num_boxes_b == 0 ? 0 : std::log2(num_boxes_b));
-        boxes_total[static_cast<blt::size_t>(std::log2(box_size)) - 1] = static_cast<blt::f64>(num_boxes_combined == 0 ? 0 : std::log2(
-                num_boxes_combined));
-        boxes_combined[static_cast<blt::size_t>(std::log2(box_size)) - 1] = static_cast<blt::f64>(num_boxes_total == 0 ? 0 : std::log2(
-                num_boxes_total));
-    }
-    
-    slr count_r{x_data, boxes_r};
-    slr count_g{x_data, boxes_g};
-    slr count_b{x_data, boxes_b};
-    slr count_total{x_data, boxes_total};
-    slr count_combined{x_data, boxes_combined};
-
-#define FUNC(f) (-f)
-    stats.r = FUNC(count_r.beta);
-    stats.g = FUNC(count_g.beta);
-    stats.b = FUNC(count_b.beta);
-    stats.total = FUNC(count_total.beta);
-    stats.combined = FUNC(count_combined.beta);
-#undef FUNC
-    
-    return stats;
+    if (resume_checkpoint.empty() || !load_checkpoint(resume_checkpoint))
+        generate_population();
+    scheduler.run_loop([]() {
+        execute_generation();
+        print_stats();
+    }, []() {
+        return program.get_population_stats().best_fitness.load();
+    });
 }
 
-constexpr auto create_fitness_function()
+void init(const blt::gfx::window_data&)
 {
-    return [](blt::gp::tree_t& current_tree, blt::gp::fitness_t& fitness, blt::size_t index) {
-        auto& v = generation_images[index];
-        if (evaluate)
-            v = current_tree.get_evaluation_value<full_image_t>(nullptr);
-        
-        if (fitness_values[index] < 0)
-        {
-            double total_difference = 0;
-            for (blt::size_t i = 0; i < DATA_CHANNELS_SIZE; i++)
-            {
-                auto diff = compare_values(v.rgb_data[i], base_image.rgb_data[i]);
-                total_difference += diff;
-                if (diff < 0.01)
-                    total_difference -= total_difference * 0.02;
-            }
-            
-            double total_fractal = 0;
-            auto raw = get_fractal_value(v);
-            if (std::isnan(raw.total) || std::isnan(raw.combined))
-                total_fractal += 400;
-            else
-                total_fractal += raw.total + raw.combined + 1.0;
-            
-            cv::Mat src{IMAGE_SIZE, IMAGE_SIZE, CV_32FC3, v.rgb_data};
-            cv::Mat src_hsv;
-            cv::Mat src_hist;
-            
-            cv::cvtColor(src, src_hsv, cv::COLOR_RGB2HSV);
-            calcHist(&src_hsv, 1, channels, cv::Mat(), src_hist, 2, histSize, ranges, true, false);
-            normalize(src_hist, src_hist, 0, 1, cv::NORM_MINMAX, -1, cv::Mat());
-
-//            auto total_hist = compareHist(hist_base, src_hist, cv::HISTCMP_BHATTACHARYYA);
-            auto total_hist = compareHist(hist_base, src_hist, cv::HISTCMP_CORREL);
-            
-            fitness.raw_fitness = (total_difference * difference_weight) + (total_fractal * fractal_weight) + (total_hist * histogram_weight);
-            /*BLT_TRACE(
-                    "Normal Variants: {Difference: %lf | Fractal: %lf | Histogram: %lf } Weighted Variants: { Difference: %lf | Fractal: %lf | Histogram: %lf } Total Fitness: %lf",
-                    total_difference, total_fractal, total_hist, (total_difference * difference_weight), (total_fractal * fractal_weight),
-                    (total_hist * histogram_weight), fitness.raw_fitness);*/
-            
-            fitness.raw_fitness += last_fitness;
-        } else
-            fitness.raw_fitness = fitness_values[index];
-        fitness.standardized_fitness = fitness.raw_fitness;
-        fitness.adjusted_fitness = (1.0 / (1.0 + fitness.standardized_fitness));
-    };
+    using namespace blt::gfx;
+    
+    for (blt::size_t i = 0; i < PAGE_SIZE; i++)
+        resources.set(std::to_string(i), new texture_gl2D(IMAGE_SIZE, IMAGE_SIZE, GL_RGB8));
+    
+    global_matrices.create_internals();
+    resources.load_resources();
+    renderer_2d.create();
+    
+    if (attached)
+        return;
+    
+    BLT_INFO("Starting BLT-GP Image Test");
+    BLT_INFO("Using Seed: %ld", SEED);
+    BLT_START_INTERVAL("Image Test", "Main");
+    BLT_DEBUG("Setup Base Image");
+    if (!setup_target(load_image))
+        BLT_ABORT("Unable to load the target image");
+    
+    setup_operators();
+    
+    scheduler.set_min_interval(std::chrono::milliseconds(time_between_runs));
+    gp_thread = std::make_unique<std::thread>(run_gp);
 }
 
-void execute_generation()
+void draw_stats(const population_snapshot_t& snapshot)
 {
-    BLT_TRACE("------------{Begin Generation %ld}------------", program.get_current_generation());
-    BLT_TRACE("Evaluate Fitness");
-    BLT_START_INTERVAL("Image Test", "Fitness");
-    evaluate = false;
-    program.evaluate_fitness();
-    BLT_END_INTERVAL("Image Test", "Fitness");
-    BLT_START_INTERVAL("Image Test", "Gen");
-    program.create_next_generation();
-    BLT_END_INTERVAL("Image Test", "Gen");
-    BLT_TRACE("Move to next generation");
-    program.next_generation();
-    BLT_TRACE("Evaluate Image");
-    BLT_START_INTERVAL("Image Test", "Image Eval");
-    evaluate = true;
-    program.evaluate_fitness();
-    BLT_END_INTERVAL("Image Test", "Image Eval");
-    BLT_TRACE("----------------------------------------------");
-    std::cout << std::endl;
-    // reset all fitness values.
-    for (auto& v : fitness_values)
-        v = -1;
-    last_fitness = 0;
+    ImGui::Text("Stats:");
+    ImGui::Text("Showing %ld - %ld of %ld (%.1lfMB of images retained)", snapshot.first, snapshot.first + snapshot.count, snapshot.population,
+                static_cast<double>(snapshot.image_bytes) / 1e6);
+    ImGui::Text("Average fitness: %lf", snapshot.average_fitness);
+    ImGui::Text("Best fitness: %lf", snapshot.best_fitness);
+    ImGui::Text("Worst fitness: %lf", snapshot.worst_fitness);
+    ImGui::Text("Overall fitness: %lf", snapshot.overall_fitness);
+    ImGui::Separator();
+    ImGui::Text("Hovered Fitness: %lf", hovered_fitness);
+    ImGui::Text("Hovered Fitness Value: %lf", hovered_fitness_value);
 }
 
-void print_stats()
+// true when the user picked another page of the population
+bool draw_page_controls(const population_snapshot_t& snapshot)
 {
-    auto& stats = program.get_population_stats();
-    BLT_INFO("Stats:");
-    BLT_INFO("Average fitness: %lf", stats.average_fitness.load());
-    BLT_INFO("Best fitness: %lf", stats.best_fitness.load());
-    BLT_INFO("Worst fitness: %lf", stats.worst_fitness.load());
-    BLT_INFO("Overall fitness: %lf", stats.overall_fitness.load());
+    const auto pages = static_cast<int>((snapshot.population + PAGE_SIZE - 1) / PAGE_SIZE);
+    if (pages <= 1)
+        return false;
+    return ImGui::SliderInt("Page", &page, 0, pages - 1);
 }
 
-std::atomic_bool run_generation = false;
-
-void run_gp()
+void draw_viewer_controls(const population_snapshot_t& snapshot)
 {
-    BLT_DEBUG("Generate Initial Population");
-    static constexpr auto fitness_func = create_fitness_function();
-    auto sel = blt::gp::select_tournament_t{};
-//    auto sel = blt::gp::select_fitness_proportionate_t{};
-    program.generate_population(type_system.get_type<full_image_t>().id(), fitness_func, sel, sel, sel);
-    
-    while (!program.should_thread_terminate())
+    if (ImGui::Begin("Viewer"))
     {
-        if ((run_generation || is_running) && (blt::system::getCurrentTimeMilliseconds() - last_run) > static_cast<blt::size_t>(time_between_runs))
-        {
-            execute_generation();
-            print_stats();
-            run_generation = false;
-            last_run = blt::system::getCurrentTimeMilliseconds();
-        }
+        ImGui::Text("Attached to %s", view_name.c_str());
+        if (!viewer.host_alive())
+            ImGui::Text("The gp process has exited, showing its last generation");
+        ImGui::Text("Generation %ld", snapshot.version);
+        if (ImGui::Button("Run Generation") || (blt::gfx::isKeyPressed(GLFW_KEY_R) && blt::gfx::keyPressedLastFrame()))
+            viewer.send({view_command_type_t::STEP, 0});
+        ImGui::SameLine();
+        if (ImGui::Button("Run"))
+            viewer.send({view_command_type_t::RUN, 0});
+        ImGui::SameLine();
+        if (ImGui::Button("Pause"))
+            viewer.send({view_command_type_t::PAUSE, 0});
+        if (draw_page_controls(snapshot))
+            viewer.send({view_command_type_t::PAGE, static_cast<blt::u32>(page)});
+        ImGui::Separator();
+        draw_stats(snapshot);
+        ImGui::End();
     }
 }
 
-void init(const blt::gfx::window_data&)
+void draw_operator_profile()
 {
-    using namespace blt::gfx;
-    
-    for (blt::size_t i = 0; i < config.population_size; i++)
-        resources.set(std::to_string(i), new texture_gl2D(IMAGE_SIZE, IMAGE_SIZE, GL_RGB8));
-    
-    BLT_INFO("Starting BLT-GP Image Test");
-    BLT_INFO("Using Seed: %ld", SEED);
-    BLT_START_INTERVAL("Image Test", "Main");
-    BLT_DEBUG("Setup Base Image");
-    full_base_image.load(load_image).resize(static_cast<int>(std::max(full_base_image.get_width() / 2ul, IMAGE_SIZE)),
-                                            static_cast<int>(std::max(full_base_image.get_height() / 2ul, IMAGE_SIZE)));
-    base_image.load(full_base_image);
-    
-    cv::Mat base{IMAGE_SIZE, IMAGE_SIZE, CV_32FC3, base_image.rgb_data};
-    cv::cvtColor(base, hsv_base, cv::COLOR_RGB2HSV);
-    
-    cv::calcHist(&hsv_base, 1, channels, cv::Mat(), hist_base, 2, histSize, ranges, true, false);
-    cv::normalize(hist_base, hist_base, 0, 1, cv::NORM_MINMAX, -1, cv::Mat());
-    
-    BLT_DEBUG("Setup Types and Operators");
-    type_system.register_type<full_image_t>();
-    type_system.register_type<float>();
-    type_system.register_type<blt::u64>();
-    
-    blt::gp::operator_builder<context> builder{type_system};
-#if CV_VERSION_MAJOR >= 4 && CV_VERSION_MINOR >= 10
-    program.set_operations(
-            builder.build(perlin, perlin_terminal, perlin_warped, add, sub, mul, pro_div, op_sin, op_cos, op_atan, op_exp, op_log, op_abs, op_round,
-                          op_v_mod, bitwise_and, bitwise_or, bitwise_invert, bitwise_xor, dissolve, band_pass, hsv_to_rgb, gaussian_blur, median_blur,
-                          l_system, high_pass, bilateral_filter, lit, vec, random_val, op_x_r, op_x_g, op_x_b, op_x_rgb, op_y_r, op_y_g, op_y_b,
-                          op_y_rgb, f_literal, i_literal));
-#else
-    program.set_operations(
-            builder.build(perlin, perlin_terminal, perlin_warped, add, sub, mul, pro_div, op_sin, op_cos, op_atan, op_exp, op_log, op_abs, op_round,
-                          op_v_mod, bitwise_and, bitwise_or, bitwise_invert, bitwise_xor, dissolve, band_pass, hsv_to_rgb, gaussian_blur, median_blur,
-                          l_system, high_pass, lit, vec, random_val, op_x_r, op_x_g, op_x_b, op_x_rgb, op_y_r, op_y_g, op_y_b, op_y_rgb, f_literal,
-                          i_literal));
-#endif
+    ImGui::SetNextWindowSize(ImVec2(512, 400), ImGuiCond_Once);
+    if (!ImGui::Begin("Operator Profile"))
+    {
+        ImGui::End();
+        return;
+    }
+    if (tracer_t::compiled_in())
+    {
+        static bool tracing = false;
+        if (ImGui::Checkbox("Trace", &tracing))
+            tracer.set_enabled(tracing);
+        ImGui::SameLine();
+        // the buffers are read while the threads keep recording, nothing has to stop for this
+        if (ImGui::Button("Write trace.json"))
+            tracer.write("trace.json");
+    }
+    if (!operator_profiler_t::compiled_in())
+    {
+        ImGui::Text("Built without ENABLE_OPERATOR_PROFILER");
+        ImGui::End();
+        return;
+    }
     
+    static bool write_csv = false;
+    if (ImGui::Checkbox("Write operators.csv", &write_csv))
+        operator_profiler.set_csv(write_csv ? "operators.csv" : "");
     
-    global_matrices.create_internals();
-    resources.load_resources();
-    renderer_2d.create();
+    auto rows = operator_profiler.get_rows();
+    blt::u64 total_ns = 0;
+    for (const auto& row : rows)
+        total_ns += row.total_ns;
+    ImGui::Text("Last generation: %.1lfms spent in %ld operators", static_cast<double>(total_ns) / 1e6, rows.size());
     
-    gp_thread = std::make_unique<std::thread>(run_gp);
+    constexpr auto flags = ImGuiTableFlags_Sortable | ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY |
+                           ImGuiTableFlags_Resizable;
+    if (ImGui::BeginTable("operators", 7, flags))
+    {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Operator");
+        ImGui::TableSetupColumn("Calls");
+        ImGui::TableSetupColumn("Total ms", ImGuiTableColumnFlags_DefaultSort | ImGuiTableColumnFlags_PreferSortDescending);
+        ImGui::TableSetupColumn("Mean us");
+        ImGui::TableSetupColumn("p50 us");
+        ImGui::TableSetupColumn("p99 us");
+        ImGui::TableSetupColumn("Share %");
+        ImGui::TableHeadersRow();
+        
+        // the rows are fetched again every frame, so the sort is applied every frame rather than only when the specs change
+        if (const auto* specs = ImGui::TableGetSortSpecs(); specs != nullptr && specs->SpecsCount > 0)
+        {
+            const auto column = specs->Specs[0].ColumnIndex;
+            const bool ascending = specs->Specs[0].SortDirection == ImGuiSortDirection_Ascending;
+            const auto key = [column](const operator_profile_row_t& row) {
+                switch (column)
+                {
+                    case 1:
+                        return static_cast<double>(row.calls);
+                    case 3:
+                        return static_cast<double>(row.total_ns) / static_cast<double>(row.calls);
+                    case 4:
+                        return static_cast<double>(row.p50_ns);
+                    case 5:
+                        return static_cast<double>(row.p99_ns);
+                    default:
+                        return static_cast<double>(row.total_ns);
+                }
+            };
+            std::sort(rows.begin(), rows.end(), [&](const operator_profile_row_t& a, const operator_profile_row_t& b) {
+                if (column == 0)
+                    return ascending ? a.name < b.name : a.name > b.name;
+                return ascending ? key(a) < key(b) : key(a) > key(b);
+            });
+        }
+        
+        for (const auto& row : rows)
+        {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(row.name.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%ld", row.calls);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2lf", static_cast<double>(row.total_ns) / 1e6);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2lf", static_cast<double>(row.total_ns) / static_cast<double>(row.calls) / 1e3);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2lf", static_cast<double>(row.p50_ns) / 1e3);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2lf", static_cast<double>(row.p99_ns) / 1e3);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1lf", total_ns == 0 ? 0.0 : static_cast<double>(row.total_ns) / static_cast<double>(total_ns) * 100);
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
 }
 
 void update(const blt::gfx::window_data& data)
 {
     global_matrices.update_perspectives(data.width, data.height, 90, 0.1, 2000);
     
-    for (blt::size_t i = 0; i < config.population_size; i++)
-        resources.get(std::to_string(i)).value()->upload(generation_images[i].rgb_data, IMAGE_SIZE, IMAGE_SIZE, GL_RGB, GL_FLOAT);
+    // textures only change when the gp thread has published a new generation
+    const bool changed = attached ? viewer.read(remote_snapshot) : population_snapshots.update();
+    const auto& snapshot = attached ? remote_snapshot : population_snapshots.read_buffer();
+    if (changed)
+    {
+        for (blt::size_t i = 0; i < snapshot.count; i++)
+            resources.get(std::to_string(i)).value()->upload(const_cast<blt::u8*>(snapshot.pixels[i].data()), IMAGE_SIZE, IMAGE_SIZE, GL_RGB,
+                                                             GL_UNSIGNED_BYTE);
+    }
     
     ImGui::SetNextWindowSize(ImVec2(350, 512), ImGuiCond_Once);
-    if (ImGui::Begin("Program Control"))
+    if (attached)
+        draw_viewer_controls(snapshot);
+    else if (ImGui::Begin("Program Control"))
     {
+        auto mode = scheduler.get_mode();
         ImGui::Button("Run Generation");
-        if ((ImGui::IsItemClicked() || (blt::gfx::isKeyPressed(GLFW_KEY_R) && blt::gfx::keyPressedLastFrame())) && !is_running)
-        {
-            run_generation = true;
-        }
+        if ((ImGui::IsItemClicked() || (blt::gfx::isKeyPressed(GLFW_KEY_R) && blt::gfx::keyPressedLastFrame())) && mode == run_mode_t::PAUSED)
+            scheduler.step();
         ImGui::Button("Reset Program");
         if (ImGui::IsItemClicked())
-            program.reset_program(type_system.get_type<full_image_t>().id(), true);
-        ImGui::InputInt("Time Between Runs", &time_between_runs, 16);
-        ImGui::Checkbox("Run", &is_running);
+            scheduler.post(reset_population);
+        if (ImGui::InputInt("Time Between Runs", &time_between_runs, 16))
+        {
+            time_between_runs = std::max(time_between_runs, 0);
+            scheduler.set_min_interval(std::chrono::milliseconds(time_between_runs));
+        }
+        bool running = mode == run_mode_t::RUN;
+        if (ImGui::Checkbox("Run", &running))
+        {
+            if (running)
+                scheduler.run();
+            else
+                scheduler.pause();
+        }
+        
+        static int run_count = 10;
+        ImGui::InputInt("##Generations", &run_count);
+        ImGui::SameLine();
+        if (ImGui::Button("Run N"))
+            scheduler.run_n(static_cast<blt::size_t>(std::max(run_count, 0)));
+        static float target_fitness = 0.5f;
+        ImGui::InputFloat("##Fitness", &target_fitness);
+        ImGui::SameLine();
+        if (ImGui::Button("Run Until Fitness"))
+            scheduler.run_until_fitness(target_fitness);
+        if (mode == run_mode_t::RUN_N)
+            ImGui::Text("%ld generations remaining", scheduler.get_remaining());
+        else if (mode == run_mode_t::RUN_UNTIL_FITNESS)
+            ImGui::Text("Running until best fitness reaches %f", target_fitness);
         
         ImGui::Separator();
         
@@ -428,25 +413,248 @@ void update(const blt::gfx::window_data& data)
         ImGui::SliderFloat("Difference Weight", &difference_weight, difference_min, difference_max);
         ImGui::SliderFloat("Fractal Weight", &fractal_weight, fractal_min, fractal_max);
         ImGui::SliderFloat("Hist Weight", &histogram_weight, hist_min, hist_max);
+        ImGui::SliderFloat("Cost Weight", &cost_weight, 0, 1);
+        static auto budget_ms = cost_budget_settings.budget_ms;
+        if (ImGui::InputFloat("Cost Budget (ms)", &budget_ms, 1.0f))
+            post_setting(cost_budget_settings.budget_ms, budget_ms);
+        ImGui::Text("Predicted %.2lfms per individual, %ld offspring over budget", cost_budget_stats.mean_predicted_ms(),
+                    cost_budget_stats.rejected.load());
+        static auto deadline_ms = deadline_settings.deadline_ms;
+        if (ImGui::InputFloat("Deadline (ms)", &deadline_ms, 10.0f))
+            post_setting(deadline_settings.deadline_ms, deadline_ms);
+        ImGui::Text("%ld timed out this generation, %ld in total", deadline_stats.timeouts.load(), deadline_stats.total_timeouts);
         
-        auto& stats = program.get_population_stats();
-        ImGui::Text("Stats:");
-        ImGui::Text("Average fitness: %lf", stats.average_fitness.load());
-        ImGui::Text("Best fitness: %lf", stats.best_fitness.load());
-        ImGui::Text("Worst fitness: %lf", stats.worst_fitness.load());
-        ImGui::Text("Overall fitness: %lf", stats.overall_fitness.load());
         ImGui::Separator();
-        ImGui::Text("Hovered Fitness: %lf", hovered_fitness);
-        ImGui::Text("Hovered Fitness Value: %lf", hovered_fitness_value);
+        
+        static const char* policy_names[] = {"Manual", "Outer", "Inner", "Adaptive"};
+        static int policy = static_cast<int>(thread_budget.settings.policy);
+        if (ImGui::Combo("Thread Policy", &policy, policy_names, 4))
+            post_setting(thread_budget.settings.policy, static_cast<thread_policy_t>(policy));
+        // every thread count below is handed out by the budget unless the policy is manual
+        const bool budgeted = static_cast<thread_policy_t>(policy) != thread_policy_t::MANUAL;
+        static int budget_cores = static_cast<int>(thread_budget.settings.cores);
+        if (ImGui::InputInt("Budget Cores", &budget_cores))
+        {
+            budget_cores = std::max(budget_cores, 0);
+            post_setting(thread_budget.settings.cores, static_cast<blt::size_t>(budget_cores));
+        }
+        ImGui::Text("%ld outer x %ld inner threads (%.2lfx the cores), opencv %ld, blt-gp %ld", thread_budget_stats.outer.load(),
+                    thread_budget_stats.inner.load(), thread_budget_stats.oversubscription.load(), thread_budget_stats.opencv_threads.load(),
+                    thread_budget_stats.program_threads.load());
+        ImGui::Text("%.0lf involuntary context switches a second", thread_budget_stats.involuntary_per_second());
+        if (budgeted)
+            ImGui::Text("Scheduler, steady state, tile and frame threads are set by the budget");
+        static bool pin_workers = affinity_settings.pin_workers;
+        if (ImGui::Checkbox("Pin Workers", &pin_workers))
+            post_setting(affinity_settings.pin_workers, pin_workers);
+        const auto& topology = cpu_topology();
+        ImGui::Text("%ld cpus on %ld numa nodes (%s)", topology.cpus.size(), topology.node_count, topology.from_libnuma ? "libnuma" : "sysfs");
+        
+        ImGui::Separator();
+        
+        static auto evaluation = evaluation_settings;
+        if (ImGui::Checkbox("Progressive Evaluation", &evaluation.progressive))
+            post_setting(evaluation_settings.progressive, evaluation.progressive);
+        for (blt::size_t i = 0; i < LEVEL_COUNT - 1; i++)
+        {
+            const auto label = "Promote " + std::to_string(RESOLUTION_LEVELS[i]) + " -> " + std::to_string(RESOLUTION_LEVELS[i + 1]);
+            if (ImGui::SliderFloat(label.c_str(), &evaluation.promotion_ratios[i], 0.01f, 1.0f))
+                post_setting(evaluation_settings.promotion_ratios, evaluation.promotion_ratios);
+        }
+        if (evaluation.progressive)
+        {
+            for (const auto& [level, count] : blt::enumerate(progressive_stats.evaluations))
+                ImGui::Text("%ldx%ld renders: %ld", RESOLUTION_LEVELS[level], RESOLUTION_LEVELS[level], count);
+            ImGui::Text("Full evaluations avoided: %ld (%ld / %ld total)", progressive_stats.full_avoided, progressive_stats.total_full_avoided,
+                        progressive_stats.total_individuals);
+        }
+        
+        if (ImGui::Checkbox("Racing Evaluation", &evaluation.racing))
+            post_setting(evaluation_settings.racing, evaluation.racing);
+        if (evaluation.racing)
+        {
+            static const char* threshold_names[] = {"Worst Elite", "Percentile"};
+            static int racing_threshold = static_cast<int>(evaluation.racing_threshold);
+            if (ImGui::Combo("Racing Threshold", &racing_threshold, threshold_names, 2))
+            {
+                evaluation.racing_threshold = static_cast<racing_threshold_t>(racing_threshold);
+                post_setting(evaluation_settings.racing_threshold, evaluation.racing_threshold);
+            }
+            if (evaluation.racing_threshold == racing_threshold_t::PERCENTILE &&
+                ImGui::SliderFloat("Racing Percentile", &evaluation.racing_percentile, 0.0f, 1.0f))
+                post_setting(evaluation_settings.racing_percentile, evaluation.racing_percentile);
+            ImGui::Text("Aborted: %ld / %ld (%ld untiled)", racing_stats.aborted.load(), racing_stats.raced.load(), racing_stats.fallbacks.load());
+            ImGui::Text("Work skipped: %.1lf%% (%.1lf%% total)", racing_stats.skipped_fraction() * 100, racing_stats.total_skipped_fraction() * 100);
+        }
+        
+        if (ImGui::Checkbox("Tiled Evaluation", &evaluation.tiled))
+            post_setting(evaluation_settings.tiled, evaluation.tiled);
+        static int tile_threads = static_cast<int>(evaluation.tile_threads);
+        ImGui::BeginDisabled(budgeted);
+        if (ImGui::InputInt("Tile Threads", &tile_threads))
+        {
+            tile_threads = std::max(tile_threads, 1);
+            post_setting(evaluation_settings.tile_threads, static_cast<blt::size_t>(tile_threads));
+        }
+        ImGui::EndDisabled();
+        if (ImGui::Button("Benchmark Tiled Evaluation"))
+            scheduler.post([]() { benchmark_tiled_evaluation(program.get_current_pop()); });
+        if (tile_benchmark.individuals > 0)
+        {
+            ImGui::Text("Whole: %.2lfms Tiled: %.2lfms (%ld untiled)", tile_benchmark.whole_ms, tile_benchmark.tiled_ms, tile_benchmark.untiled);
+            ImGui::Text("Max error: %lf (%ld mismatches)", tile_benchmark.max_error, tile_benchmark.mismatches);
+        }
+        
+        if (ImGui::Checkbox("Cost Scheduling", &evaluation.cost_scheduling))
+            post_setting(evaluation_settings.cost_scheduling, evaluation.cost_scheduling);
+        if (evaluation.cost_scheduling)
+        {
+            static int scheduler_threads = static_cast<int>(evaluation.scheduler_threads);
+            ImGui::BeginDisabled(budgeted);
+            if (ImGui::InputInt("Scheduler Threads", &scheduler_threads))
+            {
+                scheduler_threads = std::clamp(scheduler_threads, 0, static_cast<int>(MAX_SCHEDULER_THREADS));
+                post_setting(evaluation_settings.scheduler_threads, static_cast<blt::size_t>(scheduler_threads));
+            }
+            ImGui::EndDisabled();
+            if (ImGui::Checkbox("Split Expensive Individuals", &evaluation.split_expensive))
+                post_setting(evaluation_settings.split_expensive, evaluation.split_expensive);
+            if (ImGui::SliderFloat("Split Above Share", &evaluation.split_share, 0.05f, 1.0f))
+                post_setting(evaluation_settings.split_share, evaluation.split_share);
+            ImGui::Text("%.1lfms, %ld steals, %ld split into %ld tiles, %.1lf%% prediction error", static_cast<double>(schedule_stats.wall_ns) / 1e6,
+                        schedule_stats.steals.load(), schedule_stats.split.load(), schedule_stats.tiles.load(),
+                        schedule_stats.prediction_error.load() * 100);
+            for (blt::size_t i = 0; i < schedule_stats.threads; i++)
+            {
+                const auto utilization = schedule_stats.utilization(i);
+                ImGui::ProgressBar(static_cast<float>(utilization), ImVec2(-1, 0), ("Thread " + std::to_string(i) + ": " +
+                                                                                   std::to_string(static_cast<int>(utilization * 100)) + "%").c_str());
+            }
+        }
+        
+        static bool farm = false;
+        if (ImGui::Checkbox("Evaluation Farm", &farm))
+        {
+            // the gp thread reads the farm's state every generation, so it is only started or stopped between them
+            if (farm)
+                scheduler.post([]() { eval_farm.start(DEFAULT_FARM_SOCKET, std::filesystem::absolute(loaded_target).string()); });
+            else
+                scheduler.post([]() { eval_farm.stop(); });
+        }
+        if (farm)
+        {
+            auto farm_stats = eval_farm.get_stats();
+            ImGui::Text("%ld workers: %ld remote, %ld local in %.1lfms (%ld resent, %ld timed out)", farm_stats.workers, farm_stats.remote,
+                        farm_stats.local, farm_stats.batch_ms, farm_stats.resent, farm_stats.timeouts);
+        }
+        
+        static bool steady_state = steady_state_settings.enabled;
+        if (ImGui::Checkbox("Steady State", &steady_state))
+            post_setting(steady_state_settings.enabled, steady_state);
+        static int steady_threads = static_cast<int>(steady_state_settings.threads);
+        ImGui::BeginDisabled(budgeted);
+        if (ImGui::InputInt("Breeding Threads", &steady_threads))
+        {
+            steady_threads = std::max(steady_threads, 0);
+            post_setting(steady_state_settings.threads, static_cast<blt::size_t>(steady_threads));
+        }
+        ImGui::EndDisabled();
+        static int selection_size = static_cast<int>(steady_state_settings.selection_size);
+        if (ImGui::InputInt("Selection Tournament", &selection_size))
+        {
+            selection_size = std::max(selection_size, 1);
+            post_setting(steady_state_settings.selection_size, static_cast<blt::size_t>(selection_size));
+        }
+        static int replacement_size = static_cast<int>(steady_state_settings.replacement_size);
+        if (ImGui::InputInt("Replacement Tournament", &replacement_size))
+        {
+            replacement_size = std::max(replacement_size, 1);
+            post_setting(steady_state_settings.replacement_size, static_cast<blt::size_t>(replacement_size));
+        }
+        if (steady_state)
+            ImGui::Text("%ld offspring, %ld rejected, %.1lf%% of %ld threads busy", steady_state_stats.offspring.load(),
+                        steady_state_stats.rejected.load(), steady_state_stats.utilization() * 100, steady_state_stats.threads.load());
+        
+        ImGui::Separator();
+        
+        static bool animated = false;
+        if (ImGui::Checkbox("Animated Target", &animated))
+        {
+            // the frames are scored against by the fitness function, so they are loaded and switched on between generations
+            scheduler.post([enabled = animated]() {
+                if (enabled && animation_frames.empty() && !load_animation(animation_image))
+                    return;
+                animation_settings.enabled = enabled;
+            });
+        }
+        static int animation_threads = static_cast<int>(animation_settings.threads);
+        ImGui::BeginDisabled(budgeted);
+        if (ImGui::InputInt("Frame Threads", &animation_threads))
+        {
+            animation_threads = std::max(animation_threads, 1);
+            post_setting(animation_settings.threads, static_cast<blt::size_t>(animation_threads));
+        }
+        ImGui::EndDisabled();
+        static bool fold_static = animation_settings.fold_static;
+        if (ImGui::Checkbox("Reuse Time Independent Subtrees", &fold_static))
+            post_setting(animation_settings.fold_static, fold_static);
+        if (animated && animation_stats.frames == 0)
+            ImGui::Text("No frames loaded from %s", animation_image);
+        else if (animated)
+            ImGui::Text("%ld frames, %.1lf%% of ops evaluated once per individual", animation_stats.frames.load(),
+                        animation_stats.folded_fraction() * 100);
+        
+        ImGui::Separator();
+        
+        ImGui::Checkbox("Timelapse", &timelapse);
+        ImGui::SameLine();
+        ImGui::Checkbox("Whole Population", &timelapse_population);
+        ImGui::Text("Images written: %ld (%ld queued, %.1lfms stalled)", image_writer.written(), image_writer.queued(), image_writer.stalled_ms());
+        
+        static char checkpoint_file[256] = "checkpoint.igck";
+        static int checkpoint_interval = 0;
+        ImGui::InputText("Checkpoint", checkpoint_file, sizeof(checkpoint_file));
+        // checkpoints read and replace the population, so they are only made or loaded between generations
+        if (ImGui::Button("Save Checkpoint"))
+            scheduler.post([path = std::string(checkpoint_file)]() { save_checkpoint(path); });
+        ImGui::SameLine();
+        if (ImGui::Button("Load Checkpoint"))
+            scheduler.post([path = std::string(checkpoint_file)]() { load_checkpoint(path); });
+        if (ImGui::InputInt("Checkpoint Every", &checkpoint_interval))
+        {
+            checkpoint_interval = std::max(checkpoint_interval, 0);
+            scheduler.post([path = std::string(checkpoint_file), interval = static_cast<blt::size_t>(checkpoint_interval)]() {
+                checkpoint_path = path;
+                checkpoint_every = interval;
+            });
+        }
+        
+        static bool sharing = false;
+        if (ImGui::Checkbox("Share View", &sharing))
+        {
+            // snapshots are published from the gp thread, so the segment is only created or removed between generations
+            if (sharing)
+                scheduler.post([]() { share_view(view_name, true); });
+            else
+                scheduler.post([]() { shared_view.close(); });
+        }
+        
+        // the gp thread renders the images of the new page, they only show up once it has published them
+        if (draw_page_controls(snapshot))
+            scheduler.post([page = static_cast<blt::size_t>(page)]() { show_page(page); });
+        
+        draw_stats(snapshot);
         ImGui::End();
     }
+    // the profile is gathered by the gp thread, an attached viewer has nothing to show
+    if (!attached)
+        draw_operator_profile();
     
     const auto mouse_pos = blt::make_vec2(blt::gfx::calculateRay2D(data.width, data.height, global_matrices.getScale2D(), global_matrices.getView2D(),
                                                                    global_matrices.getOrtho()));
     
-    for (blt::size_t i = 0; i < program.get_current_pop().get_individuals().size(); i++)
+    for (blt::size_t i = 0; i < snapshot.count; i++)
     {
-        auto& ind = program.get_current_pop().get_individuals()[i];
         auto ctx = get_pop_ctx(i);
         float x = ctx.x * IMAGE_SIZE + ctx.x * IMAGE_PADDING;
         float y = ctx.y * IMAGE_SIZE + ctx.y * IMAGE_PADDING;
@@ -467,29 +675,33 @@ void update(const blt::gfx::window_data& data)
             if (io.WantCaptureMouse)
                 continue;
             
-            hovered_fitness = ind.fitness.adjusted_fitness;
+            hovered_fitness = snapshot.adjusted_fitness[i];
             
             if (blt::gfx::isKeyPressed(GLFW_KEY_LEFT_SHIFT))
             {
                 if (blt::gfx::mousePressedLastFrame())
                 {
-                    std::cout << "Fitness: " << ind.fitness.adjusted_fitness << " " << ind.fitness.raw_fitness << " ";
-                    ind.tree.print(program, std::cout, false);
-                    std::cout << std::endl;
+                    if (attached)
+                        viewer.send({view_command_type_t::SAVE_TREE, static_cast<blt::u32>(snapshot.first + i)});
+                    else
+                        save_individual(snapshot.first + i);
                 }
             } else
             {
                 if (blt::gfx::mousePressedLastFrame() || (blt::gfx::isKeyPressed(GLFW_KEY_F) && blt::gfx::keyPressedLastFrame()))
                 {
-                    fitness_values[i] = last_fitness;
-                    last_fitness += 1;
+                    if (attached)
+                        viewer.send({view_command_type_t::MARK, static_cast<blt::u32>(snapshot.first + i)});
+                    else
+                        scheduler.post([index = snapshot.first + i]() { mark_individual(index); });
                 }
             }
             
-            hovered_fitness_value = fitness_values[i];
+            // fitness_values belongs to the gp thread, marks only show up once the next snapshot is published
+            hovered_fitness_value = snapshot.user_fitness[i];
         }
         
-        auto val = static_cast<float>(ind.fitness.adjusted_fitness);
+        auto val = static_cast<float>(snapshot.adjusted_fitness[i]);
         renderer_2d.drawRectangleInternal(
                 blt::make_color(val, val, val),
                 {x, y, IMAGE_SIZE + IMAGE_PADDING / 2.0f, IMAGE_SIZE + IMAGE_PADDING / 2.0f},
@@ -509,8 +721,42 @@ void update(const blt::gfx::window_data& data)
     renderer_2d.render(data.width, data.height);
 }
 
-int main()
+// image-gp-6 render <tree> <size> <output.png> [threads]
+int render_command(int argc, char** argv)
 {
+    if (argc < 5)
+    {
+        BLT_WARN("Usage: %s render <tree> <size> <output.png> [threads]", argv[0]);
+        return 1;
+    }
+    setup_operators();
+    
+    auto tree = load_tree(argv[2]);
+    if (!tree)
+        return 1;
+    auto size = static_cast<blt::size_t>(std::stoull(argv[3]));
+    auto threads = argc > 5 ? static_cast<blt::size_t>(std::stoull(argv[5])) : 0ul;
+    
+    return render_large(*tree, size, argv[4], threads).success ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && std::string_view(argv[1]) == "render")
+        return render_command(argc, argv);
+    // image-gp-6 attach [name], watches a gp process which is sharing its view. closing the window leaves that process running
+    if (argc > 1 && std::string_view(argv[1]) == "attach")
+    {
+        if (argc > 2)
+            view_name = argv[2];
+        if (!viewer.attach(view_name))
+            return 1;
+        attached = true;
+    }
+    // image-gp-6 resume <checkpoint>, carries on from a checkpoint instead of a fresh population
+    if (argc > 2 && std::string_view(argv[1]) == "resume")
+        resume_checkpoint = argv[2];
+    
     // reset all fitness values.
     for (auto& v : fitness_values)
         v = -1;
@@ -520,21 +766,36 @@ int main()
     renderer_2d.cleanup();
     blt::gfx::cleanup();
     
+    if (attached)
+    {
+        program.kill();
+        return 0;
+    }
+    
     BLT_END_INTERVAL("Image Test", "Main");
     
-    base_image.save("input.png");
+    image_writer.submit("input.png", full_target().image);
+    // only loaded on a cold start
     full_base_image.save("full_input.png");
     
-    auto v = get_fractal_value(base_image);
-    BLT_INFO("Base image values per channel: %lf", v.total);
+    BLT_INFO("Base image values per channel: %lf", full_target().fractal.total);
     
     BLT_PRINT_PROFILE("Image Test", blt::PRINT_CYCLES | blt::PRINT_THREAD | blt::PRINT_WALL);
     BLT_PRINT_PROFILE("Mutation", blt::PRINT_CYCLES | blt::PRINT_THREAD | blt::PRINT_WALL | blt::AVERAGE_HISTORY);
     
-    is_running = false;
+    scheduler.stop();
     program.kill();
     if (gp_thread->joinable())
         gp_thread->join();
+    shared_view.close();
+    eval_farm.stop();
+    // a trace still running when the window closes covers the end of the run
+    if (tracer.enabled())
+        tracer.write("trace.json");
+    
+    // anything still queued (the last timelapse frames and checkpoint) has to reach the disk before exit
+    image_writer.flush();
+    flush_checkpoints();
     
     return 0;
 }
\ No newline at end of file
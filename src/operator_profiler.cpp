@@ -0,0 +1,216 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <operator_profiler.h>
+#include <blt/std/logging.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <fstream>
+
+namespace
+{
+    // written only by the owning thread, atomics so the merge can read them while nothing is rendering without it being a race
+    struct thread_counters_t
+    {
+        std::array<std::atomic_uint64_t, MAX_PROFILED_OPERATORS> calls{};
+        std::array<std::atomic_uint64_t, MAX_PROFILED_OPERATORS> ns{};
+        std::array<std::atomic_uint64_t, MAX_PROFILED_OPERATORS * PROFILE_BUCKETS> histogram{};
+        
+        thread_counters_t();
+        
+        ~thread_counters_t();
+    };
+    
+    struct registry_t
+    {
+        std::mutex mutex;
+        std::vector<std::string> names;
+        std::vector<thread_counters_t*> live;
+        // what threads which have since exited counted, the pools rendering individuals are started fresh every generation
+        std::vector<blt::u64> retired_calls = std::vector<blt::u64>(MAX_PROFILED_OPERATORS);
+        std::vector<blt::u64> retired_ns = std::vector<blt::u64>(MAX_PROFILED_OPERATORS);
+        std::vector<blt::u64> retired_histogram = std::vector<blt::u64>(MAX_PROFILED_OPERATORS * PROFILE_BUCKETS);
+    };
+    
+    // operators register while the program's globals are constructed, so the registry can't be a global itself
+    registry_t& registry()
+    {
+        static registry_t instance;
+        return instance;
+    }
+    
+    thread_counters_t::thread_counters_t()
+    {
+        auto& reg = registry();
+        std::scoped_lock lock(reg.mutex);
+        reg.live.push_back(this);
+    }
+    
+    thread_counters_t::~thread_counters_t()
+    {
+        auto& reg = registry();
+        std::scoped_lock lock(reg.mutex);
+        for (blt::size_t i = 0; i < MAX_PROFILED_OPERATORS; i++)
+        {
+            reg.retired_calls[i] += calls[i].load(std::memory_order_relaxed);
+            reg.retired_ns[i] += ns[i].load(std::memory_order_relaxed);
+        }
+        for (blt::size_t i = 0; i < histogram.size(); i++)
+            reg.retired_histogram[i] += histogram[i].load(std::memory_order_relaxed);
+        reg.live.erase(std::remove(reg.live.begin(), reg.live.end(), this), reg.live.end());
+    }
+    
+    void bump(std::atomic_uint64_t& counter, blt::u64 amount)
+    {
+        // only the owning thread writes, so a plain load and store is enough and avoids a locked add on the hot path
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+    
+    blt::size_t bucket_of(blt::u64 ns)
+    {
+        if (ns < 4)
+            return ns;
+        const auto msb = static_cast<blt::size_t>(63 - __builtin_clzll(ns));
+        const auto quarter = static_cast<blt::size_t>((ns >> (msb - 2)) & 3);
+        return std::min(msb * 4 + quarter, PROFILE_BUCKETS - 1);
+    }
+    
+    blt::u64 bucket_upper_edge(blt::size_t bucket)
+    {
+        if (bucket < 4)
+            return bucket + 1;
+        return (4 + bucket % 4 + 1) << (bucket / 4 - 2);
+    }
+    
+    blt::u64 percentile(const blt::u64* histogram, blt::u64 calls, double fraction)
+    {
+        const auto wanted = std::max(static_cast<blt::u64>(static_cast<double>(calls) * fraction), blt::u64{1});
+        blt::u64 seen = 0;
+        for (blt::size_t bucket = 0; bucket < PROFILE_BUCKETS; bucket++)
+        {
+            seen += histogram[bucket];
+            if (seen >= wanted)
+                return bucket_upper_edge(bucket);
+        }
+        return bucket_upper_edge(PROFILE_BUCKETS - 1);
+    }
+}
+
+blt::size_t operator_profiler_t::register_operator(const char* name)
+{
+    auto& reg = registry();
+    std::scoped_lock lock(reg.mutex);
+    if (reg.names.size() == MAX_PROFILED_OPERATORS)
+    {
+        BLT_WARN("More than %ld profiled operators, %s shares the last one's counters", MAX_PROFILED_OPERATORS, name);
+        return MAX_PROFILED_OPERATORS - 1;
+    }
+    reg.names.emplace_back(name);
+    return reg.names.size() - 1;
+}
+
+void operator_profiler_t::record(blt::size_t slot, blt::u64 ns)
+{
+    thread_local thread_counters_t counters;
+    bump(counters.calls[slot], 1);
+    bump(counters.ns[slot], ns);
+    bump(counters.histogram[slot * PROFILE_BUCKETS + bucket_of(ns)], 1);
+}
+
+void operator_profiler_t::finish_generation(blt::size_t generation)
+{
+    if constexpr (!compiled_in())
+        return;
+    
+    std::vector<blt::u64> calls;
+    std::vector<blt::u64> ns;
+    std::vector<blt::u64> histogram;
+    std::vector<std::string> names;
+    {
+        auto& reg = registry();
+        std::scoped_lock lock(reg.mutex);
+        names = reg.names;
+        calls = reg.retired_calls;
+        ns = reg.retired_ns;
+        histogram = reg.retired_histogram;
+        for (const auto* counters : reg.live)
+        {
+            for (blt::size_t i = 0; i < MAX_PROFILED_OPERATORS; i++)
+            {
+                calls[i] += counters->calls[i].load(std::memory_order_relaxed);
+                ns[i] += counters->ns[i].load(std::memory_order_relaxed);
+            }
+            for (blt::size_t i = 0; i < histogram.size(); i++)
+                histogram[i] += counters->histogram[i].load(std::memory_order_relaxed);
+        }
+    }
+    
+    std::scoped_lock lock(mutex);
+    last_calls.resize(calls.size());
+    last_ns.resize(ns.size());
+    last_histogram.resize(histogram.size());
+    
+    rows.clear();
+    std::vector<blt::u64> generation_histogram(PROFILE_BUCKETS);
+    for (blt::size_t slot = 0; slot < names.size(); slot++)
+    {
+        const auto generation_calls = calls[slot] - last_calls[slot];
+        if (generation_calls == 0)
+            continue;
+        for (blt::size_t bucket = 0; bucket < PROFILE_BUCKETS; bucket++)
+        {
+            const auto index = slot * PROFILE_BUCKETS + bucket;
+            generation_histogram[bucket] = histogram[index] - last_histogram[index];
+        }
+        
+        operator_profile_row_t row;
+        row.name = names[slot];
+        row.calls = generation_calls;
+        row.total_ns = ns[slot] - last_ns[slot];
+        row.p50_ns = percentile(generation_histogram.data(), generation_calls, 0.5);
+        row.p99_ns = percentile(generation_histogram.data(), generation_calls, 0.99);
+        rows.push_back(std::move(row));
+    }
+    last_calls = std::move(calls);
+    last_ns = std::move(ns);
+    last_histogram = std::move(histogram);
+    
+    if (csv_path.empty())
+        return;
+    std::ofstream csv{csv_path, std::ios::app};
+    for (const auto& row : rows)
+        csv << generation << ',' << row.name << ',' << row.calls << ',' << static_cast<double>(row.total_ns) / 1e6 << ','
+            << static_cast<double>(row.total_ns) / static_cast<double>(row.calls) / 1e3 << ',' << static_cast<double>(row.p50_ns) / 1e3 << ','
+            << static_cast<double>(row.p99_ns) / 1e3 << '\n';
+}
+
+std::vector<operator_profile_row_t> operator_profiler_t::get_rows() const
+{
+    std::scoped_lock lock(mutex);
+    return rows;
+}
+
+void operator_profiler_t::set_csv(const std::string& path)
+{
+    std::scoped_lock lock(mutex);
+    csv_path = path;
+    if (path.empty())
+        return;
+    std::ofstream csv{path};
+    csv << "generation,operator,calls,total_ms,mean_us,p50_us,p99_us\n";
+}
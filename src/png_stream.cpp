@@ -0,0 +1,441 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <png_stream.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+// compressed bytes are emitted as an IDAT chunk whenever this much has built up
+static constexpr std::size_t IDAT_SIZE = 1 << 16;
+
+static void put_u32(std::uint8_t* out, std::uint32_t value)
+{
+    out[0] = static_cast<std::uint8_t>(value >> 24);
+    out[1] = static_cast<std::uint8_t>(value >> 16);
+    out[2] = static_cast<std::uint8_t>(value >> 8);
+    out[3] = static_cast<std::uint8_t>(value);
+}
+
+png_stream_t::png_stream_t(const std::string& path, std::uint32_t width, std::uint32_t height, int compression_level):
+        width(width), height(height), filtered_row(1 + static_cast<std::size_t>(width) * 3), output(IDAT_SIZE)
+{
+    file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr)
+        return;
+    
+    static constexpr std::uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    std::fwrite(signature, 1, sizeof(signature), file);
+    
+    std::uint8_t header[13]{};
+    put_u32(header, width);
+    put_u32(header + 4, height);
+    header[8] = 8;  // bit depth
+    header[9] = 2;  // truecolor
+    header[10] = 0; // deflate
+    header[11] = 0; // adaptive filtering
+    header[12] = 0; // no interlacing
+    write_chunk("IHDR", header, sizeof(header));
+    
+    if (deflateInit(&stream, compression_level) != Z_OK)
+        failed = true;
+    stream.next_out = output.data();
+    stream.avail_out = static_cast<uInt>(output.size());
+}
+
+void png_stream_t::write_row(const std::uint8_t* row)
+{
+    if (!good() || rows >= height)
+    {
+        failed = true;
+        return;
+    }
+    
+    // the sub filter is cheap and does well on the smooth gradients most trees produce
+    const std::size_t row_bytes = static_cast<std::size_t>(width) * 3;
+    filtered_row[0] = 1;
+    for (std::size_t i = 0; i < row_bytes; i++)
+        filtered_row[i + 1] = static_cast<std::uint8_t>(row[i] - (i >= 3 ? row[i - 3] : 0));
+    
+    stream.next_in = filtered_row.data();
+    stream.avail_in = static_cast<uInt>(filtered_row.size());
+    deflate_input(Z_NO_FLUSH);
+    rows++;
+}
+
+bool png_stream_t::finish()
+{
+    if (finished)
+        return good();
+    finished = true;
+    if (file == nullptr)
+        return false;
+    
+    if (!failed)
+    {
+        if (rows != height)
+            failed = true;
+        stream.next_in = nullptr;
+        stream.avail_in = 0;
+        deflate_input(Z_FINISH);
+        if (output.size() != stream.avail_out)
+            write_chunk("IDAT", output.data(), output.size() - stream.avail_out);
+        write_chunk("IEND", nullptr, 0);
+    }
+    deflateEnd(&stream);
+    
+    if (std::fclose(file) != 0)
+        failed = true;
+    file = nullptr;
+    return !failed;
+}
+
+png_stream_t::~png_stream_t()
+{
+    finish();
+}
+
+void png_stream_t::write_chunk(const char* type, const std::uint8_t* data, std::size_t size)
+{
+    std::uint8_t length[4];
+    put_u32(length, static_cast<std::uint32_t>(size));
+    std::fwrite(length, 1, 4, file);
+    std::fwrite(type, 1, 4, file);
+    if (size > 0)
+        std::fwrite(data, 1, size, file);
+    
+    auto crc = crc32(0, reinterpret_cast<const Bytef*>(type), 4);
+    if (size > 0)
+        crc = crc32(crc, data, static_cast<uInt>(size));
+    std::uint8_t crc_bytes[4];
+    put_u32(crc_bytes, static_cast<std::uint32_t>(crc));
+    if (std::fwrite(crc_bytes, 1, 4, file) != 4)
+        failed = true;
+}
+
+void png_stream_t::deflate_input(int flush)
+{
+    while (true)
+    {
+        auto result = deflate(&stream, flush);
+        if (result == Z_STREAM_ERROR)
+        {
+            failed = true;
+            return;
+        }
+        if (stream.avail_out == 0)
+        {
+            write_chunk("IDAT", output.data(), output.size());
+            stream.next_out = output.data();
+            stream.avail_out = static_cast<uInt>(output.size());
+            continue;
+        }
+        if (flush == Z_FINISH ? result == Z_STREAM_END : stream.avail_in == 0)
+            return;
+    }
+}
+
+static std::uint32_t get_u32(const std::uint8_t* in)
+{
+    return (static_cast<std::uint32_t>(in[0]) << 24) | (static_cast<std::uint32_t>(in[1]) << 16) | (static_cast<std::uint32_t>(in[2]) << 8) |
+           static_cast<std::uint32_t>(in[3]);
+}
+
+static std::uint8_t paeth(std::uint8_t a, std::uint8_t b, std::uint8_t c)
+{
+    int p = static_cast<int>(a) + static_cast<int>(b) - static_cast<int>(c);
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return a;
+    if (pb <= pc)
+        return b;
+    return c;
+}
+
+png_reader_t::png_reader_t(const std::string& path)
+{
+    file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return;
+    if (!read_header())
+    {
+        failed = true;
+        return;
+    }
+    
+    if (inflateInit(&stream) != Z_OK)
+    {
+        failed = true;
+        return;
+    }
+    stream_open = true;
+    current_row.resize(row_bytes + 1);
+    previous_row.assign(row_bytes + 1, 0);
+}
+
+bool png_reader_t::read_header()
+{
+    static constexpr std::uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    std::uint8_t buffer[8];
+    if (std::fread(buffer, 1, 8, file) != 8 || std::memcmp(buffer, signature, 8) != 0)
+        return false;
+    
+    std::uint8_t header[8 + 13 + 4];
+    if (std::fread(header, 1, sizeof(header), file) != sizeof(header) || std::memcmp(header + 4, "IHDR", 4) != 0)
+        return false;
+    width = get_u32(header + 8);
+    height = get_u32(header + 12);
+    bit_depth = header[16];
+    color_type = header[17];
+    const auto interlaced = header[20] != 0;
+    
+    std::size_t samples;
+    switch (color_type)
+    {
+        case 0:
+            samples = 1;
+            break;
+        case 2:
+            samples = 3;
+            break;
+        case 3:
+            samples = 1;
+            break;
+        case 4:
+            samples = 2;
+            break;
+        case 6:
+            samples = 4;
+            break;
+        default:
+            return false;
+    }
+    if (interlaced || width == 0 || height == 0 || (bit_depth != 8 && bit_depth != 16) || (color_type == 3 && bit_depth != 8))
+        return false;
+    pixel_bytes = samples * bit_depth / 8;
+    row_bytes = pixel_bytes * width;
+    return true;
+}
+
+bool png_reader_t::next_idat()
+{
+    while (true)
+    {
+        std::uint8_t chunk[8];
+        if (std::fread(chunk, 1, 8, file) != 8)
+            return false;
+        const auto length = get_u32(chunk);
+        
+        if (std::memcmp(chunk + 4, "IDAT", 4) == 0)
+        {
+            input.resize(length);
+            if (std::fread(input.data(), 1, length, file) != length || std::fseek(file, 4, SEEK_CUR) != 0)
+                return false;
+            stream.next_in = input.data();
+            stream.avail_in = static_cast<uInt>(length);
+            return true;
+        }
+        if (std::memcmp(chunk + 4, "IEND", 4) == 0)
+            return false;
+        if (std::memcmp(chunk + 4, "PLTE", 4) == 0)
+        {
+            palette.resize(length);
+            if (std::fread(palette.data(), 1, length, file) != length || std::fseek(file, 4, SEEK_CUR) != 0)
+                return false;
+            continue;
+        }
+        // every other chunk is ancillary as far as we're concerned
+        if (std::fseek(file, static_cast<long>(length) + 4, SEEK_CUR) != 0)
+            return false;
+    }
+}
+
+const std::uint8_t* png_reader_t::read_row()
+{
+    if (!good() || rows >= height)
+        return nullptr;
+    
+    std::swap(current_row, previous_row);
+    stream.next_out = current_row.data();
+    stream.avail_out = static_cast<uInt>(current_row.size());
+    while (stream.avail_out > 0)
+    {
+        if (stream.avail_in == 0 && !next_idat())
+        {
+            failed = true;
+            return nullptr;
+        }
+        auto result = inflate(&stream, Z_NO_FLUSH);
+        if (result == Z_STREAM_END && stream.avail_out > 0)
+            result = Z_DATA_ERROR;
+        if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+        {
+            failed = true;
+            return nullptr;
+        }
+    }
+    
+    auto* row = current_row.data() + 1;
+    const auto* prior = previous_row.data() + 1;
+    // the row before the first is defined to be all zeros
+    if (rows == 0)
+        std::fill(previous_row.begin(), previous_row.end(), 0);
+    switch (current_row[0])
+    {
+        case 0:
+            break;
+        case 1:
+            for (std::size_t i = pixel_bytes; i < row_bytes; i++)
+                row[i] = static_cast<std::uint8_t>(row[i] + row[i - pixel_bytes]);
+            break;
+        case 2:
+            for (std::size_t i = 0; i < row_bytes; i++)
+                row[i] = static_cast<std::uint8_t>(row[i] + prior[i]);
+            break;
+        case 3:
+            for (std::size_t i = 0; i < row_bytes; i++)
+            {
+                const int left = i >= pixel_bytes ? row[i - pixel_bytes] : 0;
+                row[i] = static_cast<std::uint8_t>(row[i] + ((left + prior[i]) >> 1));
+            }
+            break;
+        case 4:
+            for (std::size_t i = 0; i < row_bytes; i++)
+            {
+                const auto left = i >= pixel_bytes ? row[i - pixel_bytes] : 0;
+                const auto up_left = i >= pixel_bytes ? prior[i - pixel_bytes] : 0;
+                row[i] = static_cast<std::uint8_t>(row[i] + paeth(left, prior[i], up_left));
+            }
+            break;
+        default:
+            failed = true;
+            return nullptr;
+    }
+    rows++;
+    return row;
+}
+
+void png_reader_t::to_rgb(const std::uint8_t* row, float* rgb) const
+{
+    const auto sample = [this, row](std::size_t pixel, std::size_t channel) -> float {
+        if (bit_depth == 16)
+        {
+            const auto* at = row + pixel * pixel_bytes + channel * 2;
+            return static_cast<float>((at[0] << 8) | at[1]) / 65535.0f;
+        }
+        return static_cast<float>(row[pixel * pixel_bytes + channel]) / 255.0f;
+    };
+    
+    for (std::size_t x = 0; x < width; x++)
+    {
+        switch (color_type)
+        {
+            case 0:
+            case 4:
+                rgb[x * 3] = rgb[x * 3 + 1] = rgb[x * 3 + 2] = sample(x, 0);
+                break;
+            case 3:
+            {
+                const std::size_t entry = row[x] * 3u;
+                for (std::size_t c = 0; c < 3; c++)
+                    rgb[x * 3 + c] = entry + c < palette.size() ? static_cast<float>(palette[entry + c]) / 255.0f : 0.0f;
+                break;
+            }
+            default:
+                for (std::size_t c = 0; c < 3; c++)
+                    rgb[x * 3 + c] = sample(x, c);
+                break;
+        }
+    }
+}
+
+png_reader_t::~png_reader_t()
+{
+    if (stream_open)
+        inflateEnd(&stream);
+    if (file != nullptr)
+        std::fclose(file);
+}
+
+float* load_png_scaled(const std::string& path, int divisor, int min_size, int& width, int& height)
+{
+    png_reader_t reader{path};
+    if (!reader.good())
+        return nullptr;
+    
+    const auto source_width = static_cast<std::size_t>(reader.get_width());
+    const auto source_height = static_cast<std::size_t>(reader.get_height());
+    const auto out_width = static_cast<std::size_t>(std::max(static_cast<int>(source_width) / divisor, min_size));
+    const auto out_height = static_cast<std::size_t>(std::max(static_cast<int>(source_height) / divisor, min_size));
+    if (out_width > source_width || out_height > source_height)
+        return nullptr;
+    
+    // every source pixel lands in exactly one output pixel, which is a box filter when downsampling
+    std::vector<std::size_t> column_bin(source_width);
+    std::vector<std::size_t> column_count(out_width, 0);
+    for (std::size_t x = 0; x < source_width; x++)
+    {
+        column_bin[x] = x * out_width / source_width;
+        column_count[column_bin[x]]++;
+    }
+    
+    auto* data = static_cast<float*>(std::malloc(out_width * out_height * 3 * sizeof(float)));
+    if (data == nullptr)
+        return nullptr;
+    std::vector<float> rgb(source_width * 3);
+    std::vector<double> sums(out_width * 3, 0.0);
+    std::size_t rows_in_bin = 0;
+    
+    for (std::size_t y = 0; y < source_height; y++)
+    {
+        const auto* row = reader.read_row();
+        if (row == nullptr)
+        {
+            std::free(data);
+            return nullptr;
+        }
+        reader.to_rgb(row, rgb.data());
+        for (std::size_t x = 0; x < source_width; x++)
+        {
+            for (std::size_t c = 0; c < 3; c++)
+                // matches the 2.2 gamma stbi_loadf applies to low dynamic range images
+                sums[column_bin[x] * 3 + c] += std::pow(rgb[x * 3 + c], 2.2f);
+        }
+        rows_in_bin++;
+        
+        const auto bin = y * out_height / source_height;
+        if (y + 1 == source_height || (y + 1) * out_height / source_height != bin)
+        {
+            auto* out = data + bin * out_width * 3;
+            for (std::size_t x = 0; x < out_width; x++)
+            {
+                const auto count = static_cast<double>(column_count[x] * rows_in_bin);
+                for (std::size_t c = 0; c < 3; c++)
+                    out[x * 3 + c] = static_cast<float>(sums[x * 3 + c] / count);
+            }
+            std::fill(sums.begin(), sums.end(), 0.0);
+            rows_in_bin = 0;
+        }
+    }
+    
+    width = static_cast<int>(out_width);
+    height = static_cast<int>(out_height);
+    return data;
+}
@@ -0,0 +1,134 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <render.h>
+#include <tiles.h>
+#include <parallel.h>
+#include <png_stream.h>
+#include <blt/std/logging.h>
+#include <blt/std/time.h>
+#include <future>
+
+static constexpr blt::size_t MAX_RENDER_HALO = (IMAGE_SIZE - MIN_RENDER_TILE) / 2;
+
+static blt::size_t halo_at(blt::gp::tree_t& tree, eval_region_t region, float kernel_scale)
+{
+    region.kernel_scale = kernel_scale;
+    return tree_halo(tree, region);
+}
+
+// kernels grow with the output, but a tile plus its halo has to fit in a single image. finds the smallest kernel_scale (largest kernels)
+// which still leaves room for a useful tile.
+static float fit_kernel_scale(blt::gp::tree_t& tree, const eval_region_t& region)
+{
+    if (halo_at(tree, region, region.kernel_scale) <= MAX_RENDER_HALO)
+        return region.kernel_scale;
+    
+    float low = region.kernel_scale;
+    float high = 1;
+    while (halo_at(tree, region, high) > MAX_RENDER_HALO)
+    {
+        low = high;
+        high *= 2;
+    }
+    for (blt::size_t i = 0; i < 16; i++)
+    {
+        auto mid = (low + high) / 2;
+        if (halo_at(tree, region, mid) > MAX_RENDER_HALO)
+            low = mid;
+        else
+            high = mid;
+    }
+    return high;
+}
+
+static blt::u8 quantize(float value)
+{
+    if (!(value > 0))
+        return 0;
+    if (value >= 1)
+        return std::numeric_limits<blt::u8>::max();
+    return static_cast<blt::u8>(value * std::numeric_limits<blt::u8>::max());
+}
+
+render_stats_t render_large(blt::gp::tree_t& tree, blt::size_t size, const std::string& path, blt::size_t threads)
+{
+    render_stats_t stats;
+    stats.size = size;
+    auto start = blt::system::getCurrentTimeNanoseconds();
+    
+    auto region = eval_region_t::for_resolution(size);
+    region.kernel_scale = fit_kernel_scale(tree, region);
+    stats.kernel_scale = region.kernel_scale;
+    stats.halo = tree_halo(tree, region);
+    stats.tile_size = IMAGE_SIZE - stats.halo * 2;
+    if (region.kernel_scale != region.scale)
+    {
+        stats.shrunk_kernels = count_shrunk_kernels(tree, region);
+        BLT_WARN("Kernels are too large to tile at %ldx%ld, %ld operators are rendered with kernels %f of their full size. The output "
+                 "won't match the tree exactly", size, size, stats.shrunk_kernels, region.scale / region.kernel_scale);
+    }
+    
+    png_stream_t png{path, static_cast<std::uint32_t>(size), static_cast<std::uint32_t>(size)};
+    if (!png.good())
+    {
+        BLT_WARN("Unable to open %s for writing!", path.c_str());
+        return stats;
+    }
+    
+    const auto tile_size = stats.tile_size;
+    const auto tiles_x = (size + tile_size - 1) / tile_size;
+    const auto bands = (size + tile_size - 1) / tile_size;
+    
+    std::vector<float> band(size * tile_size * CHANNELS);
+    // one band is compressed while the next is rendered
+    std::array<std::vector<blt::u8>, 2> encoded{std::vector<blt::u8>(band.size()), std::vector<blt::u8>(band.size())};
+    std::future<void> pending;
+    
+    for (blt::size_t band_index = 0; band_index < bands; band_index++)
+    {
+        const auto band_y = band_index * tile_size;
+        const auto band_height = std::min(tile_size, size - band_y);
+        parallel_for(tiles_x, [&](blt::size_t i) {
+            tile_t tile{};
+            tile.x = i * tile_size;
+            tile.y = band_y;
+            tile.width = std::min(tile_size, size - tile.x);
+            tile.height = band_height;
+            render_tile(tree, region, stats.halo, tile, band.data() + tile.x * CHANNELS, size);
+        }, threads);
+        
+        auto& out = encoded[band_index % 2];
+        for (blt::size_t i = 0; i < band_height * size * CHANNELS; i++)
+            out[i] = quantize(band[i]);
+        
+        if (pending.valid())
+            pending.get();
+        pending = std::async(std::launch::async, [&png, &out, band_height, size]() {
+            for (blt::size_t y = 0; y < band_height; y++)
+                png.write_row(out.data() + y * size * CHANNELS);
+        });
+    }
+    if (pending.valid())
+        pending.get();
+    
+    stats.success = png.finish();
+    stats.seconds = static_cast<double>(blt::system::getCurrentTimeNanoseconds() - start) / 1e9;
+    BLT_INFO("Rendered %ldx%ld to %s in %lfs (%lf MP/s, %ld px tiles, %ld px halo)", size, size, path.c_str(), stats.seconds,
+             stats.megapixels_per_second(), stats.tile_size, stats.halo);
+    return stats;
+}
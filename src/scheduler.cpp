@@ -0,0 +1,177 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <scheduler.h>
+#include <algorithm>
+
+void generation_scheduler_t::set_mode(run_mode_t new_mode, blt::size_t count, double fitness)
+{
+    {
+        std::scoped_lock lock(mutex);
+        mode = new_mode;
+        remaining = count;
+        target_fitness = fitness;
+    }
+    wake.notify_all();
+    idle.notify_all();
+}
+
+void generation_scheduler_t::pause()
+{
+    set_mode(run_mode_t::PAUSED);
+}
+
+void generation_scheduler_t::step()
+{
+    set_mode(run_mode_t::STEP, 1);
+}
+
+void generation_scheduler_t::run()
+{
+    set_mode(run_mode_t::RUN);
+}
+
+void generation_scheduler_t::run_n(blt::size_t count)
+{
+    set_mode(count == 0 ? run_mode_t::PAUSED : run_mode_t::RUN_N, count);
+}
+
+void generation_scheduler_t::run_until_fitness(double fitness)
+{
+    set_mode(run_mode_t::RUN_UNTIL_FITNESS, 0, fitness);
+}
+
+void generation_scheduler_t::post(std::function<void()> task)
+{
+    {
+        std::scoped_lock lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    wake.notify_all();
+}
+
+void generation_scheduler_t::stop()
+{
+    {
+        std::scoped_lock lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    idle.notify_all();
+}
+
+void generation_scheduler_t::wait_idle()
+{
+    std::unique_lock lock(mutex);
+    idle.wait(lock, [this]() { return stopping || (mode == run_mode_t::PAUSED && tasks.empty() && !busy); });
+}
+
+void generation_scheduler_t::set_min_interval(std::chrono::milliseconds interval)
+{
+    {
+        std::scoped_lock lock(mutex);
+        min_interval = interval;
+    }
+    wake.notify_all();
+}
+
+blt::size_t generation_scheduler_t::on_generation(std::function<void(blt::size_t)> hook)
+{
+    std::scoped_lock lock(mutex);
+    hooks.emplace_back(next_hook, std::move(hook));
+    return next_hook++;
+}
+
+void generation_scheduler_t::remove_hook(blt::size_t id)
+{
+    std::scoped_lock lock(mutex);
+    hooks.erase(std::remove_if(hooks.begin(), hooks.end(), [id](const auto& hook) { return hook.first == id; }), hooks.end());
+}
+
+void generation_scheduler_t::run_loop(const std::function<void()>& run_generation, const std::function<double()>& best_fitness)
+{
+    std::unique_lock lock(mutex);
+    while (true)
+    {
+        wake.wait(lock, [this]() { return has_work(); });
+        if (stopping)
+            break;
+        
+        if (!tasks.empty())
+        {
+            auto task = std::move(tasks.front());
+            tasks.pop_front();
+            busy = true;
+            lock.unlock();
+            task();
+            lock.lock();
+            busy = false;
+            idle.notify_all();
+            continue;
+        }
+        if (mode == run_mode_t::PAUSED)
+            continue;
+        
+        // pacing sleeps on the same condition variable, so pausing or stopping still takes effect straight away
+        const auto next_start = last_start + min_interval;
+        if (min_interval.count() > 0 && clock::now() < next_start)
+        {
+            wake.wait_until(lock, next_start, [this]() { return stopping || !tasks.empty() || mode == run_mode_t::PAUSED; });
+            continue;
+        }
+        
+        last_start = clock::now();
+        busy = true;
+        lock.unlock();
+        run_generation();
+        const auto fitness = best_fitness();
+        lock.lock();
+        generations++;
+        
+        switch (mode)
+        {
+            case run_mode_t::STEP:
+                mode = run_mode_t::PAUSED;
+                break;
+            case run_mode_t::RUN_N:
+                if (remaining > 0)
+                    remaining--;
+                if (remaining == 0)
+                    mode = run_mode_t::PAUSED;
+                break;
+            case run_mode_t::RUN_UNTIL_FITNESS:
+                if (fitness >= target_fitness)
+                    mode = run_mode_t::PAUSED;
+                break;
+            case run_mode_t::PAUSED:
+            case run_mode_t::RUN:
+                break;
+        }
+        
+        const auto generation = generations;
+        auto current_hooks = hooks;
+        lock.unlock();
+        for (auto& [id, hook] : current_hooks)
+            hook(generation);
+        lock.lock();
+        // only idle once the hooks are done, wait_idle callers often own what the hooks write to
+        busy = false;
+        idle.notify_all();
+    }
+    busy = false;
+    idle.notify_all();
+}
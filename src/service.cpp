@@ -0,0 +1,484 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <gp_system.h>
+#include <job.h>
+#include <farm.h>
+#include <scheduler.h>
+#include <blt/std/logging.h>
+#include <atomic>
+#include <condition_variable>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// a long running process which evolves one target after another. the operators, the target cache and the thread pool stay alive between
+// jobs, so a job only pays for loading its target (nothing at all if the last job used the same one).
+//
+//  image-gp-6-service serve                        listens on $IMAGE_GP_SOCKET, seed, threads and population size come from the environment
+//  image-gp-6-service submit <target> [key=value]  queues a job and prints its progress until it is done, keys are the ones in job.h
+//  image-gp-6-service status                       lists the running and queued jobs
+//
+// the protocol is plain text lines. a client sends key = value lines followed by 'run' (or just 'status'), the service answers with
+//  queued <id> <position>
+//  started <id>
+//  generation <id> <n> <total> <best fitness> <average fitness> <milliseconds>
+//  done <id> <generations> <best fitness> <seconds> <output>
+//  failed <id> <reason>
+
+static const std::string socket_path = std::getenv("IMAGE_GP_SOCKET") != nullptr ? std::getenv("IMAGE_GP_SOCKET") : "/tmp/image-gp-6.sock";
+
+static bool send_line(int fd, const std::string& line)
+{
+    auto message = line + '\n';
+    blt::size_t sent = 0;
+    while (sent < message.size())
+    {
+        auto written = send(fd, message.data() + sent, message.size() - sent, MSG_NOSIGNAL);
+        if (written <= 0)
+            return false;
+        sent += static_cast<blt::size_t>(written);
+    }
+    return true;
+}
+
+// reads a line at a time from a socket, false once the other end has closed it
+class line_reader_t
+{
+    public:
+        explicit line_reader_t(int fd): fd(fd)
+        {}
+        
+        bool next(std::string& line)
+        {
+            while (true)
+            {
+                auto newline = buffer.find('\n');
+                if (newline != std::string::npos)
+                {
+                    line = buffer.substr(0, newline);
+                    buffer.erase(0, newline + 1);
+                    return true;
+                }
+                char chunk[4096];
+                auto received = recv(fd, chunk, sizeof(chunk), 0);
+                if (received <= 0)
+                    return false;
+                buffer.append(chunk, static_cast<blt::size_t>(received));
+            }
+        }
+    
+    private:
+        int fd;
+        std::string buffer;
+};
+
+static int connect_to_service()
+{
+    auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        BLT_WARN("Unable to connect to the service at %s, is 'image-gp-6-service serve' running?", socket_path.c_str());
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+struct job_t
+{
+    blt::size_t id = 0;
+    int fd = -1;
+    run_config_t config;
+    std::atomic_bool cancelled = false;
+    
+    std::mutex mutex;
+    std::condition_variable finished_cv;
+    bool finished = false;
+    // read by status requests while the job runs
+    std::atomic_uint64_t generation = 0;
+    
+    // a client which has gone away cancels its job
+    void send(const std::string& line)
+    {
+        std::scoped_lock lock(mutex);
+        if (!send_line(fd, line))
+            cancelled = true;
+    }
+    
+    void finish(const std::string& line)
+    {
+        send(line);
+        {
+            std::scoped_lock lock(mutex);
+            finished = true;
+        }
+        finished_cv.notify_all();
+    }
+    
+    void wait()
+    {
+        std::unique_lock lock(mutex);
+        finished_cv.wait(lock, [this]() { return finished; });
+    }
+};
+
+// jobs run one at a time in the order they arrive, each one gets the whole thread pool rather than several jobs fighting over it
+class job_queue_t
+{
+    public:
+        // returns the number of jobs ahead of this one, or nothing once the queue is closed since no thread will ever run it
+        std::optional<blt::size_t> push(std::shared_ptr<job_t> job)
+        {
+            std::scoped_lock lock(mutex);
+            if (closed)
+                return {};
+            job->id = next_id++;
+            jobs.push_back(std::move(job));
+            const auto position = jobs.size() - 1 + (running != nullptr ? 1 : 0);
+            available.notify_one();
+            return position;
+        }
+        
+        // blocks until there is a job, nullptr once the queue is closed
+        std::shared_ptr<job_t> pop()
+        {
+            std::unique_lock lock(mutex);
+            running = nullptr;
+            available.wait(lock, [this]() { return closed || !jobs.empty(); });
+            if (closed)
+                return nullptr;
+            running = std::move(jobs.front());
+            jobs.pop_front();
+            return running;
+        }
+        
+        std::vector<std::string> describe()
+        {
+            std::scoped_lock lock(mutex);
+            std::vector<std::string> lines;
+            if (running != nullptr)
+                lines.push_back("running " + std::to_string(running->id) + " " + std::to_string(running->generation.load()) + " " +
+                                std::to_string(running->config.generations) + " " + running->config.target);
+            for (const auto& job : jobs)
+                lines.push_back("queued " + std::to_string(job->id) + " " + std::to_string(job->config.generations) + " " + job->config.target);
+            return lines;
+        }
+        
+        // jobs which never started are handed back so their clients can be told
+        std::deque<std::shared_ptr<job_t>> close()
+        {
+            std::scoped_lock lock(mutex);
+            closed = true;
+            available.notify_all();
+            if (running != nullptr)
+                running->cancelled = true;
+            return std::move(jobs);
+        }
+    
+    private:
+        std::mutex mutex;
+        std::condition_variable available;
+        std::deque<std::shared_ptr<job_t>> jobs;
+        std::shared_ptr<job_t> running = nullptr;
+        blt::size_t next_id = 1;
+        bool closed = false;
+};
+
+static job_queue_t job_queue;
+static std::atomic_int listen_fd = -1;
+
+// connection threads are detached, shutdown waits for them through this count
+static std::mutex connection_mutex;
+static std::condition_variable connection_cv;
+static blt::size_t active_connections = 0;
+
+static void handle_connection(int fd, const run_config_t& defaults)
+{
+    // a client which connects and never finishes its request would otherwise hold this thread forever
+    timeval timeout{5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    
+    auto job = std::make_shared<job_t>();
+    job->fd = fd;
+    job->config = defaults;
+    
+    line_reader_t reader{fd};
+    std::string line;
+    bool run = false;
+    while (!run && reader.next(line))
+    {
+        auto equals = line.find('=');
+        if (line == "run")
+            run = true;
+        else if (line == "status")
+        {
+            for (const auto& description : job_queue.describe())
+                send_line(fd, description);
+            break;
+        } else if (equals != std::string::npos)
+        {
+            std::string error;
+            auto key = line.substr(0, equals);
+            key.erase(key.find_last_not_of(' ') + 1);
+            auto value = line.substr(equals + 1);
+            value.erase(0, value.find_first_not_of(' '));
+            if (key == "seed" || key == "threads" || key == "population")
+                error = key + " is fixed when the service starts";
+            else if (key == "share")
+                error = "sharing is not supported by the service";
+            else if (key == "scaling" || key == "population_scaling")
+                error = "scaling benchmarks only run headless";
+            else
+                set_config_value(job->config, key, value, error);
+            if (!error.empty())
+            {
+                send_line(fd, "failed 0 " + error);
+                break;
+            }
+        }
+    }
+    
+    if (run)
+    {
+        {
+            // held so the job can't report that it started before the client hears it was queued
+            std::scoped_lock lock(job->mutex);
+            auto position = job_queue.push(job);
+            if (!position)
+                send_line(fd, "failed 0 the service is shutting down");
+            else if (!send_line(fd, "queued " + std::to_string(job->id) + " " + std::to_string(*position)))
+                job->cancelled = true;
+            run = position.has_value();
+        }
+        if (run)
+            job->wait();
+    }
+    close(fd);
+    
+    {
+        std::scoped_lock lock(connection_mutex);
+        active_connections--;
+    }
+    connection_cv.notify_all();
+}
+
+static void run_jobs()
+{
+    while (auto job = job_queue.pop())
+    {
+        const auto id = std::to_string(job->id);
+        if (job->cancelled)
+        {
+            job->finish("failed " + id + " cancelled");
+            continue;
+        }
+        BLT_INFO("Starting job %s: %s for %ld generations", id.c_str(), job->config.target.c_str(), job->config.generations);
+        job->send("started " + id);
+        
+        auto result = run_job(job->config, [&job, &id](const job_progress_t& progress) {
+            job->generation = progress.generation;
+            std::ostringstream line;
+            line << "generation " << id << ' ' << progress.generation << ' ' << progress.generations << ' ' << progress.best_fitness << ' '
+                 << progress.average_fitness << ' ' << progress.milliseconds;
+            job->send(line.str());
+            return !job->cancelled;
+        });
+        
+        if (!result.success)
+            job->finish("failed " + id + " " + result.error);
+        else if (!result.completed)
+            job->finish("failed " + id + " cancelled after " + std::to_string(result.generations) + " generations");
+        else
+        {
+            std::ostringstream line;
+            line << "done " << id << ' ' << result.generations << ' ' << result.best_fitness << ' ' << result.seconds << ' ' << job->config.output;
+            job->finish(line.str());
+        }
+        BLT_INFO("Finished job %s in %lfs", id.c_str(), result.seconds);
+    }
+}
+
+static int serve()
+{
+    auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+    // a socket file left behind by a service which didn't exit cleanly
+    unlink(socket_path.c_str());
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, 16) != 0)
+    {
+        BLT_WARN("Unable to listen on %s", socket_path.c_str());
+        return 1;
+    }
+    listen_fd = fd;
+    
+    // closing the listening socket makes accept fail, which is how the loop below notices it should exit
+    const auto shutdown = [](int) {
+        auto listening = listen_fd.exchange(-1);
+        if (listening >= 0)
+            ::shutdown(listening, SHUT_RDWR);
+    };
+    std::signal(SIGINT, shutdown);
+    std::signal(SIGTERM, shutdown);
+    
+    setup_operators();
+    // every job starts from the settings the service was built with, plus its own overrides
+    const run_config_t defaults{};
+    
+    std::thread gp_thread([]() {
+        scheduler.run_loop(execute_generation, []() {
+            return program.get_population_stats().best_fitness.load();
+        });
+    });
+    std::thread job_thread(run_jobs);
+    BLT_INFO("Listening on %s, seed %ld", socket_path.c_str(), SEED);
+    
+    while (true)
+    {
+        auto client = accept(fd, nullptr, nullptr);
+        if (client < 0)
+        {
+            if (errno == EINTR && listen_fd >= 0)
+                continue;
+            break;
+        }
+        {
+            std::scoped_lock lock(connection_mutex);
+            active_connections++;
+        }
+        std::thread(handle_connection, client, std::cref(defaults)).detach();
+    }
+    
+    BLT_INFO("Shutting down");
+    for (auto& job : job_queue.close())
+        job->finish("failed " + std::to_string(job->id) + " the service is shutting down");
+    job_thread.join();
+    scheduler.stop();
+    gp_thread.join();
+    eval_farm.stop();
+    {
+        std::unique_lock lock(connection_mutex);
+        connection_cv.wait(lock, []() { return active_connections == 0; });
+    }
+    close(fd);
+    unlink(socket_path.c_str());
+    program.kill();
+    return 0;
+}
+
+static int submit(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        BLT_WARN("Usage: %s submit <target> [key=value]...", argv[0]);
+        return 1;
+    }
+    auto fd = connect_to_service();
+    if (fd < 0)
+        return 1;
+    
+    // the service has its own working directory, so paths are resolved here
+    std::string output = "headless_output";
+    std::vector<std::string> lines;
+    lines.push_back("target = " + std::filesystem::absolute(argv[2]).string());
+    for (int i = 3; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        auto equals = argument.find('=');
+        if (equals == std::string::npos)
+        {
+            BLT_WARN("Expected key=value, got '%s'", argument.c_str());
+            close(fd);
+            return 1;
+        }
+        if (argument.substr(0, equals) == "output")
+            output = argument.substr(equals + 1);
+        else
+            lines.push_back(argument.substr(0, equals) + " = " + argument.substr(equals + 1));
+    }
+    lines.push_back("output = " + std::filesystem::absolute(output).string());
+    lines.emplace_back("run");
+    
+    // a rejected request is answered and closed early, the reason is still there to read below
+    for (const auto& line : lines)
+    {
+        if (!send_line(fd, line))
+            break;
+    }
+    
+    line_reader_t reader{fd};
+    std::string line;
+    int status = 1;
+    while (reader.next(line))
+    {
+        std::cout << line << std::endl;
+        if (line.rfind("done", 0) == 0)
+            status = 0;
+    }
+    close(fd);
+    return status;
+}
+
+static int status()
+{
+    auto fd = connect_to_service();
+    if (fd < 0)
+        return 1;
+    send_line(fd, "status");
+    line_reader_t reader{fd};
+    std::string line;
+    blt::size_t count = 0;
+    while (reader.next(line))
+    {
+        std::cout << line << std::endl;
+        count++;
+    }
+    if (count == 0)
+        std::cout << "idle" << std::endl;
+    close(fd);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    const std::string_view command = argc > 1 ? argv[1] : "";
+    if (command == "serve")
+        return serve();
+    if (command == "submit")
+        return submit(argc, argv);
+    if (command == "status")
+        return status();
+    BLT_WARN("Usage: %s serve | submit <target> [key=value]... | status", argv[0]);
+    return 1;
+}
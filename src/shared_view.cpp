@@ -0,0 +1,249 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <shared_view.h>
+#include <blt/std/logging.h>
+#include <chrono>
+#include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static constexpr blt::u32 VIEW_MAGIC = 0x56474749; // "IGGV"
+// changes whenever the layout does, a viewer built from different code refuses to attach
+static constexpr blt::u32 VIEW_LAYOUT = 3;
+static constexpr blt::size_t VIEW_SLOTS = 3;
+static constexpr blt::size_t COMMAND_CAPACITY = 64;
+
+static_assert(std::atomic_uint64_t::is_always_lock_free, "Shared memory atomics must be lock free to work across processes");
+static_assert(std::is_trivially_copyable_v<population_snapshot_t>);
+
+struct shared_slot_t
+{
+    // odd while the host is writing the slot
+    std::atomic_uint64_t sequence;
+    population_snapshot_t snapshot;
+};
+
+// several viewers can send at once, so a sender claims a position by moving command_tail and then fills the slot, which tells the host
+// when the command in it is complete
+struct command_slot_t
+{
+    // 2 * lap while the slot is free for that lap's command, one more once the command has been written
+    std::atomic_uint64_t sequence;
+    view_command_t command;
+};
+
+struct shared_view_header_t
+{
+    blt::u32 magic;
+    blt::u32 layout;
+    blt::u64 host_pid;
+    blt::u64 snapshot_size;
+    // number of snapshots published so far, the newest is in slot (published - 1) % VIEW_SLOTS
+    std::atomic_uint64_t published;
+    // only the host moves the head
+    std::atomic_uint64_t command_head;
+    std::atomic_uint64_t command_tail;
+    command_slot_t commands[COMMAND_CAPACITY];
+    shared_slot_t slots[VIEW_SLOTS];
+};
+
+bool shared_view_host_t::open(const std::string& view_name, std::function<void(const view_command_t&)> handler)
+{
+    close();
+    // a segment left behind by a crashed host is simply replaced
+    shm_unlink(view_name.c_str());
+    auto fd = shm_open(view_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+    {
+        BLT_WARN("Unable to create shared view %s", view_name.c_str());
+        return false;
+    }
+    if (ftruncate(fd, sizeof(shared_view_header_t)) != 0)
+    {
+        ::close(fd);
+        shm_unlink(view_name.c_str());
+        return false;
+    }
+    auto* memory = mmap(nullptr, sizeof(shared_view_header_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED)
+    {
+        shm_unlink(view_name.c_str());
+        return false;
+    }
+    
+    // the segment is zero filled, which is a valid state for every atomic in it
+    header = static_cast<shared_view_header_t*>(memory);
+    header->host_pid = static_cast<blt::u64>(getpid());
+    header->snapshot_size = sizeof(population_snapshot_t);
+    header->layout = VIEW_LAYOUT;
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = VIEW_MAGIC;
+    name = view_name;
+    
+    polling = true;
+    poll_thread = std::thread([this, handler = std::move(handler)]() {
+        while (polling)
+        {
+            auto head = header->command_head.load(std::memory_order_relaxed);
+            while (true)
+            {
+                auto& slot = header->commands[head % COMMAND_CAPACITY];
+                const auto lap = head / COMMAND_CAPACITY * 2;
+                // a viewer which has claimed the slot but not finished writing it holds up everything behind it until it does
+                if (slot.sequence.load(std::memory_order_acquire) != lap + 1)
+                    break;
+                handler(slot.command);
+                slot.sequence.store(lap + 2, std::memory_order_release);
+                head++;
+            }
+            header->command_head.store(head, std::memory_order_relaxed);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    });
+    BLT_INFO("Sharing population view as %s, attach with: image-gp-6 attach %s", view_name.c_str(), view_name.c_str());
+    return true;
+}
+
+void shared_view_host_t::publish(const population_snapshot_t& snapshot)
+{
+    if (header == nullptr)
+        return;
+    const auto published = header->published.load(std::memory_order_relaxed);
+    auto& slot = header->slots[published % VIEW_SLOTS];
+    
+    const auto sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&slot.snapshot, &snapshot, sizeof(snapshot));
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+    header->published.store(published + 1, std::memory_order_release);
+}
+
+void shared_view_host_t::close()
+{
+    if (header == nullptr)
+        return;
+    polling = false;
+    if (poll_thread.joinable())
+        poll_thread.join();
+    munmap(header, sizeof(shared_view_header_t));
+    shm_unlink(name.c_str());
+    header = nullptr;
+}
+
+shared_view_host_t::~shared_view_host_t()
+{
+    close();
+}
+
+bool shared_view_client_t::attach(const std::string& name)
+{
+    detach();
+    auto fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0)
+    {
+        BLT_WARN("No shared view named %s, is the gp process running with sharing enabled?", name.c_str());
+        return false;
+    }
+    auto* memory = mmap(nullptr, sizeof(shared_view_header_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED)
+        return false;
+    
+    header = static_cast<shared_view_header_t*>(memory);
+    if (header->magic != VIEW_MAGIC || header->layout != VIEW_LAYOUT || header->snapshot_size != sizeof(population_snapshot_t))
+    {
+        BLT_WARN("Shared view %s was created by an incompatible build", name.c_str());
+        detach();
+        return false;
+    }
+    last_read = 0;
+    return true;
+}
+
+bool shared_view_client_t::read(population_snapshot_t& out)
+{
+    if (header == nullptr)
+        return false;
+    // a few attempts is plenty, the host only rewrites a slot after it has filled the other two
+    for (blt::size_t attempt = 0; attempt < 4; attempt++)
+    {
+        const auto published = header->published.load(std::memory_order_acquire);
+        if (published == 0 || published == last_read)
+            return false;
+        auto& slot = header->slots[(published - 1) % VIEW_SLOTS];
+        
+        const auto before = slot.sequence.load(std::memory_order_acquire);
+        if (before % 2 != 0)
+            continue;
+        std::memcpy(&out, &slot.snapshot, sizeof(out));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != before)
+            continue;
+        last_read = published;
+        return true;
+    }
+    return false;
+}
+
+bool shared_view_client_t::send(const view_command_t& command)
+{
+    if (header == nullptr)
+        return false;
+    auto tail = header->command_tail.load(std::memory_order_relaxed);
+    while (true)
+    {
+        auto& slot = header->commands[tail % COMMAND_CAPACITY];
+        const auto lap = tail / COMMAND_CAPACITY * 2;
+        const auto sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence == lap)
+        {
+            // another viewer may have taken this position since tail was read, in which case tail is reloaded and we go again
+            if (header->command_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed))
+            {
+                slot.command = command;
+                slot.sequence.store(lap + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (sequence < lap)
+            // the host hasn't drained the command sent a lap ago
+            return false;
+        else
+            tail = header->command_tail.load(std::memory_order_relaxed);
+    }
+}
+
+bool shared_view_client_t::host_alive() const
+{
+    return header != nullptr && kill(static_cast<pid_t>(header->host_pid), 0) == 0;
+}
+
+void shared_view_client_t::detach()
+{
+    if (header != nullptr)
+        munmap(header, sizeof(shared_view_header_t));
+    header = nullptr;
+}
+
+shared_view_client_t::~shared_view_client_t()
+{
+    detach();
+}
@@ -0,0 +1,160 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <steady_state.h>
+#include <affinity.h>
+#include <gp_system.h>
+#include <animation.h>
+#include <cost_scheduler.h>
+#include <evaluation_cost.h>
+#include <deadline.h>
+#include <tracer.h>
+#include <parallel.h>
+#include <blt/std/time.h>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <random>
+
+static fitness_components_t evaluate_offspring(blt::gp::tree_t& tree, full_image_t& image)
+{
+    trace_span_t span{"evaluate"};
+    deadline_guard deadline;
+    fitness_components_t components;
+    if (animation_settings.enabled)
+        components = evaluate_animation(tree, image);
+    else
+    {
+        if (evaluation_settings.tiled)
+            render_tree_tiled(tree, image);
+        else
+            image = tree.get_evaluation_value<full_image_t>(nullptr);
+        components = score_image(image, full_target());
+    }
+    deadline.finish(components);
+    return components;
+}
+
+void run_steady_state_epoch()
+{
+    auto& individuals = program.get_current_pop().get_individuals();
+    const auto population = individuals.size();
+    const blt::size_t threads = steady_state_settings.threads == 0 ? std::max(std::thread::hardware_concurrency(), 1u) : steady_state_settings.threads;
+    const auto epoch_seed = program.get_random().get_u64(1, std::numeric_limits<blt::i64>::max());
+    const auto operator_total = config.crossover_chance + config.mutation_chance + config.reproduction_chance;
+    
+    steady_state_stats.reset();
+    steady_state_stats.threads = std::min(threads, population);
+    cost_budget_stats.reset();
+    cost_model.ensure_costs();
+    const auto epoch_start = blt::system::getCurrentTimeNanoseconds();
+    
+    // selection and insertion touch the population, breeding and evaluating only touch the thread's own copies
+    std::mutex population_mutex;
+    std::atomic_uint64_t handed_out = 0;
+    parallel_for(threads, [&](blt::size_t thread) {
+        // before the scratch image is taken, pinning may replace it with one on the new node
+        worker_placement_t placement{thread};
+        std::mt19937_64 random{epoch_seed + thread};
+        std::uniform_int_distribution<blt::size_t> any_individual{0, population - 1};
+        // the transformers keep state between calls, so every thread has its own
+        auto crossover = image_crossover;
+        auto mutation = image_mutation;
+        auto& image = image_store_t::scratch();
+        
+        // fittest (or least fit) of count individuals drawn at random, called with the population locked
+        const auto tournament = [&](blt::size_t count, bool fittest) {
+            auto winner = any_individual(random);
+            for (blt::size_t i = 1; i < count; i++)
+            {
+                const auto challenger = any_individual(random);
+                const auto challenger_fitness = individuals[challenger].fitness.adjusted_fitness;
+                const auto winner_fitness = individuals[winner].fitness.adjusted_fitness;
+                if (fittest ? challenger_fitness > winner_fitness : challenger_fitness < winner_fitness)
+                    winner = challenger;
+            }
+            return winner;
+        };
+        
+        while (handed_out.fetch_add(1, std::memory_order_relaxed) < population)
+        {
+            const auto offspring_start = blt::system::getCurrentTimeNanoseconds();
+            const auto choice = std::uniform_real_distribution<double>{0, operator_total}(random);
+            
+            std::optional<trace_span_t> select_span{"select"};
+            std::unique_lock lock(population_mutex);
+            blt::gp::tree_t child = individuals[tournament(steady_state_settings.selection_size, true)].tree;
+            if (choice < config.crossover_chance)
+            {
+                blt::gp::tree_t other = individuals[tournament(steady_state_settings.selection_size, true)].tree;
+                lock.unlock();
+                select_span.reset();
+                auto result = crossover.apply(program, child, other);
+                if (result)
+                    child = std::move(result->child1);
+            } else
+            {
+                lock.unlock();
+                select_span.reset();
+                if (choice < config.crossover_chance + config.mutation_chance)
+                    child = mutation.apply(program, child);
+            }
+            
+            evaluation_result_t result;
+            result.predicted_ns = cost_model.predict(child);
+            cost_budget_stats.add(result.predicted_ns);
+            if (!within_cost_budget(result.predicted_ns))
+            {
+                cost_budget_stats.rejected++;
+                steady_state_stats.offspring++;
+                steady_state_stats.busy_ns += blt::system::getCurrentTimeNanoseconds() - offspring_start;
+                continue;
+            }
+            
+            const auto render_start = blt::system::getCurrentTimeNanoseconds();
+            result.components = evaluate_offspring(child, image);
+            result.level = LEVEL_COUNT - 1;
+            result.measured_ns = blt::system::getCurrentTimeNanoseconds() - render_start;
+            // the same fitness the fitness function gives an individual nobody has clicked on
+            const auto raw_fitness = result.components.combine() + cost_penalty(result) + last_fitness;
+            const auto adjusted_fitness = 1.0 / (1.0 + raw_fitness);
+            
+            lock.lock();
+            const auto loser = tournament(steady_state_settings.replacement_size, false);
+            if (individuals[loser].fitness.adjusted_fitness <= adjusted_fitness)
+            {
+                auto& individual = individuals[loser];
+                individual.tree = std::move(child);
+                individual.fitness.raw_fitness = raw_fitness;
+                individual.fitness.standardized_fitness = raw_fitness;
+                individual.fitness.adjusted_fitness = adjusted_fitness;
+                evaluation_results[loser] = result;
+                // a fitness assigned by clicking belonged to the individual which was just replaced
+                fitness_values[loser] = -1;
+                if (generation_images.retained(loser))
+                    generation_images[loser] = image;
+            } else
+                steady_state_stats.rejected++;
+            lock.unlock();
+            
+            steady_state_stats.offspring++;
+            steady_state_stats.busy_ns += blt::system::getCurrentTimeNanoseconds() - offspring_start;
+        }
+    }, threads);
+    
+    steady_state_stats.wall_ns = blt::system::getCurrentTimeNanoseconds() - epoch_start;
+}
@@ -0,0 +1,223 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <target_cache.h>
+#include <fitness.h>
+#include <blt/std/logging.h>
+#include <blt/std/assert.h>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// bump whenever the layout or the way targets are prepared changes, stale caches are then ignored
+static constexpr blt::u32 CACHE_VERSION = 1;
+static constexpr blt::u32 CACHE_MAGIC = 0x43544749; // "IGTC"
+
+struct cache_header_t
+{
+    blt::u32 magic;
+    blt::u32 version;
+    blt::u64 source_hash;
+    blt::u64 image_size;
+    blt::u64 level_count;
+};
+
+// followed by the image, then hsv, then histogram data, each padded out to 8 bytes
+struct cache_level_t
+{
+    blt::u64 size;
+    blt::u64 hist_rows;
+    blt::u64 hist_cols;
+    fractal_stats fractal;
+};
+
+static_assert(std::is_trivially_copyable_v<cache_header_t> && std::is_trivially_copyable_v<cache_level_t>);
+
+// the hsv and histogram matrices of every level point into this mapping, so it lives until exit
+struct cache_mapping_t
+{
+    void* data = nullptr;
+    blt::size_t size = 0;
+    
+    ~cache_mapping_t()
+    {
+        if (data != nullptr)
+            munmap(data, size);
+    }
+};
+
+static cache_mapping_t mapping;
+
+static blt::size_t padded(blt::size_t bytes)
+{
+    return (bytes + 7) & ~static_cast<blt::size_t>(7);
+}
+
+static std::string cache_path(blt::u64 hash)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016lx.cache", static_cast<unsigned long>(hash));
+    return std::string(TARGET_CACHE_DIRECTORY) + "/" + name;
+}
+
+blt::u64 hash_file(const std::string& path)
+{
+    // fnv-1a, the images are only a few megabytes so anything stronger would just be slower
+    std::ifstream file{path, std::ios::binary};
+    blt::u64 hash = 0xcbf29ce484222325;
+    char buffer[1 << 16];
+    while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0)
+    {
+        for (std::streamsize i = 0; i < file.gcount(); i++)
+        {
+            hash ^= static_cast<blt::u8>(buffer[i]);
+            hash *= 0x100000001b3;
+        }
+    }
+    return hash;
+}
+
+bool load_target_cache(const std::string& path)
+{
+    const auto hash = hash_file(path);
+    const auto file_path = cache_path(hash);
+    
+    auto fd = open(file_path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info{};
+    if (fstat(fd, &info) != 0 || static_cast<blt::size_t>(info.st_size) < sizeof(cache_header_t))
+    {
+        close(fd);
+        return false;
+    }
+    const auto size = static_cast<blt::size_t>(info.st_size);
+    auto* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    
+    auto* bytes = static_cast<const blt::u8*>(data);
+    cache_header_t header{};
+    std::memcpy(&header, bytes, sizeof(header));
+    if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.source_hash != hash || header.image_size != IMAGE_SIZE ||
+        header.level_count != LEVEL_COUNT)
+    {
+        munmap(data, size);
+        return false;
+    }
+    
+    // validate everything before touching target_levels, a truncated file should fall back to a cold start
+    blt::size_t offset = sizeof(header);
+    std::array<cache_level_t, LEVEL_COUNT> levels{};
+    std::array<blt::size_t, LEVEL_COUNT> level_offsets{};
+    for (blt::size_t i = 0; i < LEVEL_COUNT; i++)
+    {
+        if (offset + sizeof(cache_level_t) > size)
+        {
+            munmap(data, size);
+            return false;
+        }
+        std::memcpy(&levels[i], bytes + offset, sizeof(cache_level_t));
+        offset += sizeof(cache_level_t);
+        level_offsets[i] = offset;
+        
+        const auto image_bytes = padded(levels[i].size * levels[i].size * CHANNELS * sizeof(float));
+        const auto hist_bytes = padded(levels[i].hist_rows * levels[i].hist_cols * sizeof(float));
+        offset += image_bytes * 2 + hist_bytes;
+        if (levels[i].size != RESOLUTION_LEVELS[i] || offset > size)
+        {
+            munmap(data, size);
+            return false;
+        }
+    }
+    
+    if (mapping.data != nullptr)
+        munmap(mapping.data, mapping.size);
+    mapping.data = data;
+    mapping.size = size;
+    
+    for (blt::size_t i = 0; i < LEVEL_COUNT; i++)
+    {
+        auto& level = target_levels[i];
+        const auto& cached = levels[i];
+        const auto image_bytes = padded(cached.size * cached.size * CHANNELS * sizeof(float));
+        auto* base = const_cast<blt::u8*>(bytes + level_offsets[i]);
+        auto side = static_cast<int>(cached.size);
+        
+        level.size = cached.size;
+        level.fractal = cached.fractal;
+        std::memcpy(level.image.rgb_data, base, cached.size * cached.size * CHANNELS * sizeof(float));
+        level.hsv = cv::Mat{side, side, CV_32FC3, base + image_bytes};
+        level.hist = cv::Mat{static_cast<int>(cached.hist_rows), static_cast<int>(cached.hist_cols), CV_32F, base + image_bytes * 2};
+    }
+    return true;
+}
+
+static void write_padded(std::ofstream& out, const void* data, blt::size_t bytes)
+{
+    static constexpr char zeros[8]{};
+    out.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+    out.write(zeros, static_cast<std::streamsize>(padded(bytes) - bytes));
+}
+
+bool save_target_cache(const std::string& path)
+{
+    const auto hash = hash_file(path);
+    const auto file_path = cache_path(hash);
+    const auto temp_path = file_path + ".tmp";
+    
+    std::error_code error;
+    std::filesystem::create_directories(TARGET_CACHE_DIRECTORY, error);
+    
+    {
+        std::ofstream out{temp_path, std::ios::binary};
+        if (!out)
+        {
+            BLT_WARN("Unable to write target cache %s", temp_path.c_str());
+            return false;
+        }
+        
+        cache_header_t header{CACHE_MAGIC, CACHE_VERSION, hash, IMAGE_SIZE, LEVEL_COUNT};
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const auto& level : target_levels)
+        {
+            // the matrices are written as raw rows, so they have to be contiguous floats
+            cv::Mat hsv = level.hsv.isContinuous() ? level.hsv : level.hsv.clone();
+            cv::Mat hist = level.hist.isContinuous() ? level.hist : level.hist.clone();
+            BLT_ASSERT(hsv.type() == CV_32FC3 && hist.type() == CV_32F);
+            
+            cache_level_t cached{level.size, static_cast<blt::u64>(hist.rows), static_cast<blt::u64>(hist.cols), level.fractal};
+            out.write(reinterpret_cast<const char*>(&cached), sizeof(cached));
+            write_padded(out, level.image.rgb_data, level.size * level.size * CHANNELS * sizeof(float));
+            write_padded(out, hsv.ptr<float>(), level.size * level.size * CHANNELS * sizeof(float));
+            write_padded(out, hist.ptr<float>(), hist.total() * sizeof(float));
+        }
+        if (!out)
+        {
+            BLT_WARN("Failed writing target cache %s", temp_path.c_str());
+            return false;
+        }
+    }
+    // written under a temporary name so a crash can never leave a half written cache behind
+    std::filesystem::rename(temp_path, file_path, error);
+    return !error;
+}
@@ -0,0 +1,138 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <thread_budget.h>
+#include <config.h>
+#include <evaluation.h>
+#include <animation.h>
+#include <steady_state.h>
+#include <parallel.h>
+#include <blt/std/logging.h>
+#include <blt/std/time.h>
+#include "opencv2/core/utility.hpp"
+#include <sched.h>
+#include <sys/resource.h>
+#include <thread>
+
+// an outer thread needs a few individuals to even out how much each one costs, smaller populations leave the spare cores to the inner layer
+static constexpr blt::size_t INDIVIDUALS_PER_THREAD = 2;
+
+// whatever opencv picked for itself, restored when the policy goes back to manual
+static const int opencv_default_threads = cv::getNumThreads();
+
+blt::size_t available_cores()
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+        return std::max(CPU_COUNT(&set), 1);
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+void set_opencv_threads(blt::size_t threads)
+{
+    // 0 turns opencv's pool off, every call runs on the thread which made it
+    const auto wanted = threads <= 1 ? 0 : static_cast<int>(threads);
+    if (cv::getNumThreads() != std::max(wanted, 1))
+        cv::setNumThreads(wanted);
+}
+
+thread_split_t thread_budget_t::split(const thread_budget_settings_t& settings, blt::size_t population)
+{
+    const auto cores = settings.cores == 0 ? available_cores() : settings.cores;
+    switch (settings.policy)
+    {
+        case thread_policy_t::MANUAL:
+        case thread_policy_t::OUTER:
+            return {cores, 1};
+        case thread_policy_t::INNER:
+            return {1, cores};
+        case thread_policy_t::ADAPTIVE:
+        {
+            const auto outer = std::clamp(population / INDIVIDUALS_PER_THREAD, 1ul, cores);
+            return {outer, std::max(cores / outer, 1ul)};
+        }
+    }
+    return {cores, 1};
+}
+
+void thread_budget_t::begin_generation()
+{
+    const auto cores = settings.cores == 0 ? available_cores() : settings.cores;
+    const auto program_threads = std::max(config.threads, 1ul);
+    thread_budget_stats.program_threads = program_threads;
+    
+    if (settings.policy == thread_policy_t::MANUAL)
+    {
+        if (manual)
+        {
+            evaluation_settings.scheduler_threads = manual->scheduler;
+            evaluation_settings.tile_threads = manual->tile;
+            steady_state_settings.threads = manual->steady_state;
+            animation_settings.threads = manual->animation;
+            manual.reset();
+        }
+        render_outside = false;
+        default_thread_count = 0;
+        if (cv::getNumThreads() != opencv_default_threads)
+            cv::setNumThreads(opencv_default_threads);
+        thread_budget_stats.outer = program_threads;
+        thread_budget_stats.inner = static_cast<blt::size_t>(cv::getNumThreads());
+    } else
+    {
+        if (!manual)
+            manual = manual_threads_t{evaluation_settings.scheduler_threads, evaluation_settings.tile_threads, steady_state_settings.threads,
+                                      animation_settings.threads};
+        const auto budget = split(settings, population_size);
+        evaluation_settings.scheduler_threads = budget.outer;
+        evaluation_settings.tile_threads = budget.inner;
+        steady_state_settings.threads = budget.outer;
+        animation_settings.threads = budget.inner;
+        default_thread_count = budget.outer;
+        set_opencv_threads(budget.inner);
+        render_outside = budget.outer < program_threads;
+        thread_budget_stats.outer = budget.outer;
+        thread_budget_stats.inner = budget.inner;
+    }
+    thread_budget_stats.opencv_threads = static_cast<blt::size_t>(cv::getNumThreads());
+    thread_budget_stats.oversubscription = static_cast<double>(thread_budget_stats.outer * thread_budget_stats.inner) / static_cast<double>(cores);
+    
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    start_voluntary = usage.ru_nvcsw;
+    start_involuntary = usage.ru_nivcsw;
+    start_ns = blt::system::getCurrentTimeNanoseconds();
+}
+
+void thread_budget_t::configure(const thread_budget_settings_t& new_settings)
+{
+    settings = new_settings;
+    manual.reset();
+}
+
+void thread_budget_t::end_generation()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    thread_budget_stats.voluntary_switches = static_cast<blt::u64>(std::max(usage.ru_nvcsw - start_voluntary, 0l));
+    thread_budget_stats.involuntary_switches = static_cast<blt::u64>(std::max(usage.ru_nivcsw - start_involuntary, 0l));
+    thread_budget_stats.seconds = static_cast<double>(blt::system::getCurrentTimeNanoseconds() - start_ns) / 1e9;
+    
+    BLT_DEBUG("Thread budget: %ld outer x %ld inner (%lfx the cores), %lf involuntary context switches a second",
+              thread_budget_stats.outer.load(), thread_budget_stats.inner.load(), thread_budget_stats.oversubscription.load(),
+              thread_budget_stats.involuntary_per_second());
+}
@@ -0,0 +1,139 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <tiles.h>
+#include <image_operations.h>
+#include <deadline.h>
+#include <blt/std/logging.h>
+#include <blt/std/assert.h>
+
+struct halo_value_t
+{
+    blt::size_t halo = 0;
+    // kernel size, only known for integer literals
+    blt::u64 size = 0;
+    bool has_size = false;
+};
+
+// walk the tree the same way it is evaluated, tracking the halo each value needs instead of the value itself. on_operator is handed the
+// radius of every operator in the order they are evaluated
+template<typename Func>
+static blt::size_t walk_halo(blt::gp::tree_t& tree, const eval_region_t& region, Func&& on_operator)
+{
+    eval_region_guard guard{region};
+    
+    auto& ops = tree.get_operations();
+    auto& vals = tree.get_values();
+    
+    static thread_local std::vector<halo_value_t> stack;
+    stack.clear();
+    
+    blt::size_t bytes_from_head = 0;
+    for (auto it = ops.rbegin(); it != ops.rend(); ++it)
+    {
+        const auto& op = *it;
+        if (op.is_value)
+        {
+            halo_value_t value;
+            if (op.type_size == sizeof(blt::u64))
+            {
+                value.size = vals.from<blt::u64>(bytes_from_head);
+                value.has_size = true;
+            }
+            bytes_from_head += blt::gp::stack_allocator::aligned_size(op.type_size);
+            stack.push_back(value);
+            continue;
+        }
+        
+        auto argc = program.get_operator_info(op.id).argc.argc;
+        halo_value_t result;
+        blt::u64 size = u64_size_max;
+        for (blt::size_t i = 0; i < argc; i++)
+        {
+            auto& arg = stack.back();
+            result.halo = std::max(result.halo, arg.halo);
+            if (arg.has_size)
+                size = arg.size;
+            stack.pop_back();
+        }
+        const auto radius = operator_radius(operator_kinds[op.id], size);
+        on_operator(radius);
+        result.halo += radius;
+        stack.push_back(result);
+    }
+    
+    return stack.empty() ? 0 : stack.back().halo;
+}
+
+blt::size_t tree_halo(blt::gp::tree_t& tree, const eval_region_t& region)
+{
+    return walk_halo(tree, region, [](blt::size_t) {});
+}
+
+blt::size_t count_shrunk_kernels(blt::gp::tree_t& tree, const eval_region_t& region)
+{
+    auto full = region;
+    full.kernel_scale = full.scale;
+    
+    static thread_local std::vector<blt::size_t> radii;
+    radii.clear();
+    walk_halo(tree, full, [](blt::size_t radius) { radii.push_back(radius); });
+    
+    blt::size_t index = 0;
+    blt::size_t shrunk = 0;
+    walk_halo(tree, region, [&index, &shrunk](blt::size_t radius) {
+        if (radius < radii[index++])
+            shrunk++;
+    });
+    return shrunk;
+}
+
+bool tile_fits(blt::size_t tile_size, blt::size_t halo)
+{
+    return tile_size + halo * 2 <= IMAGE_SIZE;
+}
+
+void render_tile(blt::gp::tree_t& tree, const eval_region_t& region, blt::size_t halo, const tile_t& tile, float* dst, blt::size_t stride)
+{
+    auto x0 = tile.x > halo ? tile.x - halo : 0;
+    auto y0 = tile.y > halo ? tile.y - halo : 0;
+    auto x1 = std::min(tile.x + tile.width + halo, region.width);
+    auto y1 = std::min(tile.y + tile.height + halo, region.height);
+    
+    eval_region_t tile_region = region;
+    tile_region.width = x1 - x0;
+    tile_region.height = y1 - y0;
+    tile_region.offset_x = region.offset_x + static_cast<float>(x0) * region.scale;
+    tile_region.offset_y = region.offset_y + static_cast<float>(y0) * region.scale;
+    BLT_ASSERT(tile_region.width <= IMAGE_SIZE && tile_region.height <= IMAGE_SIZE && "Tile and halo must fit inside an image!");
+    
+    // a tile is the smallest piece of an individual the deadline cancels on its own, the tiles left are skipped outright
+    if (deadline_passed())
+        return;
+    
+    static thread_local full_image_t image;
+    {
+        eval_region_guard guard{tile_region};
+        image = tree.get_evaluation_value<full_image_t>(nullptr);
+    }
+    
+    for (blt::size_t y = 0; y < tile.height; y++)
+    {
+        const auto* src_row = image.rgb_data + ((y + tile.y - y0) * tile_region.width + (tile.x - x0)) * CHANNELS;
+        std::memcpy(dst + y * stride * CHANNELS, src_row, tile.width * CHANNELS * sizeof(float));
+    }
+}
@@ -0,0 +1,176 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <tracer.h>
+#include <blt/std/logging.h>
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    // written only by the thread holding it. a span is published by moving head past it, so a reader knows which slots are complete and
+    // which could have been overwritten while it was reading them
+    struct trace_buffer_t
+    {
+        blt::size_t id = 0;
+        std::array<std::atomic<const char*>, TRACE_BUFFER_EVENTS> names{};
+        std::array<std::atomic_uint64_t, TRACE_BUFFER_EVENTS> starts{};
+        std::array<std::atomic_uint64_t, TRACE_BUFFER_EVENTS> ends{};
+        // spans ever written
+        std::atomic_uint64_t head = 0;
+    };
+    
+    // the pools rendering individuals start new threads every generation, so a buffer outlives its thread and is handed to the next one
+    // rather than every thread getting its own. memory stays bounded by the most threads alive at once
+    struct trace_registry_t
+    {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<trace_buffer_t>> buffers;
+        std::vector<trace_buffer_t*> unused;
+    };
+    
+    trace_registry_t& registry()
+    {
+        static trace_registry_t instance;
+        return instance;
+    }
+    
+    class thread_buffer_t
+    {
+        public:
+            trace_buffer_t& get()
+            {
+                if (buffer == nullptr)
+                {
+                    auto& reg = registry();
+                    std::scoped_lock lock(reg.mutex);
+                    if (reg.unused.empty())
+                    {
+                        reg.buffers.push_back(std::make_unique<trace_buffer_t>());
+                        reg.buffers.back()->id = reg.buffers.size();
+                        buffer = reg.buffers.back().get();
+                    } else
+                    {
+                        buffer = reg.unused.back();
+                        reg.unused.pop_back();
+                    }
+                }
+                return *buffer;
+            }
+            
+            ~thread_buffer_t()
+            {
+                if (buffer == nullptr)
+                    return;
+                auto& reg = registry();
+                std::scoped_lock lock(reg.mutex);
+                reg.unused.push_back(buffer);
+            }
+        
+        private:
+            trace_buffer_t* buffer = nullptr;
+    };
+}
+
+void tracer_t::set_enabled(bool enabled)
+{
+    if (enabled && !active)
+        since = blt::system::getCurrentTimeNanoseconds();
+    active = enabled;
+}
+
+void tracer_t::record(const char* name, blt::u64 start, blt::u64 end)
+{
+    thread_local thread_buffer_t thread_buffer;
+    auto& buffer = thread_buffer.get();
+    const auto index = buffer.head.load(std::memory_order_relaxed);
+    const auto slot = index % TRACE_BUFFER_EVENTS;
+    buffer.names[slot].store(name, std::memory_order_relaxed);
+    buffer.starts[slot].store(start, std::memory_order_relaxed);
+    buffer.ends[slot].store(end, std::memory_order_relaxed);
+    buffer.head.store(index + 1, std::memory_order_release);
+}
+
+bool tracer_t::write(const std::string& path) const
+{
+    struct span_t
+    {
+        const char* name;
+        blt::u64 start;
+        blt::u64 end;
+        blt::size_t thread;
+    };
+    
+    std::vector<span_t> spans;
+    blt::size_t threads = 0;
+    {
+        auto& reg = registry();
+        std::scoped_lock lock(reg.mutex);
+        threads = reg.buffers.size();
+        for (const auto& buffer : reg.buffers)
+        {
+            const auto head = buffer->head.load(std::memory_order_acquire);
+            const auto first = head > TRACE_BUFFER_EVENTS ? head - TRACE_BUFFER_EVENTS : 0;
+            const auto begin = spans.size();
+            for (auto index = first; index < head; index++)
+            {
+                const auto slot = index % TRACE_BUFFER_EVENTS;
+                spans.push_back({buffer->names[slot].load(std::memory_order_relaxed), buffer->starts[slot].load(std::memory_order_relaxed),
+                                 buffer->ends[slot].load(std::memory_order_relaxed), buffer->id});
+            }
+            // the owner kept recording while the slots were copied. anything it has since wrapped around onto, including the slot it may be
+            // halfway through writing, can't be trusted
+            const auto moved = buffer->head.load(std::memory_order_acquire);
+            const auto overwritten = moved + 1 > TRACE_BUFFER_EVENTS ? moved + 1 - TRACE_BUFFER_EVENTS : 0;
+            if (overwritten > first)
+                spans.erase(spans.begin() + static_cast<std::ptrdiff_t>(begin),
+                            spans.begin() + static_cast<std::ptrdiff_t>(begin + std::min(overwritten - first, head - first)));
+        }
+    }
+    
+    const auto from = since.load();
+    spans.erase(std::remove_if(spans.begin(), spans.end(), [from](const span_t& span) {
+        return span.start < from;
+    }), spans.end());
+    
+    std::ofstream out{path};
+    if (!out)
+    {
+        BLT_WARN("Unable to write trace to %s", path.c_str());
+        return false;
+    }
+    // chrome wants microseconds
+    const auto micros = [from](blt::u64 ns) {
+        return static_cast<double>(ns - std::min(ns, from)) / 1e3;
+    };
+    out << std::fixed;
+    out.precision(3);
+    out << "{\"traceEvents\":[\n";
+    for (blt::size_t thread = 1; thread <= threads; thread++)
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread << ",\"args\":{\"name\":\"thread " << thread << "\"}},\n";
+    for (const auto& span : spans)
+        out << "{\"name\":\"" << span.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << span.thread << ",\"ts\":" << micros(span.start)
+            << ",\"dur\":" << static_cast<double>(span.end - span.start) / 1e3 << "},\n";
+    // chrome's parser rejects a trailing comma, so the list ends on the process name instead
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"image-gp-6\"}}\n]}\n";
+    BLT_INFO("Wrote %ld spans over %ld threads to %s", spans.size(), threads, path.c_str());
+    return static_cast<bool>(out);
+}
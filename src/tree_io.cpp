@@ -0,0 +1,279 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <tree_io.h>
+#include <config.h>
+#include <image_operations.h>
+#include <blt/std/logging.h>
+#include <cstring>
+#include <fstream>
+
+static constexpr blt::u32 TREE_MAGIC = 0x54504749; // "IGPT"
+static constexpr blt::u32 TREE_VERSION = 1;
+
+template<typename T>
+static void write_value(std::ofstream& out, const T& value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+static bool read_value(std::ifstream& in, T& value)
+{
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+tree_data_t export_tree(blt::gp::tree_t& tree)
+{
+    tree_data_t data;
+    for (const auto& op : tree.get_operations())
+        data.operations.push_back({static_cast<blt::u64>(op.id), static_cast<blt::u64>(op.type_size), static_cast<blt::u8>(op.is_value)});
+    data.values.resize(tree.total_value_bytes());
+    tree.get_values().copy_to(data.values.data(), data.values.size());
+    return data;
+}
+
+blt::gp::tree_t import_tree(const tree_data_t& data, blt::gp::gp_program& destination)
+{
+    blt::gp::tree_t tree{destination};
+    auto& ops = tree.get_operations();
+    for (const auto& op : data.operations)
+        ops.emplace_back(op.type_size, op.id, op.is_value != 0);
+    tree.get_values().copy_from(const_cast<blt::u8*>(data.values.data()), data.values.size());
+    return tree;
+}
+
+template<typename T>
+static void append_value(std::vector<blt::u8>& out, const T& value)
+{
+    const auto* bytes = reinterpret_cast<const blt::u8*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template<typename T>
+static bool take_value(const blt::u8*& bytes, const blt::u8* end, T& value)
+{
+    if (static_cast<blt::size_t>(end - bytes) < sizeof(T))
+        return false;
+    std::memcpy(&value, bytes, sizeof(T));
+    bytes += sizeof(T);
+    return true;
+}
+
+enum class value_encoding_t : blt::u8
+{
+    RAW,
+    SOLID_IMAGE
+};
+
+static bool solid_image(const blt::u8* bytes, float (& colour)[CHANNELS])
+{
+    const auto* image = reinterpret_cast<const full_image_t*>(bytes);
+    for (blt::size_t c = 0; c < CHANNELS; c++)
+        colour[c] = image->rgb_data[c];
+    for (blt::size_t i = 0; i < DATA_SIZE * CHANNELS; i++)
+    {
+        if (std::memcmp(&image->rgb_data[i], &colour[i % CHANNELS], sizeof(float)) != 0)
+            return false;
+    }
+    return true;
+}
+
+void encode_values(const tree_data_t& tree, std::vector<blt::u8>& out)
+{
+    blt::size_t offset = 0;
+    for (const auto& op : tree.operations)
+    {
+        if (!op.is_value)
+            continue;
+        const auto size = blt::gp::stack_allocator::aligned_size(op.type_size);
+        const auto* value = tree.values.data() + offset;
+        offset += size;
+        
+        float colour[CHANNELS];
+        if (op.type_size == sizeof(full_image_t) && solid_image(value, colour))
+        {
+            append_value(out, value_encoding_t::SOLID_IMAGE);
+            for (auto channel : colour)
+                append_value(out, channel);
+        } else
+        {
+            append_value(out, value_encoding_t::RAW);
+            out.insert(out.end(), value, value + size);
+        }
+    }
+}
+
+bool decode_values(const blt::u8* bytes, const blt::u8* end, tree_data_t& tree)
+{
+    tree.values.clear();
+    for (const auto& op : tree.operations)
+    {
+        if (!op.is_value)
+            continue;
+        const auto size = blt::gp::stack_allocator::aligned_size(op.type_size);
+        value_encoding_t encoding;
+        if (!take_value(bytes, end, encoding))
+            return false;
+        
+        const auto offset = tree.values.size();
+        tree.values.resize(offset + size, 0);
+        if (encoding == value_encoding_t::SOLID_IMAGE)
+        {
+            float colour[CHANNELS];
+            for (auto& channel : colour)
+            {
+                if (!take_value(bytes, end, channel))
+                    return false;
+            }
+            if (op.type_size != sizeof(full_image_t))
+                return false;
+            auto* image = reinterpret_cast<full_image_t*>(tree.values.data() + offset);
+            for (blt::size_t i = 0; i < DATA_SIZE * CHANNELS; i++)
+                image->rgb_data[i] = colour[i % CHANNELS];
+        } else if (encoding == value_encoding_t::RAW && static_cast<blt::size_t>(end - bytes) >= size)
+        {
+            std::memcpy(tree.values.data() + offset, bytes, size);
+            bytes += size;
+        } else
+            return false;
+    }
+    return bytes == end;
+}
+
+void encode_tree(const tree_data_t& data, std::vector<blt::u8>& out)
+{
+    append_value(out, static_cast<blt::u32>(data.operations.size()));
+    for (const auto& op : data.operations)
+    {
+        append_value(out, static_cast<blt::u32>(op.id));
+        append_value(out, static_cast<blt::u32>(op.type_size));
+        append_value(out, op.is_value);
+    }
+    // the length is patched in once the values are encoded
+    const auto length_offset = out.size();
+    append_value(out, blt::u32{});
+    encode_values(data, out);
+    const auto length = static_cast<blt::u32>(out.size() - length_offset - sizeof(blt::u32));
+    std::memcpy(out.data() + length_offset, &length, sizeof(length));
+}
+
+bool decode_tree(const blt::u8* bytes, blt::size_t size, tree_data_t& out)
+{
+    const auto* end = bytes + size;
+    blt::u32 op_count;
+    if (!take_value(bytes, end, op_count))
+        return false;
+    
+    out.operations.clear();
+    for (blt::u32 i = 0; i < op_count; i++)
+    {
+        blt::u32 id, type_size;
+        blt::u8 is_value;
+        if (!take_value(bytes, end, id) || !take_value(bytes, end, type_size) || !take_value(bytes, end, is_value) || id >= operator_kinds.size())
+            return false;
+        out.operations.push_back({id, type_size, is_value});
+    }
+    
+    blt::u32 value_bytes;
+    if (!take_value(bytes, end, value_bytes) || static_cast<blt::size_t>(end - bytes) != value_bytes)
+        return false;
+    return decode_values(bytes, end, out);
+}
+
+bool save_tree(blt::gp::tree_t& tree, const std::string& path)
+{
+    std::ofstream out{path, std::ios::binary};
+    if (!out)
+    {
+        BLT_WARN("Unable to open %s for writing!", path.c_str());
+        return false;
+    }
+    
+    auto data = export_tree(tree);
+    
+    write_value(out, TREE_MAGIC);
+    write_value(out, TREE_VERSION);
+    write_value(out, static_cast<blt::u64>(operator_kinds.size()));
+    write_value(out, static_cast<blt::u64>(data.operations.size()));
+    for (const auto& op : data.operations)
+    {
+        write_value(out, op.id);
+        write_value(out, op.type_size);
+        write_value(out, op.is_value);
+    }
+    
+    write_value(out, static_cast<blt::u64>(data.values.size()));
+    out.write(reinterpret_cast<const char*>(data.values.data()), static_cast<std::streamsize>(data.values.size()));
+    
+    return static_cast<bool>(out);
+}
+
+std::optional<blt::gp::tree_t> load_tree(const std::string& path)
+{
+    std::ifstream in{path, std::ios::binary};
+    if (!in)
+    {
+        BLT_WARN("Unable to open %s for reading!", path.c_str());
+        return {};
+    }
+    
+    blt::u32 magic, version;
+    blt::u64 operator_count, op_count;
+    if (!read_value(in, magic) || !read_value(in, version) || magic != TREE_MAGIC || version != TREE_VERSION)
+    {
+        BLT_WARN("%s is not a tree file or was written by a different version!", path.c_str());
+        return {};
+    }
+    if (!read_value(in, operator_count) || operator_count != operator_kinds.size())
+    {
+        BLT_WARN("%s was written with a different set of operators!", path.c_str());
+        return {};
+    }
+    if (!read_value(in, op_count))
+        return {};
+    
+    tree_data_t data;
+    blt::size_t expected_bytes = 0;
+    for (blt::size_t i = 0; i < op_count; i++)
+    {
+        tree_op_t op{};
+        if (!read_value(in, op.id) || !read_value(in, op.type_size) || !read_value(in, op.is_value) || op.id >= operator_count)
+        {
+            BLT_WARN("%s is truncated or corrupt!", path.c_str());
+            return {};
+        }
+        data.operations.push_back(op);
+        if (op.is_value)
+            expected_bytes += blt::gp::stack_allocator::aligned_size(op.type_size);
+    }
+    
+    blt::u64 bytes;
+    if (!read_value(in, bytes) || bytes != expected_bytes)
+    {
+        BLT_WARN("%s has a value stack which doesn't match its operators!", path.c_str());
+        return {};
+    }
+    data.values.resize(bytes);
+    if (!in.read(reinterpret_cast<char*>(data.values.data()), static_cast<std::streamsize>(bytes)))
+    {
+        BLT_WARN("%s is truncated!", path.c_str());
+        return {};
+    }
+    
+    return import_tree(data, program);
+}
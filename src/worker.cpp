@@ -0,0 +1,38 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <gp_system.h>
+#include <farm.h>
+#include <blt/std/logging.h>
+#include <unistd.h>
+
+// image-gp-6-worker [socket], renders trees for an evaluation farm. start as many as there are cores to spare, on this machine or any
+// other sharing the socket's filesystem, and kill or restart them whenever
+int main(int argc, char** argv)
+{
+    // a worker renders one tree at a time on its own thread, the program's pool would only sit idle
+    if (std::getenv("IMAGE_GP_THREADS") == nullptr)
+    {
+        setenv("IMAGE_GP_THREADS", "1", 1);
+        execv("/proc/self/exe", argv);
+    }
+    
+    setup_operators();
+    auto status = run_farm_worker(argc > 1 ? argv[1] : DEFAULT_FARM_SOCKET);
+    program.kill();
+    return status;
+}
@@ -0,0 +1,13 @@
+# fails unless racing.csv in RACING_OUTPUT shows at least one aborted individual
+file(STRINGS "${RACING_OUTPUT}/racing.csv" rows)
+list(REMOVE_AT rows 0)
+set(aborted 0)
+foreach (row IN LISTS rows)
+    string(REPLACE "," ";" columns "${row}")
+    list(GET columns 2 count)
+    math(EXPR aborted "${aborted} + ${count}")
+endforeach ()
+if (aborted EQUAL 0)
+    message(FATAL_ERROR "racing never aborted an individual")
+endif ()
+message(STATUS "racing aborted ${aborted} individuals")
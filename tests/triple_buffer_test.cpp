@@ -0,0 +1,81 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <triple_buffer.h>
+#include <cstdio>
+#include <thread>
+
+// every value in a buffer is written with the version it is published as, so a torn read shows up as a mismatch
+struct versioned_t
+{
+    std::uint64_t version = 0;
+    std::array<std::uint64_t, 1024> values{};
+};
+
+static constexpr std::uint64_t VERSIONS = 200000;
+
+int main()
+{
+    triple_buffer_t<versioned_t> buffer;
+    
+    std::thread writer([&buffer]() {
+        for (std::uint64_t version = 1; version <= VERSIONS; version++)
+        {
+            auto& value = buffer.write_buffer();
+            value.version = version;
+            value.values.fill(version);
+            buffer.publish();
+        }
+    });
+    
+    std::uint64_t last = 0;
+    std::uint64_t updates = 0;
+    bool failed = false;
+    while (last != VERSIONS && !failed)
+    {
+        if (!buffer.update())
+            continue;
+        updates++;
+        const auto& value = buffer.read_buffer();
+        if (value.version <= last)
+        {
+            std::printf("version went from %lu to %lu\n", static_cast<unsigned long>(last), static_cast<unsigned long>(value.version));
+            failed = true;
+        }
+        for (auto v : value.values)
+        {
+            if (v != value.version)
+            {
+                std::printf("buffer for version %lu holds %lu\n", static_cast<unsigned long>(value.version), static_cast<unsigned long>(v));
+                failed = true;
+                break;
+            }
+        }
+        last = value.version;
+    }
+    writer.join();
+    
+    // once the writer is done nothing new can show up
+    if (buffer.update())
+    {
+        std::printf("update succeeded after the last version was read\n");
+        failed = true;
+    }
+    
+    std::printf("read %lu of %lu versions\n", static_cast<unsigned long>(updates), static_cast<unsigned long>(VERSIONS));
+    return failed ? 1 : 0;
+}